@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "headers/data-link-impl.h"
+#include "headers/data-link-kernels.h"
+#include "headers/colors.h"
+
+#define BENCH_MIN_SECONDS 0.2
+#define CRC32C_CHECK_VALUE 0xE3069283u // CRC-32C of "123456789"
+
+static volatile uint32_t bench_sink;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Runs FCS-only (stuff == 0) or fused stuffing + FCS (stuff == 1) over one frame-sized buffer until
+// BENCH_MIN_SECONDS have passed and returns the throughput in GB/s.
+static double bench_run(data_link_fcs_mode_t mode, const unsigned char* data, size_t length, unsigned char* out, int stuff, double* ns_per_frame) {
+    size_t iterations = 0;
+    size_t batch = 1 + (1 << 20) / (length + 1);
+    double start = now_seconds();
+    double elapsed = 0;
+    do {
+        for(size_t i = 0; i < batch; i++) {
+            data_link_fcs_t fcs;
+            data_link_fcs_begin(&fcs, mode);
+            if(stuff) bench_sink += (uint32_t)data_link_stuff(data, length, out, DATA_LINK_STUFFED_FRAME_SIZE(DATA_LINK_DEFAULT_MTU), &fcs);
+            else data_link_fcs_update(&fcs, data, length);
+            bench_sink += fcs.state;
+        }
+        iterations += batch;
+        elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    *ns_per_frame = elapsed * 1e9 / (double)iterations;
+    return (double)length * (double)iterations / elapsed / 1e9;
+}
+
+int main() {
+    static const size_t sizes[] = {64, 256, 576, 1500};
+    unsigned char* data = (unsigned char*)malloc(DATA_LINK_DEFAULT_MTU);
+    unsigned char* out = (unsigned char*)malloc(DATA_LINK_STUFFED_FRAME_SIZE(DATA_LINK_DEFAULT_MTU));
+    if(data == NULL || out == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: Failed to allocate benchmark buffers.\n");
+        return 1;
+    }
+    // Payload without FLAG/ESC bytes, the common case the stuffing kernels are tuned for.
+    srand(1);
+    for(size_t i = 0; i < DATA_LINK_DEFAULT_MTU; i++) {
+        unsigned char byte = (unsigned char)rand();
+        data[i] = (byte == FLAG_BYTE || byte == ESC_BYTE) ? 0x20 : byte;
+    }
+    data_link_kernels_init();
+    int failures = 0;
+    for(int impl = 0; impl < DATA_LINK_CRC_IMPL_COUNT; impl++) {
+        if(data_link_crc_select((data_link_crc_impl_t)impl) != 0) continue;
+        uint32_t check = ~data_link_crc32c(0xFFFFFFFFu, (const unsigned char*)"123456789", 9);
+        if(check != CRC32C_CHECK_VALUE) {
+            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: CRC-32C (%s) check value 0x%08X, expected 0x%08X.\n", data_link_crc_name((data_link_crc_impl_t)impl), check, CRC32C_CHECK_VALUE);
+            failures++;
+        }
+    }
+    printf("Stuffing kernel: %s\n", data_link_kernel_name(data_link_kernel_active()));
+    printf("%-8s %-14s %6s %14s %10s %18s %10s\n", "fcs", "impl", "bytes", "fcs GB/s", "ns/frame", "stuff+fcs GB/s", "ns/frame");
+    for(int mode = 0; mode < DATA_LINK_FCS_MODE_COUNT; mode++) {
+        int impl_count = mode == DATA_LINK_FCS_CRC32C ? DATA_LINK_CRC_IMPL_COUNT : 1;
+        for(int impl = 0; impl < impl_count; impl++) {
+            const char* impl_name = "-";
+            if(mode == DATA_LINK_FCS_CRC32C) {
+                if(data_link_crc_select((data_link_crc_impl_t)impl) != 0) continue;
+                impl_name = data_link_crc_name((data_link_crc_impl_t)impl);
+            }
+            for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                double fcs_ns, fused_ns;
+                double fcs_rate = bench_run((data_link_fcs_mode_t)mode, data, sizes[s], out, 0, &fcs_ns);
+                double fused_rate = bench_run((data_link_fcs_mode_t)mode, data, sizes[s], out, 1, &fused_ns);
+                printf("%-8s %-14s %6zu %14.2f %10.1f %18.2f %10.1f\n", data_link_fcs_name((data_link_fcs_mode_t)mode), impl_name, sizes[s], fcs_rate, fcs_ns, fused_rate, fused_ns);
+            }
+        }
+    }
+    free(data);
+    free(out);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,481 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include "headers/data-link-impl.h"
+#include "headers/data-link-kernels.h"
+#include "headers/network-impl.h"
+#include "headers/transport-impl.h"
+#include "headers/reliable-impl.h"
+#include "headers/thread-pool.h"
+#include "headers/rx-dispatch.h"
+#include "headers/packet-buffer.h"
+#include "headers/checksum.h"
+#include "headers/log.h"
+#include "headers/colors.h"
+
+#define MICRO_MAX_RESULTS 128
+#define MICRO_MAX_RUNS 101
+#define MICRO_DEFAULT_RUNS 7
+#define MICRO_DEFAULT_RUN_MS 10.0
+#define MICRO_DEFAULT_THRESHOLD 10.0 // Percent slower than the baseline that counts as a regression
+#define MICRO_MAX_FRAGMENTS 64
+#define MICRO_NAME_SIZE 48
+
+typedef struct {
+    unsigned char* bytes;
+    size_t length;
+} micro_fragment_t;
+
+// Everything one case needs, prepared before timing starts.
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+    unsigned char* out;
+    size_t out_capacity;
+    data_link_fcs_mode_t fcs_mode;
+    micro_fragment_t fragments[MICRO_MAX_FRAGMENTS];
+    size_t fragment_count;
+    bool reverse;
+} micro_input_t;
+
+typedef void (*micro_kernel_t)(micro_input_t* input, size_t iterations);
+
+typedef struct {
+    char name[MICRO_NAME_SIZE];
+    size_t bytes; // Payload bytes per operation
+    double ns_per_op; // Median over the runs
+    double min_ns_per_op;
+    double stddev_percent;
+} micro_result_t;
+
+typedef struct {
+    int runs;
+    double run_ms;
+    const char* filter;
+    const char* json_path;
+    const char* baseline_path;
+    double threshold;
+} micro_config_t;
+
+static volatile uint64_t micro_sink;
+static micro_result_t micro_results[MICRO_MAX_RESULTS];
+static size_t micro_result_count = 0;
+static micro_fragment_t* micro_capture = NULL; // When set, the data link stub records the frames it is handed
+static size_t micro_capture_count = 0;
+static uint64_t micro_delivered = 0;
+static char micro_no_pool;
+
+// The network layer only checks that a pool exists; the rx_dispatch_next stub below runs every hop inline.
+threadpool thpool = (threadpool)&micro_no_pool;
+// Gives network_layer_init a default route for the fragmentation benchmark to send along.
+char destination_mac_address[20] = "micro_next_hop";
+_Thread_local bool physical_send_no_wait = false;
+uint32_t data_link_mtu = DATA_LINK_DEFAULT_MTU;
+// Receive kernels call the network layer inline on one thread, as a run-to-completion worker does.
+rx_mode_t rx_mode = RX_MODE_RUN_TO_COMPLETION;
+
+// Copies bytes [offset, offset + length) of the packet, linear bytes first and then its fragments.
+static void micro_copy_range(const packet_buffer_t* packet, size_t offset, size_t length, unsigned char* out) {
+    const unsigned char* data = packet->data;
+    size_t available = packet->length;
+    for(size_t i = 0; length > 0 && i <= packet->frag_count; i++) {
+        if(i > 0) {
+            data = packet->frags[i - 1].data;
+            available = packet->frags[i - 1].length;
+        }
+        if(offset >= available) {
+            offset -= available;
+            continue;
+        }
+        size_t take = available - offset < length ? available - offset : length;
+        memcpy(out, data + offset, take);
+        out += take;
+        length -= take;
+        offset = 0;
+    }
+}
+
+// Lays a frame out the way the receiving data link hands it to the network layer.
+static int micro_capture_frame(uint16_t protocol, const void* header, size_t header_size, const packet_buffer_t* packet, size_t offset, size_t length) {
+    if(micro_capture == NULL || micro_capture_count >= MICRO_MAX_FRAGMENTS) return 0;
+    micro_fragment_t* fragment = &micro_capture[micro_capture_count];
+    fragment->length = PROTOCOL_SIZE + header_size + length;
+    fragment->bytes = (unsigned char*)malloc(fragment->length);
+    if(fragment->bytes == NULL) return -1;
+    micro_capture_count++;
+    fragment->bytes[0] = (protocol >> 8) & 0xFF;
+    fragment->bytes[1] = protocol & 0xFF;
+    if(header_size > 0) memcpy(fragment->bytes + PROTOCOL_SIZE, header, header_size);
+    micro_copy_range(packet, offset, length, fragment->bytes + PROTOCOL_SIZE + header_size);
+    return 0;
+}
+
+// Stands in for the data link: the fragmentation benchmark stops at the layer boundary.
+int handle_data_link_to_physical_batch(uint16_t protocol, packet_buffer_t* const* packets, size_t packet_count, uint32_t flow_hash, const char* destination) {
+    (void)flow_hash;
+    (void)destination;
+    for(size_t i = 0; i < packet_count; i++) {
+        size_t length = packet_buffer_length(packets[i]);
+        micro_sink += length;
+        if(micro_capture_frame(protocol, NULL, 0, packets[i], 0, length) != 0) return -1;
+    }
+    return 0;
+}
+
+// Does the per-segment header work of the real one, which happens as each frame is written.
+int handle_data_link_to_physical_gso(uint16_t protocol, const data_link_gso_t* gso, uint32_t flow_hash, const char* destination) {
+    (void)flow_hash;
+    (void)destination;
+    unsigned char header[DATA_LINK_GSO_MAX_HEADER] __attribute__((aligned(8)));
+    size_t payload_length = packet_buffer_length(gso->payload);
+    size_t offset = 0;
+    do {
+        size_t length = payload_length - offset < gso->segment_size ? payload_length - offset : gso->segment_size;
+        memcpy(header, gso->header, gso->header_size);
+        gso->fix_header(header, offset, length, offset + length == payload_length);
+        micro_sink += header[0] + length;
+        if(micro_capture_frame(protocol, header, gso->header_size, gso->payload, offset, length) != 0) return -1;
+        offset += length;
+    } while(offset < payload_length);
+    return 0;
+}
+
+void handle_network_to_transport(void* network_payload) {
+    micro_delivered++;
+    packet_buffer_release((packet_buffer_t*)network_payload);
+}
+
+void handle_network_to_reliable(void* network_payload) {
+    handle_network_to_transport(network_payload);
+}
+
+int rx_dispatch_next(void (*handler)(void*), void* data) {
+    handler(data);
+    return 0;
+}
+
+static double micro_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Deterministic payload in which about density_percent of the bytes are FLAG or ESC.
+static void micro_fill(unsigned char* data, size_t length, int density_percent) {
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for(size_t i = 0; i < length; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        unsigned char byte = (unsigned char)(state >> 24);
+        if((int)(state % 1000) < density_percent * 10) byte = (state & 0x100) ? FLAG_BYTE : ESC_BYTE;
+        else if(byte == FLAG_BYTE || byte == ESC_BYTE) byte = 0x20;
+        data[i] = byte;
+    }
+}
+
+static void micro_stuff(micro_input_t* input, size_t iterations) {
+    for(size_t i = 0; i < iterations; i++) micro_sink += (uint64_t)data_link_stuff(input->data, input->length, input->out, input->out_capacity, NULL);
+}
+
+static void micro_destuff(micro_input_t* input, size_t iterations) {
+    for(size_t i = 0; i < iterations; i++) {
+        size_t consumed = 0, produced = 0;
+        micro_sink += data_link_destuff(input->data, input->length, input->out, input->out_capacity, &consumed, &produced, NULL);
+        micro_sink += produced;
+    }
+}
+
+static void micro_fcs(micro_input_t* input, size_t iterations) {
+    for(size_t i = 0; i < iterations; i++) {
+        data_link_fcs_t fcs;
+        data_link_fcs_begin(&fcs, input->fcs_mode);
+        data_link_fcs_update(&fcs, input->data, input->length);
+        micro_sink += fcs.state;
+    }
+}
+
+static void micro_internet_checksum(micro_input_t* input, size_t iterations) {
+    for(size_t i = 0; i < iterations; i++) micro_sink += calculate_internet_checksum(input->data, input->length);
+}
+
+static void micro_fragment(micro_input_t* input, size_t iterations) {
+    for(size_t i = 0; i < iterations; i++) {
+        packet_buffer_t* packet = packet_buffer_alloc(PACKET_BUFFER_DEFAULT_HEADROOM, 0);
+        if(packet == NULL) return;
+        packet_buffer_attach(packet, input->data, input->length, NULL);
+        micro_sink += (uint64_t)handle_transport_to_network(packet, UDP_PROTOCOL_NUMBER, 0);
+        packet_buffer_release(packet);
+    }
+}
+
+// Each fragment is copied into a fresh packet buffer first, as the receiving data link destuffs into one.
+static void micro_reassemble(micro_input_t* input, size_t iterations) {
+    for(size_t i = 0; i < iterations; i++) {
+        for(size_t j = 0; j < input->fragment_count; j++) {
+            const micro_fragment_t* fragment = &input->fragments[input->reverse ? input->fragment_count - 1 - j : j];
+            packet_buffer_t* frame = packet_buffer_alloc(0, fragment->length);
+            if(frame == NULL) return;
+            memcpy(packet_buffer_put(frame, fragment->length), fragment->bytes, fragment->length);
+            handle_data_link_to_network(frame);
+        }
+    }
+}
+
+static int micro_compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Calibrates the iteration count on the warm kernel until one run lasts run_ms, then times config->runs runs.
+static void micro_measure(const micro_config_t* config, const char* name, micro_kernel_t kernel, micro_input_t* input, size_t bytes) {
+    if(config->filter != NULL && strstr(name, config->filter) == NULL) return;
+    if(micro_result_count >= MICRO_MAX_RESULTS) return;
+    double target_ns = config->run_ms * 1e6;
+    size_t iterations = 1;
+    while (true) {
+        double start = micro_now_ns();
+        kernel(input, iterations);
+        double elapsed = micro_now_ns() - start;
+        if(elapsed >= target_ns) break;
+        size_t next = elapsed > 0 ? (size_t)((double)iterations * target_ns / elapsed * 1.1) : iterations * 10;
+        iterations = next > iterations * 10 ? iterations * 10 : (next > iterations ? next : iterations + 1);
+    }
+    double samples[MICRO_MAX_RUNS];
+    double sum = 0;
+    for(int run = 0; run < config->runs; run++) {
+        double start = micro_now_ns();
+        kernel(input, iterations);
+        samples[run] = (micro_now_ns() - start) / (double)iterations;
+        sum += samples[run];
+    }
+    double mean = sum / config->runs;
+    double variance = 0;
+    for(int run = 0; run < config->runs; run++) variance += (samples[run] - mean) * (samples[run] - mean);
+    qsort(samples, (size_t)config->runs, sizeof(double), micro_compare_doubles);
+    micro_result_t* result = &micro_results[micro_result_count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->bytes = bytes;
+    result->ns_per_op = samples[config->runs / 2];
+    result->min_ns_per_op = samples[0];
+    result->stddev_percent = mean > 0 ? 100.0 * sqrt(variance / config->runs) / mean : 0;
+    printf("%-28s %8zu %12.1f %12.1f %8.1f%% %10.3f\n", result->name, result->bytes, result->ns_per_op, result->min_ns_per_op, result->stddev_percent, result->ns_per_op > 0 ? (double)bytes / result->ns_per_op : 0);
+    fflush(stdout);
+}
+
+static void micro_run_data_link(const micro_config_t* config, unsigned char* data, unsigned char* stuffed, unsigned char* out) {
+    static const size_t sizes[] = {64, 256, 576, DATA_LINK_DEFAULT_MTU};
+    static const int densities[] = {0, 1, 10, 50};
+    char name[MICRO_NAME_SIZE];
+    for(size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+        for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            micro_fill(data, sizes[s], densities[d]);
+            micro_input_t input = { .data = data, .length = sizes[s], .out = out, .out_capacity = DATA_LINK_STUFFED_FRAME_SIZE(DATA_LINK_DEFAULT_MTU) };
+            snprintf(name, sizeof(name), "stuff/%zu/d%d", sizes[s], densities[d]);
+            micro_measure(config, name, micro_stuff, &input, sizes[s]);
+            // Destuffing reads the stuffed content up to and including the closing flag.
+            long stuffed_length = data_link_stuff(data, sizes[s], stuffed, DATA_LINK_STUFFED_FRAME_SIZE(DATA_LINK_DEFAULT_MTU) - 1, NULL);
+            if(stuffed_length < 0) continue;
+            stuffed[stuffed_length++] = FLAG_BYTE;
+            micro_input_t destuff_input = { .data = stuffed, .length = (size_t)stuffed_length, .out = out, .out_capacity = DATA_LINK_STUFFED_FRAME_SIZE(DATA_LINK_DEFAULT_MTU) };
+            snprintf(name, sizeof(name), "destuff/%zu/d%d", sizes[s], densities[d]);
+            micro_measure(config, name, micro_destuff, &destuff_input, sizes[s]);
+        }
+    }
+    micro_fill(data, DATA_LINK_DEFAULT_MTU, 0);
+    for(int mode = 0; mode < DATA_LINK_FCS_MODE_COUNT; mode++) {
+        for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            micro_input_t input = { .data = data, .length = sizes[s], .fcs_mode = (data_link_fcs_mode_t)mode };
+            snprintf(name, sizeof(name), "fcs-%s/%zu", data_link_fcs_name((data_link_fcs_mode_t)mode), sizes[s]);
+            micro_measure(config, name, micro_fcs, &input, sizes[s]);
+        }
+    }
+}
+
+static void micro_run_network(const micro_config_t* config, unsigned char* data) {
+    static const size_t checksum_sizes[] = {10, 64, 576, DATA_LINK_DEFAULT_MTU, 65535};
+    static const size_t datagram_sizes[] = {1000, 3000, 16000, 65000};
+    char name[MICRO_NAME_SIZE];
+    micro_fill(data, NETWORK_MAX_DATAGRAM_PAYLOAD, 0);
+    for(size_t s = 0; s < sizeof(checksum_sizes) / sizeof(checksum_sizes[0]); s++) {
+        micro_input_t input = { .data = data, .length = checksum_sizes[s] };
+        snprintf(name, sizeof(name), "inet-checksum/%zu", checksum_sizes[s]);
+        micro_measure(config, name, micro_internet_checksum, &input, checksum_sizes[s]);
+    }
+    // Without offload first, so the plain kernels keep their names; offload adds fragment-gso and reassemble-gro.
+    for(int offload = 0; offload <= 1; offload++) {
+        network_offload = offload != 0;
+        for(size_t s = 0; s < sizeof(datagram_sizes) / sizeof(datagram_sizes[0]); s++) {
+            micro_input_t input = { .data = data, .length = datagram_sizes[s] };
+            if(offload && datagram_sizes[s] <= data_link_mtu - sizeof(simple_ip_header_t)) continue;
+            snprintf(name, sizeof(name), offload ? "fragment-gso/%zu" : "fragment/%zu", datagram_sizes[s]);
+            micro_measure(config, name, micro_fragment, &input, datagram_sizes[s]);
+            // Capture the frames of one datagram to feed the receive side.
+            micro_capture = input.fragments;
+            micro_capture_count = 0;
+            micro_fragment(&input, 1);
+            micro_capture = NULL;
+            input.fragment_count = micro_capture_count;
+            uint64_t delivered = micro_delivered;
+            micro_reassemble(&input, 1);
+            if(micro_delivered != delivered + 1) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: %zu-byte datagram was not reassembled; skipping reassembly.\n", datagram_sizes[s]);
+            else {
+                snprintf(name, sizeof(name), offload ? "reassemble-gro/%zu" : "reassemble/%zu", datagram_sizes[s]);
+                micro_measure(config, name, micro_reassemble, &input, datagram_sizes[s]);
+                if(!offload && input.fragment_count > 1) {
+                    input.reverse = true;
+                    snprintf(name, sizeof(name), "reassemble-reverse/%zu", datagram_sizes[s]);
+                    micro_measure(config, name, micro_reassemble, &input, datagram_sizes[s]);
+                }
+            }
+            for(size_t i = 0; i < input.fragment_count; i++) free(input.fragments[i].bytes);
+        }
+    }
+}
+
+static int micro_write_json(const char* path) {
+    FILE* json = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if(json == NULL) {
+        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "BENCH Error: Cannot write JSON results");
+        return -1;
+    }
+    fprintf(json, "{\n  \"stuffing_kernel\": \"%s\",\n  \"crc_impl\": \"%s\",\n  \"results\": [\n", data_link_kernel_name(data_link_kernel_active()), data_link_crc_name(data_link_crc_active()));
+    for(size_t i = 0; i < micro_result_count; i++) {
+        const micro_result_t* result = &micro_results[i];
+        fprintf(json, "    { \"name\": \"%s\", \"bytes\": %zu, \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, \"stddev_percent\": %.2f }%s\n", result->name, result->bytes, result->ns_per_op, result->min_ns_per_op, result->stddev_percent, i + 1 < micro_result_count ? "," : "");
+    }
+    fprintf(json, "  ]\n}\n");
+    if(json != stdout) fclose(json);
+    return 0;
+}
+
+// Reads the "name" / "ns_per_op" pairs of a file written by --json. Returns the regression count, or -1 on error.
+static int micro_compare(const char* path, double threshold) {
+    FILE* file = fopen(path, "r");
+    if(file == NULL) {
+        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "BENCH Error: Cannot read baseline");
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = size > 0 ? (char*)malloc((size_t)size + 1) : NULL;
+    if(text == NULL || fread(text, 1, (size_t)size, file) != (size_t)size) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: Failed to read baseline %s.\n", path);
+        free(text);
+        fclose(file);
+        return -1;
+    }
+    text[size] = '\0';
+    fclose(file);
+    int regressions = 0, matched = 0;
+    printf("\nComparison with %s (regression above +%.1f%%):\n", path, threshold);
+    printf("%-28s %12s %12s %9s\n", "kernel", "baseline ns", "current ns", "change");
+    for(size_t i = 0; i < micro_result_count; i++) {
+        const micro_result_t* result = &micro_results[i];
+        char key[MICRO_NAME_SIZE + 16];
+        snprintf(key, sizeof(key), "\"name\": \"%.*s\"", MICRO_NAME_SIZE - 1, result->name);
+        const char* entry = strstr(text, key);
+        const char* value = entry != NULL ? strstr(entry, "\"ns_per_op\":") : NULL;
+        if(value == NULL) {
+            printf("%-28s %12s %12.1f %9s\n", result->name, "-", result->ns_per_op, "new");
+            continue;
+        }
+        double baseline = strtod(value + strlen("\"ns_per_op\":"), NULL);
+        double change = baseline > 0 ? 100.0 * (result->ns_per_op - baseline) / baseline : 0;
+        bool regressed = change > threshold;
+        matched++;
+        if(regressed) regressions++;
+        printf("%-28s %12.1f %12.1f %+8.1f%%%s\n", result->name, baseline, result->ns_per_op, change, regressed ? "  REGRESSED" : "");
+    }
+    free(text);
+    if(matched == 0) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: No kernel of this run appears in %s.\n", path);
+        return -1;
+    }
+    printf("%d of %d kernels regressed.\n", regressions, matched);
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"runs", required_argument, NULL, 'r'},
+        {"run-ms", required_argument, NULL, 't'},
+        {"filter", required_argument, NULL, 'f'},
+        {"json", required_argument, NULL, 'j'},
+        {"compare", required_argument, NULL, 'c'},
+        {"threshold", required_argument, NULL, 'T'},
+        {NULL, 0, NULL, 0}
+    };
+    micro_config_t config = { .runs = MICRO_DEFAULT_RUNS, .run_ms = MICRO_DEFAULT_RUN_MS, .filter = NULL, .json_path = NULL, .baseline_path = NULL, .threshold = MICRO_DEFAULT_THRESHOLD };
+    bool usage_error = false;
+    int option;
+    while ((option = getopt_long(argc, argv, "r:t:f:j:c:T:", long_options, NULL)) != -1) {
+        char* end = NULL;
+        switch (option) {
+            case 'r':
+                config.runs = (int)strtol(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || config.runs < 1 || config.runs > MICRO_MAX_RUNS) usage_error = true;
+                break;
+            case 't':
+                config.run_ms = strtod(optarg, &end);
+                if(end == optarg || *end != '\0' || config.run_ms <= 0) usage_error = true;
+                break;
+            case 'f':
+                config.filter = optarg;
+                break;
+            case 'j':
+                config.json_path = optarg;
+                break;
+            case 'c':
+                config.baseline_path = optarg;
+                break;
+            case 'T':
+                config.threshold = strtod(optarg, &end);
+                if(end == optarg || *end != '\0' || config.threshold < 0) usage_error = true;
+                break;
+            default:
+                usage_error = true;
+                break;
+        }
+    }
+    if(usage_error || optind != argc) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "Usage: %s [options]\n", argv[0]);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -r, --runs <n>         : Timed runs per kernel; the median is reported (default %d).\n", MICRO_DEFAULT_RUNS);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -t, --run-ms <ms>      : Length of each run (default %.0f).\n", MICRO_DEFAULT_RUN_MS);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -f, --filter <text>    : Only kernels whose name contains text.\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -j, --json <file>      : Write the results as JSON ('-' for stdout), e.g. to save a baseline.\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -c, --compare <file>   : Compare with a saved baseline and exit 2 if a kernel regressed.\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -T, --threshold <pct>  : Slowdown that counts as a regression (default %.0f).\n", MICRO_DEFAULT_THRESHOLD);
+        return 1;
+    }
+    log_level = LOG_LEVEL_WARN;
+    unsigned char* data = (unsigned char*)malloc(NETWORK_MAX_DATAGRAM_PAYLOAD);
+    unsigned char* stuffed = (unsigned char*)malloc(DATA_LINK_STUFFED_FRAME_SIZE(DATA_LINK_DEFAULT_MTU));
+    unsigned char* out = (unsigned char*)malloc(DATA_LINK_STUFFED_FRAME_SIZE(DATA_LINK_DEFAULT_MTU));
+    if(data == NULL || stuffed == NULL || out == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: Failed to allocate benchmark buffers.\n");
+        return 1;
+    }
+    data_link_kernels_init();
+    network_layer_init();
+    printf("Stuffing kernel: %s, CRC-32C: %s, %d runs of %.0f ms per kernel\n", data_link_kernel_name(data_link_kernel_active()), data_link_crc_name(data_link_crc_active()), config.runs, config.run_ms);
+    printf("%-28s %8s %12s %12s %9s %10s\n", "kernel", "bytes", "median ns", "min ns", "stddev", "GB/s");
+    micro_run_data_link(&config, data, stuffed, out);
+    micro_run_network(&config, data);
+    network_layer_shutdown();
+    free(data);
+    free(stuffed);
+    free(out);
+    if(config.json_path != NULL && micro_write_json(config.json_path) != 0) return 1;
+    if(config.baseline_path == NULL) return 0;
+    int regressions = micro_compare(config.baseline_path, config.threshold);
+    if(regressions < 0) return 1;
+    return regressions > 0 ? 2 : 0;
+}
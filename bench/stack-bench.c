@@ -0,0 +1,578 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "headers/stack.h"
+#include "headers/physical-impl.h"
+#include "headers/data-link-impl.h"
+#include "headers/rx-dispatch.h"
+#include "headers/network-impl.h"
+#include "headers/transport-impl.h"
+#include "headers/reliable-impl.h"
+#include "headers/application-impl.h"
+#include "headers/log.h"
+#include "headers/latency.h"
+#include "headers/metrics.h"
+#include "headers/colors.h"
+
+#define BENCH_HEADER_SIZE 33 // 16 hex digits of sequence number, 16 of send time, '|'
+#define BENCH_MAX_MESSAGE_SIZE (NETWORK_MAX_DATAGRAM_PAYLOAD - (int)sizeof(simple_udp_header_t))
+#define BENCH_DEFAULT_SIZE 100
+#define BENCH_DEFAULT_COUNT 100000
+#define BENCH_MAX_FLOWS 1024
+#define BENCH_BASE_PORT 20000
+#define BENCH_DEST_PORT 9
+#define BENCH_READY_TIMEOUT_MS 5000
+#define BENCH_DRAIN_IDLE_MS 1000 // The run ends once the receiver has taken nothing new for this long
+#define BENCH_POLL_US 1000
+#define BENCH_FLUSH_TIMEOUT_MS 10000
+#define BENCH_MAX_HOPS 8
+// Addresses are only assigned once forwarders sit between the two ends.
+#define BENCH_SENDER_ADDRESS 0x0A000001u    // 10.0.0.1
+#define BENCH_RECEIVER_ADDRESS 0x0A000002u  // 10.0.0.2
+#define BENCH_FORWARDER_ADDRESS 0x0A000100u // Plus the hop number: 10.0.1.<hop>
+
+// Filled in by a forwarder process as it stops.
+typedef struct {
+    _Atomic uint64_t forwarded;
+    _Atomic uint64_t forward_drops;
+    _Atomic uint64_t cpu_ns; // User and system time of the whole process
+    atomic_bool ready;
+    atomic_bool failed;
+} bench_hop_t;
+
+// Lives in memory shared with the receiver and forwarder processes, which fill in everything but stop.
+typedef struct {
+    _Atomic uint64_t received;
+    _Atomic uint64_t received_bytes;
+    _Atomic uint64_t malformed;
+    _Atomic uint64_t last_receive_ns;
+    atomic_bool ready;
+    atomic_bool failed;
+    atomic_bool stop;
+    latency_histogram_t latency; // One-way, send time to delivery to the application
+    bench_hop_t hops[BENCH_MAX_HOPS];
+} bench_shared_t;
+
+typedef struct {
+    size_t message_size;
+    uint64_t count; // 0 when the run is bounded by duration instead
+    double duration;
+    double rate; // Messages per second, 0 for as fast as the stack accepts them
+    int flows;
+    bool reliable; // Reliable transport connections instead of UDP datagrams, to compare goodput
+    int hops;      // Forwarding instances between sender and receiver
+    const char* json_path;
+} bench_config_t;
+
+typedef struct {
+    uint64_t sent;
+    uint64_t send_failures;
+    uint64_t first_send_ns;
+    uint64_t last_send_ns;
+    reliable_stats_t reliable; // Summed over the flows' connections
+} bench_sender_result_t;
+
+// Where the receiver is in one reliable flow's stream, which carries the messages back to back.
+typedef struct {
+    size_t offset;
+    char header[BENCH_HEADER_SIZE]; // Collected across segments when the MSS is smaller than the header
+    uint64_t sent_ns;
+    bool valid;
+} bench_stream_t;
+
+static bench_shared_t* bench_shared = NULL;
+static size_t bench_message_size = 0;
+
+static void bench_sleep_us(long microseconds) {
+    struct timespec pause = { microseconds / 1000000, (microseconds % 1000000) * 1000 };
+    nanosleep(&pause, NULL);
+}
+
+static void bench_put_hex(char* out, uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    for(int i = 15; i >= 0; i--) {
+        out[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+}
+
+static int bench_get_hex(const char* in, uint64_t* value) {
+    uint64_t parsed = 0;
+    for(int i = 0; i < 16; i++) {
+        char c = in[i];
+        if(c >= '0' && c <= '9') parsed = (parsed << 4) | (uint64_t)(c - '0');
+        else if(c >= 'a' && c <= 'f') parsed = (parsed << 4) | (uint64_t)(c - 'a' + 10);
+        else return -1;
+    }
+    *value = parsed;
+    return 0;
+}
+
+static void bench_raise(_Atomic uint64_t* target, uint64_t value) {
+    uint64_t current = atomic_load_explicit(target, memory_order_relaxed);
+    while (value > current && !atomic_compare_exchange_weak_explicit(target, &current, value, memory_order_relaxed, memory_order_relaxed)) { }
+}
+
+static bool bench_parse(const char* message, size_t length, uint64_t* sent_ns) {
+    return length >= BENCH_HEADER_SIZE && message[BENCH_HEADER_SIZE - 1] == '|' && bench_get_hex(message + 16, sent_ns) == 0;
+}
+
+static void bench_count(bool valid, uint64_t sent_ns, size_t length) {
+    uint64_t now = latency_now_ns();
+    if(!valid) {
+        atomic_fetch_add_explicit(&bench_shared->malformed, 1, memory_order_relaxed);
+        return;
+    }
+    latency_histogram_record(&bench_shared->latency, now > sent_ns ? now - sent_ns : 0);
+    atomic_fetch_add_explicit(&bench_shared->received_bytes, length, memory_order_relaxed);
+    bench_raise(&bench_shared->last_receive_ns, now);
+    atomic_fetch_add_explicit(&bench_shared->received, 1, memory_order_release);
+}
+
+// Runs on the receive workers of the receiver process.
+static void bench_on_receive(transport_endpoint_t* endpoint, transport_message_t* received, void* context) {
+    (void)endpoint;
+    (void)context;
+    uint64_t sent_ns = 0;
+    bool valid = bench_parse((const char*)received->data, received->length, &sent_ns);
+    size_t length = received->length;
+    transport_message_release(received);
+    bench_count(valid, sent_ns, length);
+}
+
+// Each message starts a new segment, but at a small MTU its header can span several, so it is collected first.
+static void bench_on_segment(reliable_connection_t* connection, transport_message_t* received, void* context) {
+    (void)connection;
+    bench_stream_t* stream = (bench_stream_t*)context;
+    if(stream->offset < BENCH_HEADER_SIZE) {
+        size_t take = BENCH_HEADER_SIZE - stream->offset;
+        if(take > received->length) take = received->length;
+        memcpy(stream->header + stream->offset, received->data, take);
+        if(stream->offset + take == BENCH_HEADER_SIZE) stream->valid = bench_parse(stream->header, BENCH_HEADER_SIZE, &stream->sent_ns);
+    }
+    stream->offset += received->length;
+    transport_message_release(received);
+    if(stream->offset < bench_message_size) return;
+    bench_count(stream->valid && stream->offset == bench_message_size, stream->sent_ns, stream->offset);
+    stream->offset = 0;
+}
+
+static int bench_run_receiver(const bench_config_t* config, const char* receiver_mac, const char* peer_mac, pid_t parent) {
+    if(config->hops > 0) network_local_address = BENCH_RECEIVER_ADDRESS;
+    if(log_init() != 0) {
+        atomic_store(&bench_shared->failed, true);
+        return 1;
+    }
+    if(stack_init(receiver_mac, peer_mac) != 0) {
+        atomic_store(&bench_shared->failed, true);
+        log_shutdown();
+        return 1;
+    }
+    bool bound = true;
+    bench_stream_t* streams = NULL;
+    if(!config->reliable) bound = transport_bind(BENCH_DEST_PORT, bench_on_receive, NULL, 0) != NULL;
+    else {
+        streams = (bench_stream_t*)calloc(config->flows, sizeof(bench_stream_t));
+        bound = streams != NULL;
+        for(int i = 0; bound && i < config->flows; i++) bound = reliable_open((uint16_t)(BENCH_DEST_PORT + i), config->hops > 0 ? BENCH_SENDER_ADDRESS : 0, (uint16_t)(BENCH_BASE_PORT + i), bench_on_segment, &streams[i]) != NULL;
+    }
+    if(!bound) {
+        atomic_store(&bench_shared->failed, true);
+        stack_shutdown();
+        log_shutdown();
+        free(streams);
+        return 1;
+    }
+    atomic_store(&bench_shared->ready, true);
+    while (!atomic_load(&bench_shared->stop) && getppid() == parent) bench_sleep_us(BENCH_POLL_US);
+    stack_shutdown();
+    log_shutdown();
+    free(streams);
+    return 0;
+}
+
+// Hop n of the chain takes datagrams from hop n - 1 and passes them on to hop n + 1 along its default route. The
+// acknowledgements of reliable runs travel back up to the sender on a host route.
+static int bench_run_forwarder(int hop, const char* forwarder_mac, const char* previous_mac, const char* next_mac, pid_t parent) {
+    bench_hop_t* shared_hop = &bench_shared->hops[hop - 1];
+    network_local_address = BENCH_FORWARDER_ADDRESS + (uint32_t)hop;
+    if(log_init() != 0) {
+        atomic_store(&shared_hop->failed, true);
+        return 1;
+    }
+    if(stack_init(forwarder_mac, next_mac) != 0) {
+        atomic_store(&shared_hop->failed, true);
+        log_shutdown();
+        return 1;
+    }
+    if(network_route_add(BENCH_SENDER_ADDRESS, 32, previous_mac) != 0) {
+        atomic_store(&shared_hop->failed, true);
+        stack_shutdown();
+        log_shutdown();
+        return 1;
+    }
+    atomic_store(&shared_hop->ready, true);
+    while (!atomic_load(&bench_shared->stop) && getppid() == parent) bench_sleep_us(BENCH_POLL_US);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t cpu_us = (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+    atomic_store(&shared_hop->cpu_ns, cpu_us * 1000);
+    atomic_store(&shared_hop->forwarded, metrics_value(METRIC_NW_FORWARDED));
+    atomic_store(&shared_hop->forward_drops, metrics_value(METRIC_NW_FORWARD_DROPS) + metrics_value(METRIC_NW_NO_ROUTE) + metrics_value(METRIC_NW_TTL_EXPIRED));
+    stack_shutdown();
+    log_shutdown();
+    return 0;
+}
+
+static bool bench_wait_ready(atomic_bool* ready, atomic_bool* failed) {
+    int waited_ms = 0;
+    while (!atomic_load(ready) && !atomic_load(failed) && waited_ms < BENCH_READY_TIMEOUT_MS) {
+        bench_sleep_us(BENCH_POLL_US);
+        waited_ms += BENCH_POLL_US / 1000;
+    }
+    return atomic_load(ready);
+}
+
+static void bench_reap(pid_t* children, int child_count, bool kill_them) {
+    for(int i = 0; i < child_count; i++) {
+        if(kill_them) kill(children[i], SIGKILL);
+        waitpid(children[i], NULL, 0);
+    }
+}
+
+// Paced sends are stamped with the time they were due rather than the time they went out, so a stall
+// in the sender shows up as latency instead of silently thinning the load (coordinated omission).
+static void bench_run_sender(const bench_config_t* config, char* message, reliable_connection_t** connections, bench_sender_result_t* result) {
+    uint64_t interval_ns = config->rate > 0 ? (uint64_t)(1e9 / config->rate) : 0;
+    uint64_t duration_ns = (uint64_t)(config->duration * 1e9);
+    uint64_t start = latency_now_ns();
+    result->first_send_ns = start;
+    for(uint64_t i = 0; config->count == 0 || i < config->count; i++) {
+        uint64_t now = latency_now_ns();
+        if(config->count == 0 && now - start >= duration_ns) break;
+        uint64_t stamp = now;
+        if(interval_ns > 0) {
+            stamp = start + i * interval_ns;
+            while (now < stamp) {
+                if(stamp - now > 2 * BENCH_POLL_US * 1000ull) bench_sleep_us(BENCH_POLL_US);
+                now = latency_now_ns();
+            }
+        }
+        bench_put_hex(message, i);
+        bench_put_hex(message + 16, stamp);
+        int sent;
+        if(config->reliable) sent = reliable_send(connections[i % (uint64_t)config->flows], message, config->message_size);
+        else sent = send_application_buffer(message, config->message_size, (uint16_t)(BENCH_BASE_PORT + i % (uint64_t)config->flows), BENCH_DEST_PORT);
+        if(sent == 0) result->sent++;
+        else result->send_failures++;
+    }
+    // Reliable sends return once queued; the run is only over when the receiver has acknowledged everything.
+    for(int i = 0; config->reliable && i < config->flows; i++) {
+        if(reliable_flush(connections[i], BENCH_FLUSH_TIMEOUT_MS) != 0) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: Flow %d still had unacknowledged data after %d ms.\n", i, BENCH_FLUSH_TIMEOUT_MS);
+        reliable_stats_t stats;
+        reliable_get_stats(connections[i], &stats);
+        result->reliable.segments_sent += stats.segments_sent;
+        result->reliable.retransmits += stats.retransmits;
+        result->reliable.timeouts += stats.timeouts;
+        result->reliable.fast_recoveries += stats.fast_recoveries;
+        if(stats.srtt_us > result->reliable.srtt_us) result->reliable.srtt_us = stats.srtt_us;
+    }
+    result->last_send_ns = latency_now_ns();
+}
+
+// Waits until everything sent has arrived, or until nothing more arrives for BENCH_DRAIN_IDLE_MS.
+static void bench_drain(uint64_t sent) {
+    uint64_t last_seen = atomic_load(&bench_shared->received);
+    int idle_ms = 0;
+    while (last_seen < sent && idle_ms < BENCH_DRAIN_IDLE_MS) {
+        bench_sleep_us(BENCH_POLL_US);
+        uint64_t seen = atomic_load(&bench_shared->received);
+        idle_ms = seen == last_seen ? idle_ms + BENCH_POLL_US / 1000 : 0;
+        last_seen = seen;
+    }
+}
+
+static void bench_report(const bench_config_t* config, const bench_sender_result_t* sender) {
+    uint64_t received = atomic_load(&bench_shared->received);
+    uint64_t received_bytes = atomic_load(&bench_shared->received_bytes);
+    uint64_t malformed = atomic_load(&bench_shared->malformed);
+    uint64_t last_receive_ns = atomic_load(&bench_shared->last_receive_ns);
+    uint64_t end_ns = last_receive_ns > sender->last_send_ns ? last_receive_ns : sender->last_send_ns;
+    double seconds = (double)(end_ns - sender->first_send_ns) / 1e9;
+    double send_seconds = (double)(sender->last_send_ns - sender->first_send_ns) / 1e9;
+    double messages_per_second = seconds > 0 ? (double)received / seconds : 0;
+    double gbits_per_second = seconds > 0 ? (double)received_bytes * 8 / seconds / 1e9 : 0;
+    uint64_t attempted = sender->sent + sender->send_failures;
+    uint64_t lost = attempted > received ? attempted - received : 0;
+    double loss_percent = attempted > 0 ? 100.0 * (double)lost / (double)attempted : 0;
+    latency_summary_t latency;
+    latency_histogram_summarize(&bench_shared->latency, &latency);
+    printf("Stack benchmark: %zu-byte messages over %s, %d flow(s), rate %s, rx %s", config->message_size, config->reliable ? "reliable" : "udp", config->flows, config->rate > 0 ? "paced" : "unlimited", rx_mode_name(rx_mode));
+    if(rx_mode == RX_MODE_RUN_TO_COMPLETION) printf(" with %d workers", rx_worker_count);
+    printf(", %u rx queue(s)", physical_rx_queues);
+    printf(", FCS %s, MTU %u, offload %s, %u ring slots", data_link_fcs_name(data_link_fcs_mode), data_link_mtu, network_offload ? "on" : "off", physical_ring_slots);
+    if(config->hops > 0) printf(", %d forwarding hop(s)", config->hops);
+    printf("\n");
+    if(config->rate > 0) printf("  offered    %.0f msg/s\n", config->rate);
+    printf("  sent       %llu in %.3f s (%.0f msg/s), %llu refused by the stack\n", (unsigned long long)sender->sent, send_seconds, send_seconds > 0 ? (double)sender->sent / send_seconds : 0, (unsigned long long)sender->send_failures);
+    printf("  received   %llu in %.3f s: %.0f msg/s, %.3f Gbit/s\n", (unsigned long long)received, seconds, messages_per_second, gbits_per_second);
+    printf("  loss       %llu (%.3f%%)%s\n", (unsigned long long)lost, loss_percent, malformed > 0 ? ", some malformed on arrival" : "");
+    if(config->reliable) printf("  reliable   %llu segments sent, %llu retransmitted, %llu timeouts, %llu fast recoveries, max srtt %u us\n", (unsigned long long)sender->reliable.segments_sent, (unsigned long long)sender->reliable.retransmits, (unsigned long long)sender->reliable.timeouts, (unsigned long long)sender->reliable.fast_recoveries, sender->reliable.srtt_us);
+    printf("  latency    p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us (mean %.1f us)\n", (double)latency.p50_ns / 1e3, (double)latency.p99_ns / 1e3, (double)latency.p999_ns / 1e3, (double)latency.max_ns / 1e3, latency.mean_ns / 1e3);
+    // A forwarder's CPU time covers the whole run, so packets per CPU-second is what one core could forward.
+    for(int i = 0; i < config->hops; i++) {
+        uint64_t forwarded = atomic_load(&bench_shared->hops[i].forwarded);
+        double cpu_seconds = (double)atomic_load(&bench_shared->hops[i].cpu_ns) / 1e9;
+        printf("  hop %-6d %llu forwarded (%.0f pkt/s), %llu dropped, %.3f s CPU: %.0f pkt/s per core\n", i + 1, (unsigned long long)forwarded, seconds > 0 ? (double)forwarded / seconds : 0, (unsigned long long)atomic_load(&bench_shared->hops[i].forward_drops), cpu_seconds, cpu_seconds > 0 ? (double)forwarded / cpu_seconds : 0);
+    }
+    if(config->json_path == NULL) return;
+    FILE* json = strcmp(config->json_path, "-") == 0 ? stdout : fopen(config->json_path, "w");
+    if(json == NULL) {
+        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "BENCH Error: Cannot write JSON report");
+        return;
+    }
+    fprintf(json, "{\n");
+    fprintf(json, "  \"message_size\": %zu,\n  \"protocol\": \"%s\",\n  \"flows\": %d,\n  \"offered_rate\": %.0f,\n", config->message_size, config->reliable ? "reliable" : "udp", config->flows, config->rate);
+    fprintf(json, "  \"rx_mode\": \"%s\",\n  \"rx_workers\": %d,\n  \"rx_queues\": %u,\n  \"fcs\": \"%s\",\n  \"mtu\": %u,\n  \"offload\": %s,\n  \"ring_slots\": %u,\n", rx_mode_name(rx_mode), rx_worker_count, physical_rx_queues, data_link_fcs_name(data_link_fcs_mode), data_link_mtu, network_offload ? "true" : "false", physical_ring_slots);
+    fprintf(json, "  \"hops\": [");
+    for(int i = 0; i < config->hops; i++) {
+        double cpu_seconds = (double)atomic_load(&bench_shared->hops[i].cpu_ns) / 1e9;
+        uint64_t forwarded = atomic_load(&bench_shared->hops[i].forwarded);
+        fprintf(json, "%s{ \"forwarded\": %llu, \"dropped\": %llu, \"cpu_seconds\": %.6f, \"pps_per_core\": %.1f }", i > 0 ? ", " : "", (unsigned long long)forwarded, (unsigned long long)atomic_load(&bench_shared->hops[i].forward_drops), cpu_seconds, cpu_seconds > 0 ? (double)forwarded / cpu_seconds : 0);
+    }
+    fprintf(json, "],\n");
+    fprintf(json, "  \"sent\": %llu,\n  \"send_failures\": %llu,\n  \"received\": %llu,\n  \"malformed\": %llu,\n", (unsigned long long)sender->sent, (unsigned long long)sender->send_failures, (unsigned long long)received, (unsigned long long)malformed);
+    if(config->reliable) fprintf(json, "  \"retransmits\": %llu,\n  \"timeouts\": %llu,\n", (unsigned long long)sender->reliable.retransmits, (unsigned long long)sender->reliable.timeouts);
+    fprintf(json, "  \"lost\": %llu,\n  \"loss_percent\": %.4f,\n  \"seconds\": %.6f,\n", (unsigned long long)lost, loss_percent, seconds);
+    fprintf(json, "  \"messages_per_second\": %.1f,\n  \"gbit_per_second\": %.6f,\n", messages_per_second, gbits_per_second);
+    fprintf(json, "  \"latency_us\": { \"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f }\n", latency.mean_ns / 1e3, (double)latency.p50_ns / 1e3, (double)latency.p99_ns / 1e3, (double)latency.p999_ns / 1e3, (double)latency.max_ns / 1e3);
+    fprintf(json, "}\n");
+    if(json != stdout) fclose(json);
+}
+
+static void bench_usage(const char* program) {
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "Usage: %s [options]\n", program);
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -s, --size <bytes>     : Message size, %d-%d (default %d).\n", BENCH_HEADER_SIZE, BENCH_MAX_MESSAGE_SIZE, BENCH_DEFAULT_SIZE);
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -n, --count <n>        : Messages to send (default %d).\n", BENCH_DEFAULT_COUNT);
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -d, --duration <sec>   : Send for this long instead of a fixed count.\n");
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -r, --rate <msg/s>     : Offered rate (default: as fast as the stack accepts).\n");
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -f, --flows <n>        : Distinct source ports, spread over the receive workers (default 1).\n");
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -P, --protocol <name>  : udp (default) or reliable, one connection per flow.\n");
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -H, --hops <n>         : Forwarding instances between sender and receiver, 0-%d (default 0).\n", BENCH_MAX_HOPS);
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -w, --rx-workers <n>   : Run-to-completion receive workers (default %d).\n", RX_DEFAULT_WORKERS);
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -q, --rx-queues <n>    : Receive queues per instance, 1-%d (default 1). Each instance pins its receivers to cores of its own.\n", PHYSICAL_MAX_RX_QUEUES);
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -m, --rx-mode <mode>   : rtc (default) or pipeline.\n");
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -F, --fcs <mode>       : sum8 (default) or crc32c.\n");
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -S, --ring-slots <n>   : Receive ring slots (default %d).\n", PHYSICAL_RING_DEFAULT_SLOTS);
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -M, --mtu <bytes>      : Link MTU of every instance, %d-%d (default %d).\n", DATA_LINK_MIN_MTU, DATA_LINK_MAX_MTU, DATA_LINK_DEFAULT_MTU);
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -G, --no-offload       : Fragment in the network layer and reassemble every fragment through the table.\n");
+    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -j, --json <file>      : Also write the results as JSON ('-' for stdout).\n");
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"size", required_argument, NULL, 's'},
+        {"count", required_argument, NULL, 'n'},
+        {"duration", required_argument, NULL, 'd'},
+        {"rate", required_argument, NULL, 'r'},
+        {"flows", required_argument, NULL, 'f'},
+        {"protocol", required_argument, NULL, 'P'},
+        {"hops", required_argument, NULL, 'H'},
+        {"rx-workers", required_argument, NULL, 'w'},
+        {"rx-queues", required_argument, NULL, 'q'},
+        {"rx-mode", required_argument, NULL, 'm'},
+        {"fcs", required_argument, NULL, 'F'},
+        {"ring-slots", required_argument, NULL, 'S'},
+        {"mtu", required_argument, NULL, 'M'},
+        {"no-offload", no_argument, NULL, 'G'},
+        {"json", required_argument, NULL, 'j'},
+        {NULL, 0, NULL, 0}
+    };
+    bench_config_t config = { .message_size = BENCH_DEFAULT_SIZE, .count = BENCH_DEFAULT_COUNT, .duration = 0, .rate = 0, .flows = 1, .reliable = false, .hops = 0, .json_path = NULL };
+    bool usage_error = false;
+    int option;
+    while ((option = getopt_long(argc, argv, "s:n:d:r:f:P:H:w:q:m:F:S:M:Gj:", long_options, NULL)) != -1) {
+        char* end = NULL;
+        switch (option) {
+            case 's': {
+                unsigned long size = strtoul(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || size < BENCH_HEADER_SIZE || size > BENCH_MAX_MESSAGE_SIZE) usage_error = true;
+                else config.message_size = size;
+                break;
+            }
+            case 'n':
+                config.count = strtoull(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || config.count == 0) usage_error = true;
+                break;
+            case 'd':
+                config.duration = strtod(optarg, &end);
+                if(end == optarg || *end != '\0' || config.duration <= 0) usage_error = true;
+                else config.count = 0;
+                break;
+            case 'r':
+                config.rate = strtod(optarg, &end);
+                if(end == optarg || *end != '\0' || config.rate < 0) usage_error = true;
+                break;
+            case 'f': {
+                long flows = strtol(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || flows < 1 || flows > BENCH_MAX_FLOWS) usage_error = true;
+                else config.flows = (int)flows;
+                break;
+            }
+            case 'P':
+                if(strcmp(optarg, "reliable") == 0) config.reliable = true;
+                else if(strcmp(optarg, "udp") == 0) config.reliable = false;
+                else usage_error = true;
+                break;
+            case 'H': {
+                long hops = strtol(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || hops < 0 || hops > BENCH_MAX_HOPS) usage_error = true;
+                else config.hops = (int)hops;
+                break;
+            }
+            case 'w': {
+                long workers = strtol(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || workers < 1 || workers > RX_MAX_WORKERS) usage_error = true;
+                else rx_worker_count = (int)workers;
+                break;
+            }
+            case 'q': {
+                unsigned long queues = strtoul(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || queues == 0 || queues > PHYSICAL_MAX_RX_QUEUES) usage_error = true;
+                else physical_rx_queues = (uint32_t)queues;
+                break;
+            }
+            case 'm':
+                if(rx_mode_parse(optarg, &rx_mode) != 0) usage_error = true;
+                break;
+            case 'F':
+                if(data_link_fcs_parse(optarg, &data_link_fcs_mode) != 0) usage_error = true;
+                break;
+            case 'S': {
+                unsigned long slots = strtoul(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || slots == 0 || slots > PHYSICAL_RING_MAX_SLOTS) usage_error = true;
+                else physical_ring_slots = (uint32_t)slots;
+                break;
+            }
+            case 'M': {
+                unsigned long mtu = strtoul(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || mtu < DATA_LINK_MIN_MTU || mtu > DATA_LINK_MAX_MTU) usage_error = true;
+                else data_link_mtu = (uint32_t)mtu;
+                break;
+            }
+            case 'G':
+                network_offload = false;
+                break;
+            case 'j':
+                config.json_path = optarg;
+                break;
+            default:
+                usage_error = true;
+                break;
+        }
+        if(usage_error && option != '?') fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: Invalid value '%s' for -%c.\n", optarg, option);
+        if(usage_error) break;
+    }
+    if(usage_error || optind != argc) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+    log_level = LOG_LEVEL_WARN;
+    bench_message_size = config.message_size;
+    bench_shared = (bench_shared_t*)mmap(NULL, sizeof(bench_shared_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(bench_shared == MAP_FAILED) {
+        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "BENCH Error: mmap failed");
+        return 1;
+    }
+    // Instance 0 is the sender, the last one the receiver and those in between forward.
+    char macs[BENCH_MAX_HOPS + 2][20];
+    int receiver_index = config.hops + 1;
+    snprintf(macs[0], sizeof(macs[0]), "bench_tx_%d", (int)getpid());
+    snprintf(macs[receiver_index], sizeof(macs[receiver_index]), "bench_rx_%d", (int)getpid());
+    for(int i = 1; i < receiver_index; i++) snprintf(macs[i], sizeof(macs[i]), "bench_h%d_%d", i, (int)getpid());
+    // Fork before any stack starts a thread; each process then runs one complete instance. They start from the
+    // receiver end so that every instance's next hop is already up.
+    pid_t parent = getpid();
+    pid_t children[BENCH_MAX_HOPS + 1];
+    int child_count = 0;
+    for(int i = receiver_index; i > 0; i--) {
+        bool is_receiver = i == receiver_index;
+        pid_t child = fork();
+        if(child == -1) {
+            perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "BENCH Error: fork failed");
+            bench_reap(children, child_count, true);
+            return 1;
+        }
+        if(child == 0) {
+            // Instance i pins its receive queues to the cores after those of the instances before it.
+            if(physical_rx_queues > 1) physical_rx_first_cpu = i * (int)physical_rx_queues;
+            if(is_receiver) _exit(bench_run_receiver(&config, macs[i], macs[i - 1], parent));
+            _exit(bench_run_forwarder(i, macs[i], macs[i - 1], macs[i + 1], parent));
+        }
+        children[child_count++] = child;
+        bool ready = is_receiver ? bench_wait_ready(&bench_shared->ready, &bench_shared->failed) : bench_wait_ready(&bench_shared->hops[i - 1].ready, &bench_shared->hops[i - 1].failed);
+        if(!ready) {
+            if(is_receiver) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: Receiver instance did not start.\n");
+            else fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: Forwarder instance %d did not start.\n", i);
+            bench_reap(children, child_count, true);
+            return 1;
+        }
+    }
+    if(config.hops > 0) {
+        network_local_address = BENCH_SENDER_ADDRESS;
+        application_destination_address = BENCH_RECEIVER_ADDRESS;
+    }
+    if(log_init() != 0 || stack_init(macs[0], macs[1]) != 0) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: Sender instance did not start.\n");
+        atomic_store(&bench_shared->stop, true);
+        bench_reap(children, child_count, false);
+        log_shutdown();
+        return 1;
+    }
+    char* message = (char*)malloc(config.message_size + 1);
+    if(message == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: Failed to allocate the message buffer.\n");
+        atomic_store(&bench_shared->stop, true);
+        bench_reap(children, child_count, false);
+        stack_shutdown();
+        log_shutdown();
+        return 1;
+    }
+    memset(message, 'x', config.message_size);
+    message[BENCH_HEADER_SIZE - 1] = '|';
+    message[config.message_size] = '\0';
+    reliable_connection_t* connections[BENCH_MAX_FLOWS] = { NULL };
+    bool opened = true;
+    for(int i = 0; config.reliable && opened && i < config.flows; i++) opened = (connections[i] = reliable_open((uint16_t)(BENCH_BASE_PORT + i), config.hops > 0 ? BENCH_RECEIVER_ADDRESS : 0, (uint16_t)(BENCH_DEST_PORT + i), NULL, NULL)) != NULL;
+    if(!opened) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "BENCH Error: Failed to open the reliable connections.\n");
+        atomic_store(&bench_shared->stop, true);
+        bench_reap(children, child_count, false);
+        stack_shutdown();
+        log_shutdown();
+        free(message);
+        return 1;
+    }
+    bench_sender_result_t sender;
+    memset(&sender, 0, sizeof(sender));
+    bench_run_sender(&config, message, connections, &sender);
+    bench_drain(sender.sent);
+    atomic_store(&bench_shared->stop, true);
+    bench_reap(children, child_count, false);
+    stack_shutdown();
+    log_shutdown();
+    free(message);
+    bench_report(&config, &sender);
+    return atomic_load(&bench_shared->received) > 0 ? 0 : 1;
+}
@@ -3,9 +3,23 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "headers/transport-impl.h"
 #include "headers/colors.h"
 
-void handle_transport_to_application(void* transport_payload);
+#define APPLICATION_DEFAULT_PORT 54321 // The demo application prints every message sent to this port
+
+// Where send_application_* messages go; 0 is the peer on the default route.
+extern uint32_t application_destination_address;
+
+// Binds the demo application to APPLICATION_DEFAULT_PORT.
+int application_layer_init();
+void application_layer_shutdown();
+void handle_transport_to_application(transport_endpoint_t* endpoint, transport_message_t* message, void* context);
+// Sends a C string, without its terminator.
 int send_application_data(const char* message, uint16_t src_port, uint16_t dest_port);
+// Sends length bytes of arbitrary data.
+int send_application_buffer(const void* data, size_t length, uint16_t src_port, uint16_t dest_port);
+// Sends the concatenation of up to TRANSPORT_MAX_IOV buffers as one message, e.g. a header and a body.
+int send_application_iov(const struct iovec* iov, int iov_count, uint16_t src_port, uint16_t dest_port);
 
 #endif
@@ -0,0 +1,41 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUFFER_POOL_CLASS_COUNT 5 // 512 B, 2 KiB, 8 KiB, 32 KiB and 66 KiB blocks; larger requests go to malloc
+#define BUFFER_POOL_SMALLEST_CLASS 512 // Holds a packet buffer descriptor with the default headroom
+#define BUFFER_POOL_LARGEST_CLASS (66 * 1024) // Holds a received frame at the largest MTU with its descriptor
+#define BUFFER_POOL_CACHE_BYTES (1024 * 1024) // Free blocks a thread keeps per size class before handing them back
+#define BUFFER_POOL_DEFAULT_LIMIT_MB 128
+
+typedef struct {
+    size_t block_size; // 0 for the oversize (malloc) class
+    uint64_t allocations;
+    uint64_t system_allocations; // Allocations no thread cache could serve
+    uint64_t reserved_blocks; // Currently obtained from the system, in use or cached
+    uint64_t peak_reserved_blocks;
+} buffer_pool_class_stats_t;
+
+typedef struct {
+    buffer_pool_class_stats_t classes[BUFFER_POOL_CLASS_COUNT + 1];
+    size_t reserved_bytes;
+    size_t peak_reserved_bytes;
+    size_t limit_bytes;
+    uint64_t limit_failures;
+    size_t thread_caches;
+} buffer_pool_stats_t;
+
+// Upper bound on the bytes the pool holds from the system; allocations beyond it fail.
+extern size_t buffer_pool_limit_bytes;
+// Blocks come from the calling thread's cache and may be freed on any thread: a foreign free is pushed
+// lock-free onto the owning cache's return list, which the owner drains when its own list runs dry.
+void* buffer_pool_alloc(size_t size);
+void* buffer_pool_calloc(size_t size);
+void* buffer_pool_realloc(void* ptr, size_t size);
+void buffer_pool_free(void* ptr);
+void buffer_pool_get_stats(buffer_pool_stats_t* stats);
+void buffer_pool_print_stats();
+
+#endif
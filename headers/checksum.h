@@ -0,0 +1,22 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One's-complement (RFC 1071) checksum over native-order 16-bit words, as used by the IP header and UDP.
+// A running sum is kept unfolded in 64 bits; chained calls must start at even offsets of the checksummed data.
+uint64_t internet_checksum_add(uint64_t sum, const void* data, size_t length);
+// Like internet_checksum_add for data that starts at any offset of the checksummed bytes, e.g. the second of two
+// buffers that are checksummed as one when the first has an odd length.
+uint64_t internet_checksum_add_at(uint64_t sum, const void* data, size_t length, size_t offset);
+// Copies length bytes from src to dst and adds them to sum in the same pass.
+uint64_t internet_checksum_copy(uint64_t sum, void* dst, const void* src, size_t length);
+uint64_t internet_checksum_add16(uint64_t sum, uint16_t word);
+// Folds a running sum to 16 bits and returns its complement, ready to store in a checksum field.
+uint16_t internet_checksum_fold(uint64_t sum);
+uint16_t calculate_internet_checksum(const void* buffer, size_t length);
+// RFC 1624 (eqn. 3) update of checksum after one 16-bit field changes from old_word to new_word.
+uint16_t internet_checksum_update16(uint16_t checksum, uint16_t old_word, uint16_t new_word);
+
+#endif
@@ -5,17 +5,48 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "headers/colors.h"
+#include "headers/data-link-kernels.h"
+#include "headers/packet-buffer.h"
 
 #define FLAG_BYTE 0x7E
 #define ESC_BYTE  0x7D
 #define XOR_BYTE  0x20
 
-#define MAX_INFO_SIZE 1500
+#define DATA_LINK_DEFAULT_MTU 1500
+#define DATA_LINK_MIN_MTU 68     // The network header and one 8-byte fragment unit, with room to spare
+#define DATA_LINK_MAX_MTU 65535  // A datagram of the largest size the network header can describe
 #define PROTOCOL_SIZE 2
-#define CHECKSUM_SIZE 1
-#define MAX_FRAME_CONTENT_SIZE (PROTOCOL_SIZE + MAX_INFO_SIZE + CHECKSUM_SIZE)
-#define MAX_STUFFED_FRAME_SIZE ((MAX_FRAME_CONTENT_SIZE * 2) + 2)
+#define DATA_LINK_FRAME_CONTENT_SIZE(mtu) (PROTOCOL_SIZE + (size_t)(mtu) + MAX_CHECKSUM_SIZE)
+// Every content byte escaped, plus both flags: a ring slot this large holds any frame.
+#define DATA_LINK_STUFFED_FRAME_SIZE(mtu) ((DATA_LINK_FRAME_CONTENT_SIZE(mtu) * 2) + 2)
+#define DATA_LINK_GSO_MAX_HEADER 64
+// Left in a received frame's control area for the network layer, which forwards with the sender's flow hash.
+typedef struct {
+    uint32_t flow_hash;
+} data_link_receive_control_t;
+
+extern data_link_fcs_mode_t data_link_fcs_mode;
+// Largest payload of one frame, i.e. the largest datagram the network layer sends unfragmented. Set before
+// stack_init; the ring slot size follows from it, and both ends of a link must use the same value.
+extern uint32_t data_link_mtu;
 void handle_physical_to_data_link(void* data);
 int handle_data_link_to_physical(uint16_t protocol, const unsigned char* payload, size_t payload_length);
+// Sends every packet as a frame over the link to destination, a MAC (NULL: the default destination). Returns 0, -1, or
+// PHYSICAL_SEND_DROPPED when physical_send_no_wait is set and the destination ring was full.
+int handle_data_link_to_physical_batch(uint16_t protocol, packet_buffer_t* const* packets, size_t packet_count, uint32_t flow_hash, const char* destination);
+
+// A datagram handed down whole, to be cut into frames as they are written (segmentation offload). Every frame
+// carries a copy of header, passed to fix_header with the segment's place in the payload, then the next
+// segment_size bytes of payload; the last frame takes what is left.
+typedef struct {
+    const packet_buffer_t* payload;
+    const void* header;
+    size_t header_size; // At most DATA_LINK_GSO_MAX_HEADER
+    size_t segment_size;
+    void (*fix_header)(void* header, size_t offset, size_t length, bool is_last);
+} data_link_gso_t;
+// Sends the datagram PHYSICAL_MAX_BATCH frames at a time without allocating anything per frame. Returns the same
+// as handle_data_link_to_physical_batch.
+int handle_data_link_to_physical_gso(uint16_t protocol, const data_link_gso_t* gso, uint32_t flow_hash, const char* destination);
 
 #endif
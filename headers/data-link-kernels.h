@@ -0,0 +1,71 @@
+#ifndef DATA_LINK_KERNELS_H
+#define DATA_LINK_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    DATA_LINK_KERNEL_SCALAR = 0,
+    DATA_LINK_KERNEL_SSE2,
+    DATA_LINK_KERNEL_AVX2,
+    DATA_LINK_KERNEL_COUNT
+} data_link_kernel_t;
+
+typedef enum {
+    DATA_LINK_FCS_SUM8 = 0, // 1-byte additive checksum (legacy)
+    DATA_LINK_FCS_CRC32C,   // 4-byte CRC-32C (Castagnoli), little endian on the wire
+    DATA_LINK_FCS_MODE_COUNT
+} data_link_fcs_mode_t;
+
+typedef enum {
+    DATA_LINK_CRC_SLICING8 = 0,
+    DATA_LINK_CRC_SSE42,
+    DATA_LINK_CRC_IMPL_COUNT
+} data_link_crc_impl_t;
+
+#define MAX_CHECKSUM_SIZE 4
+
+// Running frame check sequence over the protocol and info bytes of one frame.
+typedef struct {
+    data_link_fcs_mode_t mode;
+    uint32_t state;
+} data_link_fcs_t;
+
+typedef enum {
+    DATA_LINK_DESTUFF_OK = 0,     // Closing flag found
+    DATA_LINK_DESTUFF_INCOMPLETE, // Input ended before the closing flag
+    DATA_LINK_DESTUFF_BAD_ESCAPE, // ESC followed by a byte that is not an escaped FLAG/ESC
+    DATA_LINK_DESTUFF_OVERFLOW    // Destuffed content does not fit the output buffer
+} data_link_destuff_result_t;
+
+void data_link_kernels_init();
+int data_link_kernels_select(data_link_kernel_t kernel);
+bool data_link_kernel_supported(data_link_kernel_t kernel);
+data_link_kernel_t data_link_kernel_active();
+const char* data_link_kernel_name(data_link_kernel_t kernel);
+int data_link_crc_select(data_link_crc_impl_t impl);
+bool data_link_crc_supported(data_link_crc_impl_t impl);
+data_link_crc_impl_t data_link_crc_active();
+const char* data_link_crc_name(data_link_crc_impl_t impl);
+
+size_t data_link_fcs_size(data_link_fcs_mode_t mode);
+const char* data_link_fcs_name(data_link_fcs_mode_t mode);
+int data_link_fcs_parse(const char* name, data_link_fcs_mode_t* mode);
+uint32_t data_link_crc32c(uint32_t crc, const unsigned char* data, size_t length);
+void data_link_fcs_begin(data_link_fcs_t* fcs, data_link_fcs_mode_t mode);
+void data_link_fcs_update(data_link_fcs_t* fcs, const unsigned char* data, size_t length);
+// Writes the finished FCS in wire order and returns its size.
+size_t data_link_fcs_finish(const data_link_fcs_t* fcs, unsigned char out[MAX_CHECKSUM_SIZE]);
+
+// Index of the first FLAG_BYTE or ESC_BYTE in data, or length if there is none.
+size_t data_link_find_special(const unsigned char* data, size_t length);
+// Escapes every FLAG/ESC byte of data into out. Returns the stuffed length, or -1 if out_capacity is too small.
+// When fcs is not NULL it is updated with data in the same pass.
+long data_link_stuff(const unsigned char* data, size_t length, unsigned char* out, size_t out_capacity, data_link_fcs_t* fcs);
+// Destuffs frame content that follows a start flag, up to and including the closing flag.
+// consumed counts the input bytes examined (including the closing flag or the offending byte).
+// When fcs is not NULL it is updated in the same pass with everything except the trailing FCS bytes.
+data_link_destuff_result_t data_link_destuff(const unsigned char* data, size_t length, unsigned char* out, size_t out_capacity, size_t* consumed, size_t* produced, data_link_fcs_t* fcs);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "headers/colors.h"
+
+// Log-linear (HDR-style) buckets: exact below 32 ns, then 32 sub-buckets per power of two, so every
+// recorded value is within about 3% of the one reported.
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_BITS 36 // Values of 2^36 ns (about 69 s) and above share the last bucket
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+#define LATENCY_CACHE_LINE 64
+
+// Recorded from any thread with relaxed atomic adds; readers may see a recording half applied.
+// Holds no pointers, so it can also live in memory shared between processes.
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t min_inverted; // UINT64_MAX - min, so that 0 means empty and min can be raised like max
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[LATENCY_BUCKETS];
+} __attribute__((aligned(LATENCY_CACHE_LINE))) latency_histogram_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t min_ns;
+    double mean_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} latency_summary_t;
+
+// Each stage is the time between two consecutive layer boundaries of one packet.
+typedef enum {
+    LATENCY_TX_APPLICATION,       // send_application_data until the transport layer is entered
+    LATENCY_TX_TRANSPORT,         // UDP header and checksum
+    LATENCY_TX_NETWORK,           // IP header, checksum and fragmentation
+    LATENCY_TX_DATALINK,          // Until the physical layer is entered
+    LATENCY_TX_PHYSICAL,          // Slot claims (including full-ring waits), stuffing into the slots, publish and wakeup
+    LATENCY_TX_TOTAL,             // send_application_data, start to finish
+    LATENCY_RX_WIRE,              // Sender publish until the receiver thread claims the slot
+    LATENCY_RX_QUEUE_DATALINK,    // Claimed frame waiting for its worker or a thread pool thread
+    LATENCY_RX_DATALINK,
+    LATENCY_RX_QUEUE_NETWORK,
+    LATENCY_RX_NETWORK,           // Including reassembly; a datagram is timed by its last fragment
+    LATENCY_RX_QUEUE_TRANSPORT,
+    LATENCY_RX_TRANSPORT,
+    LATENCY_RX_QUEUE_APPLICATION,
+    LATENCY_RX_APPLICATION,
+    LATENCY_RX_TOTAL,             // Receiver claim until the application handler returns
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+// Timestamps of the packet being traced. It travels with the packet when a hop crosses threads.
+typedef struct {
+    uint64_t origin_ns; // 0 when the packet is not traced
+    uint64_t last_ns;   // Previous boundary
+} latency_trace_t;
+
+extern bool latency_tracing;
+extern _Thread_local latency_trace_t latency_thread_trace;
+
+// Boundaries cost one branch while tracing is off.
+#define LATENCY_MARK(stage) do { if(latency_tracing) latency_mark(stage); } while (0)
+#define LATENCY_END(total_stage) do { if(latency_tracing) latency_end(total_stage); } while (0)
+
+uint64_t latency_now_ns();
+// Starts tracing a packet on the calling thread. Returns the start time.
+uint64_t latency_begin();
+// Records the time since the previous boundary under stage.
+void latency_mark(latency_stage_t stage);
+// Records the time since latency_begin under total_stage and stops tracing.
+void latency_end(latency_stage_t total_stage);
+void latency_record(latency_stage_t stage, uint64_t nanoseconds);
+const char* latency_stage_name(latency_stage_t stage);
+latency_histogram_t* latency_stage_histogram(latency_stage_t stage);
+void latency_print();
+
+void latency_histogram_record(latency_histogram_t* histogram, uint64_t nanoseconds);
+// Value at the given percentile (0-100) of everything recorded so far, in nanoseconds.
+uint64_t latency_histogram_percentile(latency_histogram_t* histogram, double percentile);
+void latency_histogram_summarize(latency_histogram_t* histogram, latency_summary_t* summary);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "headers/colors.h"
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_WARN  3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_COUNT 5
+
+// Statements below this level are compiled out entirely; set with make LOG_LEVEL=<level>.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO
+#define LOG_RING_RECORDS 1024 // Records a thread can have waiting for the writer; further records are dropped
+#define LOG_RECORD_TEXT 240
+#define LOG_WRITER_IDLE_US 1000
+
+typedef enum {
+    LOG_MAIN,
+    LOG_PHYSICAL,
+    LOG_RX,
+    LOG_DATALINK,
+    LOG_NETWORK,
+    LOG_TRANSPORT,
+    LOG_APP,
+    LOG_POOL,
+    LOG_LATENCY,
+    LOG_CATEGORY_COUNT
+} log_category_t;
+
+#define LOG_ALL_CATEGORIES ((1u << LOG_CATEGORY_COUNT) - 1)
+
+extern int log_level;
+extern uint32_t log_categories;
+
+// The compile-time comparison is constant, so disabled statements and their arguments vanish from the build.
+#define LOG_ENABLED(level, category) ((level) >= LOG_COMPILE_LEVEL && (level) >= log_level && (log_categories & (1u << (category))) != 0)
+#define LOG_AT(level, category, ...) do { if(LOG_ENABLED(level, category)) log_write(level, category, __VA_ARGS__); } while (0)
+#define LOG_TRACE(category, ...) LOG_AT(LOG_LEVEL_TRACE, category, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) LOG_AT(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) LOG_AT(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define LOG_WARN(category, ...) LOG_AT(LOG_LEVEL_WARN, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...) LOG_AT(LOG_LEVEL_ERROR, category, __VA_ARGS__)
+#define LOG_HEX(level, category, label, data, length) do { if(LOG_ENABLED(level, category)) log_hex(level, category, label, data, length); } while (0)
+
+const char* log_level_name(int level);
+int log_level_parse(const char* name, int* level);
+// Comma-separated category names, or "all".
+int log_categories_parse(const char* list, uint32_t* categories);
+// Until log_init the records are written synchronously by the calling thread.
+int log_init();
+void log_shutdown();
+// Formats the record into the calling thread's ring; a background thread writes it out.
+void log_write(int level, log_category_t category, const char* format, ...) __attribute__((format(printf, 3, 4)));
+void log_hex(int level, log_category_t category, const char* label, const unsigned char* data, size_t length);
+uint64_t log_dropped_records();
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "headers/colors.h"
+
+#define METRICS_MAGIC 0x5053544154533031ULL // "PSTATS01"
+#define METRICS_VERSION 6
+#define METRICS_MAX_THREADS 64 // Threads beyond this share one slot with atomic adds
+#define METRICS_CACHE_LINE 64
+#define METRICS_NAME_SIZE 48
+
+// Every counter only grows; the stats tool turns them into rates.
+typedef enum {
+    METRIC_PHY_FRAMES_SENT,
+    METRIC_PHY_BYTES_SENT,
+    METRIC_PHY_FRAMES_RECEIVED,
+    METRIC_PHY_BYTES_RECEIVED,
+    METRIC_PHY_RING_FULL_WAITS,
+    METRIC_PHY_SEND_DROPS,
+    METRIC_PHY_INVALID_SLOTS,
+    METRIC_PHY_LINKS_ADDED, // Learned from received frames, made by a send, or configured
+    METRIC_PHY_LINKS_AGED,
+    METRIC_RX_QUEUED, // Frames and layer hops handed to a worker queue or the thread pool
+    METRIC_RX_STARTED, // ... and picked up; the difference is the queue depth
+    METRIC_RX_DISPATCH_FAILURES,
+    METRIC_DL_FRAMES_SENT,
+    METRIC_DL_BYTES_SENT,
+    METRIC_DL_FRAMES_RECEIVED,
+    METRIC_DL_BYTES_RECEIVED,
+    METRIC_DL_FCS_FAILURES,
+    METRIC_DL_FRAMING_ERRORS,
+    METRIC_NW_PACKETS_SENT,
+    METRIC_NW_FRAGMENTS_SENT,
+    METRIC_NW_BYTES_SENT,
+    METRIC_NW_FRAGMENTS_RECEIVED,
+    METRIC_NW_DATAGRAMS_RECEIVED,
+    METRIC_NW_BYTES_RECEIVED,
+    METRIC_NW_CHECKSUM_FAILURES,
+    METRIC_NW_MALFORMED,
+    METRIC_NW_REASSEMBLY_TIMEOUTS,
+    METRIC_NW_REASSEMBLY_DROPS,
+    METRIC_NW_FORWARDED, // Fragments routed on to another instance
+    METRIC_NW_BYTES_FORWARDED,
+    METRIC_NW_FORWARD_DROPS, // ... that the link did not take
+    METRIC_NW_NO_ROUTE,
+    METRIC_NW_TTL_EXPIRED,
+    METRIC_NW_GSO_DATAGRAMS, // Handed to the data link whole, to be cut into frames there
+    METRIC_NW_GRO_COALESCED, // Fragments coalesced in order instead of going through the reassembly table
+    METRIC_TP_SEGMENTS_SENT,
+    METRIC_TP_BYTES_SENT,
+    METRIC_TP_SEGMENTS_RECEIVED,
+    METRIC_TP_BYTES_RECEIVED,
+    METRIC_TP_CHECKSUM_FAILURES,
+    METRIC_TP_MALFORMED,
+    METRIC_TP_NO_PORT, // Datagrams to a port nobody has bound
+    METRIC_TP_QUEUE_DROPS, // Datagrams dropped because the endpoint's receive queue was full
+    METRIC_RT_SEGMENTS_SENT, // Reliable data segments, retransmissions included
+    METRIC_RT_RETRANSMITS,
+    METRIC_RT_TIMEOUTS,
+    METRIC_RT_ACKS_SENT, // Acknowledgements without data
+    METRIC_RT_SEGMENTS_RECEIVED,
+    METRIC_RT_BYTES_DELIVERED, // In order, to the connection's callback or queue
+    METRIC_RT_DUPLICATES,
+    METRIC_RT_WINDOW_DROPS, // Segments beyond the advertised receive window
+    METRIC_APP_MESSAGES_SENT,
+    METRIC_APP_MESSAGES_RECEIVED,
+    METRIC_ALLOC_FAILURES,
+    METRIC_COUNT
+} metric_id_t;
+
+// One per thread, each on its own cache lines, so the data path never shares a line with another writer.
+typedef struct {
+    _Atomic uint64_t counters[METRIC_COUNT];
+    atomic_bool in_use; // Released when the thread exits; the next thread adopts the slot and its totals
+    bool shared; // Overflow slot written by several threads
+} __attribute__((aligned(METRICS_CACHE_LINE))) metrics_slot_t;
+
+// Layout of the /metrics_<mac> segment. The instance maps it read-write; readers map it read-only.
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t metric_count;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    int32_t pid;
+    int64_t start_time; // Wall-clock seconds when the instance published the segment
+    atomic_bool active; // Cleared just before the owner unlinks the segment
+    char names[METRIC_COUNT][METRICS_NAME_SIZE];
+    metrics_slot_t slots[METRICS_MAX_THREADS + 1] __attribute__((aligned(METRICS_CACHE_LINE)));
+} metrics_segment_t;
+
+extern _Thread_local metrics_slot_t* metrics_thread_slot;
+metrics_slot_t* metrics_claim_slot();
+
+static inline void metrics_add(metric_id_t metric, uint64_t value) {
+    metrics_slot_t* slot = metrics_thread_slot != NULL ? metrics_thread_slot : metrics_claim_slot();
+    // The owning thread is the only writer, so a plain load and store replaces a locked add.
+    if(!slot->shared) atomic_store_explicit(&slot->counters[metric], atomic_load_explicit(&slot->counters[metric], memory_order_relaxed) + value, memory_order_relaxed);
+    else atomic_fetch_add_explicit(&slot->counters[metric], value, memory_order_relaxed);
+}
+
+static inline void metrics_inc(metric_id_t metric) {
+    metrics_add(metric, 1);
+}
+
+void metrics_segment_name(const char* mac_address, char* name, size_t name_size);
+// Publishes the counters in shared memory; until then they are kept in process memory only.
+int metrics_init(const char* mac_address);
+void metrics_shutdown();
+// Sum of the counter over every thread slot.
+uint64_t metrics_total(const metrics_segment_t* segment, metric_id_t metric);
+// The same for this instance's own counters.
+uint64_t metrics_value(metric_id_t metric);
+
+#endif
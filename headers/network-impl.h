@@ -3,24 +3,65 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include "headers/colors.h"
+#include "headers/packet-buffer.h"
 
 typedef struct {
     uint16_t total_length;
     uint16_t identification;
     uint16_t flags_fragment_offset;
     uint8_t protocol;
+    uint8_t ttl; // Hops left; a router drops the datagram rather than forward it with none
     uint16_t header_checksum;
-    // uint32_t src_ip;
-    // uint32_t dest_ip;
+    uint16_t reserved;
+    uint32_t src_ip;
+    uint32_t dest_ip;
 } simple_ip_header_t;
 
+// Left in a delivered datagram's control area for the transport layer.
+typedef struct {
+    uint32_t src_address;
+    uint32_t dest_address;
+} network_receive_control_t;
+
 #define IP_FLAG_MF 0x2000
 #define IP_FLAG_DF 0x4000
 #define IP_OFFSET_MASK 0x1FFF
+#define NETWORK_MAX_DATAGRAM_PAYLOAD (0xFFFF - (int)sizeof(simple_ip_header_t))
+#define REASSEMBLY_TIMEOUT 30
+#define REASSEMBLY_SHARDS 16
+#define REASSEMBLY_MAX_HOLES 64
+#define REASSEMBLY_MEMORY_CAP (8 * 1024 * 1024)
+#define REASSEMBLY_HOLE_OPEN UINT32_MAX
+#define NETWORK_DEFAULT_TTL 64
+#define NETWORK_BROADCAST_ADDRESS 0xFFFFFFFFu
+#define NETWORK_TRIE_STRIDE 8 // Address bits consumed per trie level, so a lookup visits at most 4 nodes
+#define NETWORK_MAX_NEXT_HOPS 256
+#define NETWORK_ADDRESS_STRING_SIZE 16
+
+// Addresses are IPv4-style, held in host order. 0 is this instance's own address while it has none, and a
+// datagram to 0 is for whoever receives it. An instance without an address delivers everything and never forwards.
+extern uint32_t network_local_address;
+// Segmentation offload on send and coalescing of in-order fragments on receive; on unless -G turns it off.
+extern bool network_offload;
+
 void handle_data_link_to_network(void* dl_payload);
+// Adds the default route over destination_mac_address unless a default route was configured.
 void network_layer_init();
 void network_layer_shutdown();
-int handle_transport_to_network(const unsigned char* transport_data, size_t transport_data_length, uint8_t protocol_type);
+// Moves whatever the calling receive worker is still coalescing into the reassembly table.
+void network_gro_flush();
+// Sends the datagram to dest_address, over the link its route names.
+int handle_transport_to_network(packet_buffer_t* transport_packet, uint8_t protocol_type, uint32_t dest_address);
+// Routes prefix/prefix_length (0-32) over the link to next_hop_mac, replacing an equal prefix. Safe while
+// packets are being forwarded. Returns -1 if the prefix is invalid or too many next hops are in use.
+int network_route_add(uint32_t prefix, uint8_t prefix_length, const char* next_hop_mac);
+// MAC of the link of the longest prefix that matches address, or NULL when no route does.
+const char* network_route_lookup(uint32_t address);
+// Parse "a.b.c.d" and "a.b.c.d/len"; return -1 on malformed input.
+int network_address_parse(const char* text, uint32_t* address);
+int network_prefix_parse(const char* text, uint32_t* prefix, uint8_t* prefix_length);
+const char* network_address_format(uint32_t address, char* text, size_t text_size);
 
 #endif
@@ -0,0 +1,55 @@
+#ifndef PACKET_BUFFER_H
+#define PACKET_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define PACKET_BUFFER_DEFAULT_HEADROOM 64 // Room for every header the stack prepends (link protocol, IP, UDP)
+#define PACKET_BUFFER_MAX_FRAGS 8
+#define PACKET_BUFFER_CONTROL_SIZE 48
+
+typedef struct packet_buffer packet_buffer_t;
+
+// Payload a buffer carries by reference instead of in its own storage.
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+    packet_buffer_t* owner; // Holds a reference while data points into it; NULL for borrowed caller memory
+} packet_buffer_frag_t;
+
+// A packet is its linear bytes followed by its fragments. Linear bytes live in the buffer's own
+// storage: headers are prepended into the headroom (push) and data appended into the tailroom (put).
+// Fragments reference ranges of other buffers (slices) or caller memory that outlives the buffer.
+// On the receive path a buffer can instead wrap a pool block it did not allocate (packet_buffer_wrap).
+struct packet_buffer {
+    _Atomic uint32_t refcount;
+    unsigned char* data;
+    size_t length;
+    size_t headroom;
+    size_t tailroom;
+    size_t frag_count;
+    packet_buffer_frag_t frags[PACKET_BUFFER_MAX_FRAGS];
+    void* external; // Wrapped pool block, freed with the buffer
+    // Scratch space for whichever layer currently owns the buffer, to carry state across a hop.
+    unsigned char control[PACKET_BUFFER_CONTROL_SIZE] __attribute__((aligned(8)));
+    unsigned char storage[];
+};
+
+packet_buffer_t* packet_buffer_alloc(size_t headroom, size_t tailroom);
+// Takes ownership of a buffer_pool block holding length bytes of packet, without copying them.
+packet_buffer_t* packet_buffer_wrap(void* block, size_t length);
+void packet_buffer_ref(packet_buffer_t* buffer);
+void packet_buffer_release(packet_buffer_t* buffer);
+// Each returns the start of the affected bytes, or NULL if the buffer has no room for them.
+unsigned char* packet_buffer_push(packet_buffer_t* buffer, size_t length);
+unsigned char* packet_buffer_pull(packet_buffer_t* buffer, size_t length);
+unsigned char* packet_buffer_put(packet_buffer_t* buffer, size_t length);
+// Drops linear bytes past length, e.g. link padding behind the datagram. Returns -1 if the buffer is shorter.
+int packet_buffer_trim(packet_buffer_t* buffer, size_t length);
+int packet_buffer_attach(packet_buffer_t* buffer, const unsigned char* data, size_t length, packet_buffer_t* owner);
+size_t packet_buffer_length(const packet_buffer_t* buffer);
+// New buffer with its own headroom whose payload references bytes [offset, offset + length) of buffer.
+packet_buffer_t* packet_buffer_slice(packet_buffer_t* buffer, size_t offset, size_t length, size_t headroom);
+
+#endif
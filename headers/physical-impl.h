@@ -14,17 +14,127 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include "headers/colors.h"
+#include "headers/latency.h"
+
+#define PHYSICAL_RING_DEFAULT_SLOTS 64
+#define PHYSICAL_RING_MAX_SLOTS 65536
+#define PHYSICAL_RING_MAGIC 0x52494E47u
+#define PHYSICAL_CACHE_LINE 64
+#define PHYSICAL_SEND_FULL_TIMEOUT_MS 1000
+#define PHYSICAL_MAX_BATCH 32
+#define PHYSICAL_MAC_SIZE 20 // A MAC is the name of the instance's ring, NUL-terminated
+#define PHYSICAL_LINK_BUCKETS 256
+#define PHYSICAL_MAX_LINKS 4096 // Bounds what learning can take from frames of unknown senders
+#define PHYSICAL_LINK_DEFAULT_AGE_S 300
+#define PHYSICAL_LINK_SWEEP_INTERVAL_MS 1000
+#define PHYSICAL_MAX_RX_QUEUES 32
+#define PHYSICAL_MAX_CPUS 1024 // As many as a cpu_set_t holds
+
+// Every slot starts out with sequence == its index. A producer may fill the slot
+// at position pos once sequence == pos and publishes it with sequence = pos + 1;
+// the consumer frees it again with sequence = pos + slot_count. Slots can be
+// freed out of order, a producer only ever waits for the one slot it claimed.
+typedef struct {
+    _Atomic uint64_t sequence;
+    uint32_t length;
+    uint32_t flow_hash; // Set by the sender, picks the receive worker
+    uint64_t published_ns; // CLOCK_MONOTONIC time of publishing while the sender traces latency, else 0
+    char source[PHYSICAL_MAC_SIZE]; // MAC of the sender, learned by the receiver
+} physical_slot_header_t;
+
+typedef struct {
+    _Atomic uint32_t magic; // Written last, once the ring is ready for producers
+    uint32_t slot_count;
+    uint32_t slot_size; // Derived from mtu
+    uint32_t slot_stride;
+    uint32_t mtu;       // Senders refuse a ring whose MTU differs from their own
+    uint32_t queue_count; // Rings in the segment, laid out back to back; only the first one's header has this set
+    _Atomic uint32_t generation; // Changes on every (re)start of the owner, 0 once it has retired the segment
+    _Atomic uint64_t head __attribute__((aligned(PHYSICAL_CACHE_LINE))); // Next position producers claim
+    _Atomic uint64_t tail __attribute__((aligned(PHYSICAL_CACHE_LINE))); // Next position the receiver reads
+} physical_ring_header_t;
+
+#define PHYSICAL_RING_HEADER_SIZE ((sizeof(physical_ring_header_t) + PHYSICAL_CACHE_LINE - 1) & ~(size_t)(PHYSICAL_CACHE_LINE - 1))
+#define PHYSICAL_SLOT_STRIDE(slot_size) ((sizeof(physical_slot_header_t) + (slot_size) + PHYSICAL_CACHE_LINE - 1) & ~(size_t)(PHYSICAL_CACHE_LINE - 1))
+#define PHYSICAL_RING_SIZE(slot_count, slot_stride) (PHYSICAL_RING_HEADER_SIZE + (size_t)(slot_count) * (slot_stride))
+
+// A frame to send, either copied from data/length or, when write is set, produced by write()
+// straight into its ring slot. write() returns the bytes written, or -1 if they do not fit.
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+    uint32_t flow_hash;
+    long (*write)(void* context, unsigned char* slot_data, size_t slot_capacity);
+    void* context;
+} physical_frame_t;
+
+// A received frame still sitting in its ring slot. The slot stays owned by the
+// receiver until physical_layer_release_frame(), so handlers can parse it in place.
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+    uint64_t position;
+    uint32_t queue; // Receive queue whose ring holds the slot
+    uint32_t flow_hash;
+    latency_trace_t trace; // Carried to the worker that processes the frame
+} physical_rx_frame_t;
+
+// Sender-side connection to another instance's rings, kept mapped across sends.
+// Senders hold the lock shared while writing; (re)connecting takes it exclusively.
+typedef struct {
+    char name[50];
+    char sem_name[50];   // Of the first queue
+    sem_t* sems[PHYSICAL_MAX_RX_QUEUES];
+    uint32_t queue_count; // Queues whose semaphore is open
+    physical_ring_header_t* ring; // The first queue, whose header describes the segment
+    size_t map_size;
+    uint32_t generation;
+    uint32_t mismatch_generation; // Generation whose MTU mismatch was last reported
+    pthread_rwlock_t lock;
+} physical_peer_t;
+
+// A link to another instance, found by its MAC in a hash table. Links are learned from the source of received frames
+// or made by the first send to a MAC, and map the peer's ring on first use. Links without traffic in either direction
+// for physical_link_age_s are dropped and unmapped; static links (the default destination) are kept.
+typedef struct physical_link {
+    physical_peer_t peer;
+    uint32_t hash;
+    bool is_static;
+    _Atomic uint64_t last_seen_ns;
+    _Atomic uint32_t references; // One for the table while the link is in it, one per sender using it
+    struct physical_link* next;
+} physical_link_t;
 
-#define SHARED_MEM_SIZE 2048
 extern int physical_shm_fd;
-extern char physical_sem_name[50];
-extern sem_t *physical_sem;
 extern void* physical_shm_ptr;
+extern size_t physical_shm_size;
+extern uint32_t physical_ring_slots; // Per receive queue
+extern uint32_t physical_link_age_s;
+// An instance receives on physical_rx_queues rings, each drained by its own receiver thread. Senders pick the ring
+// from the flow hash, as RSS does, so a flow stays on one queue and in order.
+extern uint32_t physical_rx_queues;
+// Queue i's receiver thread is pinned to core (physical_rx_first_cpu + i) % online cores. -1 pins from core 0
+// when there are several queues and leaves a single receiver thread unpinned.
+extern int physical_rx_first_cpu;
 int physical_layer_init();
 void physical_layer_shutdown();
 int start_physical_receiver_thread();
+// param is the index of the receive queue to drain.
 void* receive_frame_thread(void* param);
-int physical_layer_send(const unsigned char* frame_data, size_t frame_length);
+// Adds a static link to mac, which never ages out. Returns -1 if mac is invalid or the table is full.
+int physical_layer_add_link(const char* mac);
+size_t physical_layer_link_count();
+// Set by a thread that must not wait on a full destination ring, such as one forwarding frames it received: two
+// forwarders waiting on each other's rings would never drain them. Sends then drop what does not fit at once.
+extern _Thread_local bool physical_send_no_wait;
+#define PHYSICAL_SEND_DROPPED -2 // Returned instead of -1 when physical_send_no_wait dropped frames
+// Send to the link of destination, or of destination_mac_address when destination is NULL.
+int physical_layer_send(const char* destination, const unsigned char* frame_data, size_t frame_length);
+int physical_layer_send_batch(const char* destination, const physical_frame_t* frames, size_t frame_count);
+void physical_layer_release_frame(physical_rx_frame_t* frame);
 
 #endif
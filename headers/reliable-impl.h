@@ -0,0 +1,92 @@
+#ifndef RELIABLE_IMPL_H
+#define RELIABLE_IMPL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "headers/colors.h"
+#include "headers/data-link-impl.h"
+#include "headers/network-impl.h"
+#include "headers/transport-impl.h"
+
+// Sequence numbers count segments, not bytes, so the SACK bitmap and both windows are in segments too.
+typedef struct {
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint32_t session;     // Chosen at random by the sender of this segment each time it opens the connection
+    uint32_t ack_session; // Session of the peer stream being acknowledged
+    uint32_t seq;
+    uint32_t ack;         // Every segment of the peer stream before this one has arrived
+    uint32_t sack;        // Bit i set: segment ack + 1 + i has arrived too
+    uint16_t window;      // Segments the receiver can take from ack onwards
+    uint16_t length;      // Header and payload
+    uint8_t flags;
+    uint8_t reserved;
+    uint16_t checksum;
+} reliable_header_t;
+#define RELIABLE_PROTOCOL_NUMBER 27 // RDP, unused by anything else on this link
+
+#define RELIABLE_FLAG_DATA 0x01
+#define RELIABLE_FLAG_ACK 0x02
+
+// Segments are sized from the link MTU so that the network layer never fragments them.
+#define RELIABLE_MSS (((data_link_mtu - sizeof(simple_ip_header_t)) & ~(size_t)7) - sizeof(reliable_header_t))
+#define RELIABLE_SEND_BUFFER 512    // Segments queued or in flight per connection
+#define RELIABLE_RECEIVE_WINDOW 256 // Segments a connection holds out of order or waiting in its receive queue
+#define RELIABLE_SACK_BITS 32
+#define RELIABLE_INITIAL_CWND 4
+#define RELIABLE_DUPACK_THRESHOLD 3
+#define RELIABLE_ACK_EVERY 2        // In-order segments acknowledged together
+#define RELIABLE_DELAYED_ACK_US 500
+#define RELIABLE_INITIAL_RTO_US 20000
+#define RELIABLE_MIN_RTO_US 1000
+#define RELIABLE_MAX_RTO_US 1000000
+#define RELIABLE_TIMER_TICK_US 250
+#define RELIABLE_MAX_BURST 64       // Segments built under the connection lock before they are sent
+
+// One end of a reliable connection: an ordered, retransmitted stream of segments between a local and a remote port.
+typedef struct reliable_connection reliable_connection_t;
+
+// Called with the stream's segments in order, one at a time. Like transport_receive_callback_t, the message is loaned
+// and released with transport_message_release.
+typedef void (*reliable_receive_callback_t)(reliable_connection_t* connection, transport_message_t* message, void* context);
+
+typedef struct {
+    uint64_t segments_sent;
+    uint64_t retransmits;
+    uint64_t timeouts;
+    uint64_t fast_recoveries;
+    uint64_t segments_received;
+    uint32_t cwnd;        // Segments
+    uint32_t ssthresh;
+    uint32_t peer_window;
+    uint32_t srtt_us;
+    uint32_t rto_us;
+    uint32_t in_flight;
+    uint32_t queued;      // Accepted by reliable_send but not yet sent
+} reliable_stats_t;
+
+void handle_network_to_reliable(void* network_payload);
+
+int reliable_layer_init();
+// Stops the transmit thread, which also runs the retransmission timers, and closes every connection still open.
+void reliable_layer_shutdown();
+// Frees the port locks and the transmit wakeup. Call it only once nothing can receive a segment any more.
+void reliable_layer_destroy();
+// Opens the local end of a connection to remote_port at remote_address (0: the peer on the default route, from
+// whatever address it sends). Segments arrive at callback, or in a receive queue drained with reliable_recv_many
+// when callback is NULL. Returns NULL if local_port already has a connection.
+reliable_connection_t* reliable_open(uint16_t local_port, uint32_t remote_address, uint16_t remote_port, reliable_receive_callback_t callback, void* context);
+// Queues length bytes, split into segments of at most RELIABLE_MSS, and sends as many as the windows allow.
+// Blocks while the send buffer is full, so it must not be called from a receive callback, which would hold up the
+// acknowledgements it waits for. Returns 0 once everything is queued, or -1 if the connection was closed.
+int reliable_send(reliable_connection_t* connection, const void* data, size_t length);
+// Waits up to timeout_ms (-1: forever) until the peer has acknowledged everything queued. Returns 0 or -1 on timeout.
+int reliable_flush(reliable_connection_t* connection, int timeout_ms);
+// Same contract as transport_recv_many, for a connection opened without a callback.
+int reliable_recv_many(reliable_connection_t* connection, transport_message_t* messages, size_t max_messages, int timeout_ms);
+// Unacknowledged data is discarded; call reliable_flush first to deliver it. The handle must not be used afterwards.
+void reliable_close(reliable_connection_t* connection);
+void reliable_get_stats(reliable_connection_t* connection, reliable_stats_t* stats);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef RX_DISPATCH_H
+#define RX_DISPATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "headers/physical-impl.h"
+#include "headers/colors.h"
+
+#define RX_DEFAULT_WORKERS 4
+#define RX_MAX_WORKERS 64
+
+typedef enum {
+    RX_MODE_RUN_TO_COMPLETION = 0, // One flow-affine worker carries a frame through every layer
+    RX_MODE_PIPELINE,              // Every layer hop is a separate thread pool task
+    RX_MODE_COUNT
+} rx_mode_t;
+
+extern rx_mode_t rx_mode;
+extern int rx_worker_count;
+const char* rx_mode_name(rx_mode_t mode);
+int rx_mode_parse(const char* name, rx_mode_t* mode);
+// Starts the run-to-completion workers; queue_capacity must cover every frame that can be in flight at once.
+int rx_dispatch_init(uint32_t queue_capacity);
+// Lets the workers finish every queued frame, then stops them.
+void rx_dispatch_shutdown();
+// Hands a claimed frame to the data link layer. Called from the receiver thread of the frame's queue only.
+int rx_dispatch_frame(physical_rx_frame_t* frame);
+// Passes received data up to the next layer's handler.
+int rx_dispatch_next(void (*handler)(void*), void* data);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef STACK_H
+#define STACK_H
+
+#include "headers/colors.h"
+
+#define STACK_THREAD_POOL_THREADS 4
+
+// Brings up every layer for the instance source_mac, sending to destination_mac. The layer options
+// (FCS mode, receive mode and workers, ring slots, pool limit, latency tracing) are read as they are set.
+// Logging is left to the caller; start it first so the stack can report.
+int stack_init(const char* source_mac, const char* destination_mac);
+// Stops receiving, lets in-flight work finish and tears every layer down.
+void stack_shutdown();
+
+#endif
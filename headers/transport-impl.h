@@ -3,7 +3,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/uio.h>
 #include "headers/colors.h"
+#include "headers/packet-buffer.h"
 
 typedef struct {
     uint16_t src_port;
@@ -12,7 +14,47 @@ typedef struct {
     uint16_t checksum;
 } simple_udp_header_t;
 #define UDP_PROTOCOL_NUMBER 17
+
+#define TRANSPORT_PORT_COUNT 65536
+#define TRANSPORT_PORT_LOCK_STRIPES 64
+#define TRANSPORT_DEFAULT_QUEUE_DEPTH 1024
+#define TRANSPORT_MAX_QUEUE_DEPTH 65536
+#define TRANSPORT_MAX_IOV (PACKET_BUFFER_MAX_FRAGS - 1) // A fragment slice may reference the UDP header and every iovec
+
+// A bound port. Datagrams to it go either to its callback or to its bounded receive queue.
+typedef struct transport_endpoint transport_endpoint_t;
+
+// A received datagram's payload, loaned straight out of the buffer it was received into.
+typedef struct {
+    const unsigned char* data; // Valid until transport_message_release
+    size_t length;
+    uint32_t src_address; // Where to send a reply
+    uint16_t src_port;
+    uint16_t dest_port;
+    void* block;
+} transport_message_t;
+
+// Called on the receive workers, so datagrams of different flows may arrive concurrently. The message is loaned
+// to the callback, which releases it with transport_message_release, then or later and from any thread.
+typedef void (*transport_receive_callback_t)(transport_endpoint_t* endpoint, transport_message_t* message, void* context);
+
 void handle_network_to_transport(void* network_payload);
-int handle_application_to_transport(const unsigned char* app_data, size_t app_data_length, uint16_t src_port, uint16_t dest_port);
+int handle_application_to_transport(const unsigned char* app_data, size_t app_data_length, uint16_t src_port, uint32_t dest_address, uint16_t dest_port);
+// Sends the concatenation of up to TRANSPORT_MAX_IOV buffers as one datagram, without gathering them first.
+int handle_application_to_transport_iov(const struct iovec* iov, int iov_count, uint16_t src_port, uint32_t dest_address, uint16_t dest_port);
+
+void transport_layer_init();
+// Closes every endpoint still bound; their handles must not be used afterwards.
+void transport_layer_shutdown();
+// Binds port to callback, or to a receive queue of queue_depth datagrams (0 for the default) when callback is NULL.
+// Returns NULL if the port is already bound.
+transport_endpoint_t* transport_bind(uint16_t port, transport_receive_callback_t callback, void* context, uint32_t queue_depth);
+// Frees the port. Threads waiting in transport_recv_many return -1; the handle must not be used once this returns.
+void transport_unbind(transport_endpoint_t* endpoint);
+uint16_t transport_endpoint_port(const transport_endpoint_t* endpoint);
+// Moves up to max_messages queued datagrams into messages, each to be released with transport_message_release, waiting up to timeout_ms (-1: forever) for the first.
+// Returns the number moved, 0 on timeout, or -1 once the endpoint is unbound or has a callback instead of a queue.
+int transport_recv_many(transport_endpoint_t* endpoint, transport_message_t* messages, size_t max_messages, int timeout_ms);
+void transport_message_release(transport_message_t* message);
 
 #endif
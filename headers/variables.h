@@ -3,7 +3,6 @@
 
 #include <stdbool.h>
 
-extern bool DEBUG_ENABLED;
 extern char source_mac_address[20];
 extern char destination_mac_address[20];
 
@@ -3,18 +3,29 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <getopt.h>
 #include "headers/variables.h"
-#include "headers/thread-pool.h"
 #include "headers/physical-impl.h"
+#include "headers/data-link-impl.h"
 #include "headers/network-impl.h"
+#include "headers/rx-dispatch.h"
+#include "headers/buffer-pool.h"
+#include "headers/log.h"
+#include "headers/latency.h"
+#include "headers/stack.h"
 #include "headers/application-impl.h"
 #include "headers/colors.h"
 
-bool DEBUG_ENABLED = true;
-char source_mac_address[20];
-char destination_mac_address[20];
-threadpool thpool = NULL;
 volatile sig_atomic_t shutdown_flag = 0;
+volatile sig_atomic_t latency_dump_flag = 0;
+
+#define MAIN_MAX_ROUTES 64
+
+typedef struct {
+    uint32_t prefix;
+    uint8_t prefix_length;
+    const char* next_hop;
+} main_route_t;
 
 void handle_sigint(int sig) {
     (void)sig;
@@ -22,40 +33,218 @@ void handle_sigint(int sig) {
     shutdown_flag = 1;
 }
 
+void handle_sigusr1(int sig) {
+    (void)sig;
+    latency_dump_flag = 1;
+}
+
 int main(int argc, char *argv[]) {
-    if(argc != 3) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "Usage: %s <source_mac> <destination_mac>\n", argv[0]);
+    static const struct option long_options[] = {
+        {"ring-slots", required_argument, NULL, 's'},
+        {"mtu", required_argument, NULL, 'm'},
+        {"fcs", required_argument, NULL, 'f'},
+        {"rx-mode", required_argument, NULL, 'r'},
+        {"rx-workers", required_argument, NULL, 'w'},
+        {"rx-queues", required_argument, NULL, 'q'},
+        {"rx-cpu", required_argument, NULL, 'C'},
+        {"pool-limit", required_argument, NULL, 'p'},
+        {"log-level", required_argument, NULL, 'l'},
+        {"log-categories", required_argument, NULL, 'L'},
+        {"trace-latency", no_argument, NULL, 't'},
+        {"link-age", required_argument, NULL, 'a'},
+        {"address", required_argument, NULL, 'i'},
+        {"route", required_argument, NULL, 'R'},
+        {"destination-address", required_argument, NULL, 'd'},
+        {"no-offload", no_argument, NULL, 'G'},
+        {NULL, 0, NULL, 0}
+    };
+    main_route_t routes[MAIN_MAX_ROUTES];
+    size_t route_count = 0;
+    bool usage_error = false;
+    int option;
+    while ((option = getopt_long(argc, argv, "s:m:f:r:w:q:C:p:l:L:ta:i:R:d:G", long_options, NULL)) != -1) {
+        switch (option) {
+            case 's': {
+                char* end = NULL;
+                unsigned long slots = strtoul(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || slots == 0 || slots > PHYSICAL_RING_MAX_SLOTS) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid ring slot count '%s' (1-%d).\n", optarg, PHYSICAL_RING_MAX_SLOTS);
+                    usage_error = true;
+                }
+                else physical_ring_slots = (uint32_t)slots;
+                break;
+            }
+            case 'm': {
+                char* end = NULL;
+                unsigned long mtu = strtoul(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || mtu < DATA_LINK_MIN_MTU || mtu > DATA_LINK_MAX_MTU) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid MTU '%s' (%d-%d).\n", optarg, DATA_LINK_MIN_MTU, DATA_LINK_MAX_MTU);
+                    usage_error = true;
+                }
+                else data_link_mtu = (uint32_t)mtu;
+                break;
+            }
+            case 'f':
+                if(data_link_fcs_parse(optarg, &data_link_fcs_mode) != 0) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Unknown FCS mode '%s' (sum8 or crc32c).\n", optarg);
+                    usage_error = true;
+                }
+                break;
+            case 'r':
+                if(rx_mode_parse(optarg, &rx_mode) != 0) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Unknown receive mode '%s' (rtc or pipeline).\n", optarg);
+                    usage_error = true;
+                }
+                break;
+            case 'w': {
+                char* end = NULL;
+                long workers = strtol(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || workers < 1 || workers > RX_MAX_WORKERS) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid receive worker count '%s' (1-%d).\n", optarg, RX_MAX_WORKERS);
+                    usage_error = true;
+                }
+                else rx_worker_count = (int)workers;
+                break;
+            }
+            case 'q': {
+                char* end = NULL;
+                unsigned long queues = strtoul(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || queues == 0 || queues > PHYSICAL_MAX_RX_QUEUES) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid receive queue count '%s' (1-%d).\n", optarg, PHYSICAL_MAX_RX_QUEUES);
+                    usage_error = true;
+                }
+                else physical_rx_queues = (uint32_t)queues;
+                break;
+            }
+            case 'C': {
+                char* end = NULL;
+                long cpu = strtol(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || cpu < 0 || cpu >= PHYSICAL_MAX_CPUS) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid core '%s' (0-%d).\n", optarg, PHYSICAL_MAX_CPUS - 1);
+                    usage_error = true;
+                }
+                else physical_rx_first_cpu = (int)cpu;
+                break;
+            }
+            case 'p': {
+                char* end = NULL;
+                unsigned long megabytes = strtoul(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || megabytes == 0 || megabytes > SIZE_MAX / (1024 * 1024)) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid buffer pool limit '%s' (MiB, at least 1).\n", optarg);
+                    usage_error = true;
+                }
+                else buffer_pool_limit_bytes = (size_t)megabytes * 1024 * 1024;
+                break;
+            }
+            case 'l':
+                if(log_level_parse(optarg, &log_level) != 0) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Unknown log level '%s' (trace, debug, info, warn or error).\n", optarg);
+                    usage_error = true;
+                }
+                else if(log_level < LOG_COMPILE_LEVEL) fprintf(stderr, ANSI_COLOR_RESET COLOR_WARN "MAIN Warning: Log level %s was compiled out; this build logs from %s up.\n", log_level_name(log_level), log_level_name(LOG_COMPILE_LEVEL));
+                break;
+            case 'L':
+                if(log_categories_parse(optarg, &log_categories) != 0) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid log categories '%s' (comma-separated: main, physical, rx, datalink, network, transport, app, pool, latency, or all).\n", optarg);
+                    usage_error = true;
+                }
+                break;
+            case 't':
+                latency_tracing = true;
+                break;
+            case 'a': {
+                char* end = NULL;
+                unsigned long seconds = strtoul(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || seconds == 0 || seconds > UINT32_MAX) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid link age '%s' (seconds, at least 1).\n", optarg);
+                    usage_error = true;
+                }
+                else physical_link_age_s = (uint32_t)seconds;
+                break;
+            }
+            case 'i':
+                if(network_address_parse(optarg, &network_local_address) != 0) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid address '%s' (a.b.c.d).\n", optarg);
+                    usage_error = true;
+                }
+                break;
+            case 'd':
+                if(network_address_parse(optarg, &application_destination_address) != 0) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid destination address '%s' (a.b.c.d).\n", optarg);
+                    usage_error = true;
+                }
+                break;
+            case 'R': {
+                // <prefix>/<length>=<next hop mac>
+                char* separator = strchr(optarg, '=');
+                if(separator != NULL) *separator = '\0';
+                if(route_count == MAIN_MAX_ROUTES || separator == NULL || separator[1] == '\0' || network_prefix_parse(optarg, &routes[route_count].prefix, &routes[route_count].prefix_length) != 0) {
+                    if(separator != NULL) *separator = '=';
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Invalid route '%s' (a.b.c.d/len=mac, at most %d).\n", optarg, MAIN_MAX_ROUTES);
+                    usage_error = true;
+                }
+                else routes[route_count++].next_hop = separator + 1;
+                break;
+            }
+            case 'G':
+                network_offload = false;
+                break;
+            default:
+                usage_error = true;
+                break;
+        }
+    }
+    if(usage_error || argc - optind != 2) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "Usage: %s [options] <source_mac> <destination_mac>\n", argv[0]);
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  <source_mac>      : Identifier for this instance's shared memory.\n");
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  <destination_mac> : Identifier of the instance to send messages to.\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -s, --ring-slots <n> : Frames the receive ring can hold in flight (default %d).\n", PHYSICAL_RING_DEFAULT_SLOTS);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -m, --mtu <bytes>    : Largest datagram sent in one frame, %d-%d (default %d). Both ends must match.\n", DATA_LINK_MIN_MTU, DATA_LINK_MAX_MTU, DATA_LINK_DEFAULT_MTU);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -f, --fcs <mode>     : Frame check sequence, sum8 (default) or crc32c. Both ends must match.\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -r, --rx-mode <mode> : rtc (default, one worker per flow runs every layer) or pipeline (a thread pool task per layer).\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -w, --rx-workers <n> : Run-to-completion receive workers (default %d).\n", RX_DEFAULT_WORKERS);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -q, --rx-queues <n>  : Receive rings, each drained by its own receiver thread; senders pick one by flow hash, 1-%d (default 1).\n", PHYSICAL_MAX_RX_QUEUES);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -C, --rx-cpu <n>     : Pin receive queue i to core n + i (default: from core 0 with several queues, unpinned with one).\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -p, --pool-limit <MiB> : Memory the packet buffer pool may take from the system (default %d).\n", BUFFER_POOL_DEFAULT_LIMIT_MB);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -l, --log-level <level> : trace, debug, info (default), warn or error.\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -L, --log-categories <list> : Layers to log, comma-separated (default all).\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -t, --trace-latency  : Time every packet between layers; histograms print on SIGUSR1 and at exit.\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -i, --address <a.b.c.d> : This instance's address. Datagrams to other addresses are forwarded (default: none, take everything).\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -R, --route <a.b.c.d/len=mac> : Route a prefix over the link to mac; repeatable. The default route uses <destination_mac>.\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -d, --destination-address <a.b.c.d> : Address the demo messages are sent to (default: the peer on the default route).\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -a, --link-age <s>   : Drop links learned from other instances after this long without traffic (default %d).\n", PHYSICAL_LINK_DEFAULT_AGE_S);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -G, --no-offload     : Cut datagrams into fragments in the network layer and reassemble every fragment through the table.\n");
         return 1;
     }
-    strncpy(source_mac_address, argv[1], sizeof(source_mac_address) - 1);
-    source_mac_address[sizeof(source_mac_address) - 1] = '\0';
-    strncpy(destination_mac_address, argv[2], sizeof(destination_mac_address) - 1);
-    destination_mac_address[sizeof(destination_mac_address) - 1] = '\0';
-    printf(ANSI_COLOR_RESET COLOR_MAIN "MAIN: Source MAC (Listening ID): %s\n", source_mac_address);
-    printf(ANSI_COLOR_RESET COLOR_MAIN "MAIN: Destination MAC (Sending Target ID): %s\n", destination_mac_address);
+    if(log_init() != 0) return 1;
+    for(size_t i = 0; i < route_count; i++) {
+        if(network_route_add(routes[i].prefix, routes[i].prefix_length, routes[i].next_hop) != 0) {
+            log_shutdown();
+            return 1;
+        }
+    }
     signal(SIGINT, handle_sigint);
-    int num_threads = 4;
-    thpool = thpool_init(num_threads);
-    if(thpool == NULL) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Failed to initialize thread pool.\n");
-        return 1;
+    if(latency_tracing) {
+        signal(SIGUSR1, handle_sigusr1);
+        LOG_INFO(LOG_MAIN, "Latency tracing on. Send SIGUSR1 (kill -USR1 %d) to print the histograms.", (int)getpid());
     }
-    printf(ANSI_COLOR_RESET COLOR_MAIN "MAIN: Thread pool initialized with %d threads.\n", num_threads);
-    network_layer_init();
-    if(physical_layer_init() != 0) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Failed to initialize physical layer.\n");
-        thpool_destroy(thpool);
-        network_layer_shutdown();
+    if(stack_init(argv[optind], argv[optind + 1]) != 0) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Failed to bring up the protocol stack.\n");
+        log_shutdown();
         return 1;
     }
-    printf(ANSI_COLOR_RESET COLOR_MAIN "MAIN: Physical layer initialized and receiver started.\n");
-    printf(ANSI_COLOR_RESET COLOR_MAIN "MAIN: Setup complete. Ready to send/receive.\n");
-    printf(ANSI_COLOR_RESET COLOR_MAIN "MAIN: Press Ctrl+C to exit gracefully.\n");
+    LOG_INFO(LOG_MAIN, "Setup complete. Ready to send/receive.");
+    LOG_INFO(LOG_MAIN, "Press Ctrl+C to exit gracefully.");
     int message_count = 0;
     while (!shutdown_flag) {
-        sleep(10);
+        unsigned int remaining = 10;
+        while (remaining > 0 && !shutdown_flag) {
+            remaining = sleep(remaining);
+            if(latency_dump_flag) {
+                latency_dump_flag = 0;
+                latency_print();
+            }
+        }
         if(shutdown_flag) break;
         message_count++;
         char message_buffer[100];
@@ -63,17 +252,13 @@ int main(int argc, char *argv[]) {
                 message_count, source_mac_address, destination_mac_address);
         const char* message_to_send = message_buffer;
         uint16_t source_port = 12345;
-        uint16_t destination_port = 54321;
-        printf("\nMAIN: Attempting to send application message (%d)...\n", message_count);
+        uint16_t destination_port = APPLICATION_DEFAULT_PORT;
+        LOG_INFO(LOG_MAIN, "Attempting to send application message (%d)...", message_count);
         if(send_application_data(message_to_send, source_port, destination_port) != 0) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "MAIN Error: Failed attempt to send application message (%d).\n", message_count);
     }
-    printf(ANSI_COLOR_RESET COLOR_MAIN "MAIN: Shutting down...\n");
-    physical_layer_shutdown();
-    network_layer_shutdown();
-    if(thpool) {
-        thpool_destroy(thpool);
-        printf(ANSI_COLOR_RESET COLOR_MAIN "MAIN: Thread pool destroyed.\n");
-    }
-    printf(ANSI_COLOR_RESET COLOR_MAIN "MAIN: Shutdown complete.\n");
+    LOG_INFO(LOG_MAIN, "Shutting down...");
+    stack_shutdown();
+    LOG_INFO(LOG_MAIN, "Shutdown complete.");
+    log_shutdown();
     return 0;
 }
@@ -1,24 +1,37 @@
 #include "headers/application-impl.h"
 #include "headers/transport-impl.h"
+#include "headers/log.h"
+#include "headers/metrics.h"
+#include "headers/latency.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 
-extern bool DEBUG_ENABLED;
+uint32_t application_destination_address = 0;
+static transport_endpoint_t* application_endpoint = NULL;
 
-void handle_transport_to_application(void* transport_payload) {
-    if(transport_payload == NULL) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "APP Error: Received NULL data pointer from transport layer.\n");
-        return;
+void handle_transport_to_application(transport_endpoint_t* endpoint, transport_message_t* message, void* context) {
+    (void)context;
+    LOG_DEBUG(LOG_APP, "Received %zu bytes on port %u from port %u.", message->length, transport_endpoint_port(endpoint), message->src_port);
+    printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_GREEN "APP: Received Message: %.*s\n", (int)message->length, (const char*)message->data);
+    transport_message_release(message);
+    LOG_DEBUG(LOG_APP, "Finished processing transport layer data.");
+}
+
+int application_layer_init() {
+    application_endpoint = transport_bind(APPLICATION_DEFAULT_PORT, handle_transport_to_application, NULL, 0);
+    if(application_endpoint == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "APP Error: Failed to bind port %d.\n", APPLICATION_DEFAULT_PORT);
+        return -1;
     }
-    unsigned char* data = (unsigned char*)transport_payload;
-    size_t data_len = strlen((char*)data);
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_GREEN "APP: Received data from transport layer (Size: %zu - assumed string).\n", data_len);
-    printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_GREEN "APP: Received Message: %s\n", (char*)data);
-    free(transport_payload);
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_GREEN "APP: Finished processing transport layer data.\n");
+    return 0;
+}
+
+void application_layer_shutdown() {
+    transport_unbind(application_endpoint);
+    application_endpoint = NULL;
 }
 
 int send_application_data(const char* message, uint16_t src_port, uint16_t dest_port) {
@@ -26,12 +39,25 @@ int send_application_data(const char* message, uint16_t src_port, uint16_t dest_
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "APP Error: Attempted to send NULL message.\n");
         return -1;
     }
-    size_t message_len = strlen(message);
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_GREEN "APP: Sending message: \"%s\" (Length: %zu) from Port %u to Port %u\n", message, message_len, src_port, dest_port);
-    if(handle_application_to_transport((const unsigned char*)message, message_len, src_port, dest_port) != 0) {
+    LOG_DEBUG(LOG_APP, "Sending message: \"%s\" from Port %u to Port %u", message, src_port, dest_port);
+    return send_application_buffer(message, strlen(message), src_port, dest_port);
+}
+
+int send_application_buffer(const void* data, size_t length, uint16_t src_port, uint16_t dest_port) {
+    struct iovec iov = { (void*)data, length };
+    return send_application_iov(&iov, 1, src_port, dest_port);
+}
+
+int send_application_iov(const struct iovec* iov, int iov_count, uint16_t src_port, uint16_t dest_port) {
+    if(latency_tracing) latency_begin();
+    LOG_DEBUG(LOG_APP, "Sending %d buffer(s) from Port %u to Port %u", iov_count, src_port, dest_port);
+    if(handle_application_to_transport_iov(iov, iov_count, src_port, application_destination_address, dest_port) != 0) {
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "APP Error: Transport layer failed to send message.\n");
+        latency_thread_trace.origin_ns = 0;
         return -1;
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_GREEN "APP: Message successfully passed to transport layer.\n");
+    metrics_inc(METRIC_APP_MESSAGES_SENT);
+    LATENCY_END(LATENCY_TX_TOTAL);
+    LOG_DEBUG(LOG_APP, "Message successfully passed to transport layer.");
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,249 @@
+#include "headers/buffer-pool.h"
+#include "headers/log.h"
+#include "headers/metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define BUFFER_POOL_OVERSIZE BUFFER_POOL_CLASS_COUNT
+#define BUFFER_POOL_CACHE_LINE 64
+
+typedef struct buffer_pool_cache buffer_pool_cache_t;
+
+typedef struct buffer_pool_block {
+    struct buffer_pool_block* next; // Free-list link while the block is free
+    buffer_pool_cache_t* owner; // Cache the block returns to; NULL for oversize blocks
+    size_t size; // Usable bytes
+    uint32_t size_class;
+} __attribute__((aligned(16))) buffer_pool_block_t;
+
+typedef struct {
+    _Atomic uint64_t allocations;
+    _Atomic uint64_t system_allocations;
+} buffer_pool_cache_counters_t;
+
+// Per-thread cache. Only the owning thread touches local lists and counters; other threads only push onto remote.
+struct buffer_pool_cache {
+    buffer_pool_block_t* local[BUFFER_POOL_CLASS_COUNT];
+    uint32_t local_count[BUFFER_POOL_CLASS_COUNT];
+    buffer_pool_cache_counters_t counters[BUFFER_POOL_CLASS_COUNT + 1];
+    _Atomic(buffer_pool_block_t*) remote[BUFFER_POOL_CLASS_COUNT] __attribute__((aligned(BUFFER_POOL_CACHE_LINE)));
+    atomic_bool in_use __attribute__((aligned(BUFFER_POOL_CACHE_LINE))); // Cleared when the thread exits, so another can adopt it
+    buffer_pool_cache_t* next_cache;
+};
+
+static const size_t buffer_pool_class_sizes[BUFFER_POOL_CLASS_COUNT] = { BUFFER_POOL_SMALLEST_CLASS, 2048, 8192, 32768, BUFFER_POOL_LARGEST_CLASS };
+size_t buffer_pool_limit_bytes = (size_t)BUFFER_POOL_DEFAULT_LIMIT_MB * 1024 * 1024;
+static _Atomic(buffer_pool_cache_t*) buffer_pool_caches = NULL;
+static atomic_size_t buffer_pool_reserved_bytes = 0;
+static atomic_size_t buffer_pool_peak_bytes = 0;
+static _Atomic uint64_t buffer_pool_reserved_blocks[BUFFER_POOL_CLASS_COUNT + 1];
+static _Atomic uint64_t buffer_pool_peak_blocks[BUFFER_POOL_CLASS_COUNT + 1];
+static _Atomic uint64_t buffer_pool_limit_failures = 0;
+static pthread_key_t buffer_pool_key;
+static pthread_once_t buffer_pool_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local buffer_pool_cache_t* buffer_pool_thread_cache = NULL;
+
+static void buffer_pool_thread_exit(void* cache) {
+    atomic_store_explicit(&((buffer_pool_cache_t*)cache)->in_use, false, memory_order_release);
+}
+
+static void buffer_pool_make_key() {
+    pthread_key_create(&buffer_pool_key, buffer_pool_thread_exit);
+}
+
+static void buffer_pool_raise_peak(atomic_size_t* peak, size_t value) {
+    size_t current = atomic_load_explicit(peak, memory_order_relaxed);
+    while (value > current && !atomic_compare_exchange_weak_explicit(peak, &current, value, memory_order_relaxed, memory_order_relaxed)) { }
+}
+
+static void buffer_pool_raise_peak_blocks(_Atomic uint64_t* peak, uint64_t value) {
+    uint64_t current = atomic_load_explicit(peak, memory_order_relaxed);
+    while (value > current && !atomic_compare_exchange_weak_explicit(peak, &current, value, memory_order_relaxed, memory_order_relaxed)) { }
+}
+
+// Counts a block obtained from the system against the limit; only cache misses get here.
+static bool buffer_pool_reserve(uint32_t size_class, size_t bytes) {
+    size_t reserved = atomic_fetch_add_explicit(&buffer_pool_reserved_bytes, bytes, memory_order_relaxed) + bytes;
+    if(reserved > buffer_pool_limit_bytes) {
+        atomic_fetch_sub_explicit(&buffer_pool_reserved_bytes, bytes, memory_order_relaxed);
+        atomic_fetch_add_explicit(&buffer_pool_limit_failures, 1, memory_order_relaxed);
+        return false;
+    }
+    buffer_pool_raise_peak(&buffer_pool_peak_bytes, reserved);
+    uint64_t blocks = atomic_fetch_add_explicit(&buffer_pool_reserved_blocks[size_class], 1, memory_order_relaxed) + 1;
+    buffer_pool_raise_peak_blocks(&buffer_pool_peak_blocks[size_class], blocks);
+    return true;
+}
+
+static void buffer_pool_release_block(buffer_pool_block_t* block) {
+    atomic_fetch_sub_explicit(&buffer_pool_reserved_bytes, sizeof(buffer_pool_block_t) + block->size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&buffer_pool_reserved_blocks[block->size_class], 1, memory_order_relaxed);
+    free(block);
+}
+
+static uint32_t buffer_pool_cache_limit(uint32_t size_class) {
+    size_t limit = BUFFER_POOL_CACHE_BYTES / buffer_pool_class_sizes[size_class];
+    return limit < 4 ? 4 : (uint32_t)limit;
+}
+
+static buffer_pool_cache_t* buffer_pool_get_cache() {
+    if(buffer_pool_thread_cache != NULL) return buffer_pool_thread_cache;
+    pthread_once(&buffer_pool_key_once, buffer_pool_make_key);
+    buffer_pool_cache_t* cache = NULL;
+    // Adopt the cache of a thread that has exited, so blocks still returning to it get reused.
+    for(buffer_pool_cache_t* candidate = atomic_load_explicit(&buffer_pool_caches, memory_order_acquire); candidate != NULL; candidate = candidate->next_cache) {
+        bool expected = false;
+        if(atomic_compare_exchange_strong_explicit(&candidate->in_use, &expected, true, memory_order_acquire, memory_order_relaxed)) {
+            cache = candidate;
+            break;
+        }
+    }
+    if(cache == NULL) {
+        if(posix_memalign((void**)&cache, BUFFER_POOL_CACHE_LINE, sizeof(buffer_pool_cache_t)) != 0) return NULL;
+        memset(cache, 0, sizeof(buffer_pool_cache_t));
+        atomic_store_explicit(&cache->in_use, true, memory_order_relaxed);
+        buffer_pool_cache_t* head = atomic_load_explicit(&buffer_pool_caches, memory_order_relaxed);
+        do {
+            cache->next_cache = head;
+        } while (!atomic_compare_exchange_weak_explicit(&buffer_pool_caches, &head, cache, memory_order_release, memory_order_relaxed));
+    }
+    pthread_setspecific(buffer_pool_key, cache);
+    buffer_pool_thread_cache = cache;
+    return cache;
+}
+
+static void buffer_pool_count(_Atomic uint64_t* counter) {
+    // Single writer: a plain load and store, no locked instruction.
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// Moves every block other threads have returned into the local list, trimming it to the cache limit.
+static void buffer_pool_drain_remote(buffer_pool_cache_t* cache, uint32_t size_class) {
+    buffer_pool_block_t* block = atomic_exchange_explicit(&cache->remote[size_class], NULL, memory_order_acquire);
+    uint32_t limit = buffer_pool_cache_limit(size_class);
+    while (block != NULL) {
+        buffer_pool_block_t* next = block->next;
+        if(cache->local_count[size_class] < limit) {
+            block->next = cache->local[size_class];
+            cache->local[size_class] = block;
+            cache->local_count[size_class]++;
+        }
+        else buffer_pool_release_block(block);
+        block = next;
+    }
+}
+
+void* buffer_pool_alloc(size_t size) {
+    uint32_t size_class = 0;
+    while (size_class < BUFFER_POOL_CLASS_COUNT && size > buffer_pool_class_sizes[size_class]) size_class++;
+    buffer_pool_cache_t* cache = buffer_pool_get_cache();
+    buffer_pool_block_t* block = NULL;
+    if(size_class < BUFFER_POOL_CLASS_COUNT && cache != NULL) {
+        if(cache->local[size_class] == NULL && atomic_load_explicit(&cache->remote[size_class], memory_order_relaxed) != NULL) buffer_pool_drain_remote(cache, size_class);
+        block = cache->local[size_class];
+        if(block != NULL) {
+            cache->local[size_class] = block->next;
+            cache->local_count[size_class]--;
+        }
+    }
+    if(block == NULL) {
+        size_t block_size = size_class < BUFFER_POOL_CLASS_COUNT ? buffer_pool_class_sizes[size_class] : size;
+        if(!buffer_pool_reserve(size_class, sizeof(buffer_pool_block_t) + block_size)) {
+            metrics_inc(METRIC_ALLOC_FAILURES);
+            return NULL;
+        }
+        block = (buffer_pool_block_t*)malloc(sizeof(buffer_pool_block_t) + block_size);
+        if(block == NULL) {
+            metrics_inc(METRIC_ALLOC_FAILURES);
+            atomic_fetch_sub_explicit(&buffer_pool_reserved_bytes, sizeof(buffer_pool_block_t) + block_size, memory_order_relaxed);
+            atomic_fetch_sub_explicit(&buffer_pool_reserved_blocks[size_class], 1, memory_order_relaxed);
+            return NULL;
+        }
+        block->size = block_size;
+        block->size_class = size_class;
+        block->owner = size_class < BUFFER_POOL_CLASS_COUNT ? cache : NULL;
+        if(cache != NULL) buffer_pool_count(&cache->counters[size_class].system_allocations);
+    }
+    if(cache != NULL) buffer_pool_count(&cache->counters[size_class].allocations);
+    block->next = NULL;
+    return block + 1;
+}
+
+void* buffer_pool_calloc(size_t size) {
+    void* ptr = buffer_pool_alloc(size);
+    if(ptr != NULL) memset(ptr, 0, size);
+    return ptr;
+}
+
+void* buffer_pool_realloc(void* ptr, size_t size) {
+    if(ptr == NULL) return buffer_pool_alloc(size);
+    buffer_pool_block_t* block = (buffer_pool_block_t*)ptr - 1;
+    if(size <= block->size) return ptr;
+    void* grown = buffer_pool_alloc(size);
+    if(grown == NULL) return NULL;
+    memcpy(grown, ptr, block->size);
+    buffer_pool_free(ptr);
+    return grown;
+}
+
+void buffer_pool_free(void* ptr) {
+    if(ptr == NULL) return;
+    buffer_pool_block_t* block = (buffer_pool_block_t*)ptr - 1;
+    buffer_pool_cache_t* owner = block->owner;
+    uint32_t size_class = block->size_class;
+    if(owner == NULL) {
+        buffer_pool_release_block(block);
+        return;
+    }
+    if(owner == buffer_pool_thread_cache) {
+        if(owner->local_count[size_class] >= buffer_pool_cache_limit(size_class)) {
+            buffer_pool_release_block(block);
+            return;
+        }
+        block->next = owner->local[size_class];
+        owner->local[size_class] = block;
+        owner->local_count[size_class]++;
+        return;
+    }
+    // Freed on another thread: push it back to its owner without a lock. The owner only ever takes the
+    // whole list at once, so the push cannot suffer from ABA.
+    buffer_pool_block_t* head = atomic_load_explicit(&owner->remote[size_class], memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote[size_class], &head, block, memory_order_release, memory_order_relaxed));
+}
+
+void buffer_pool_get_stats(buffer_pool_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    for(uint32_t i = 0; i <= BUFFER_POOL_CLASS_COUNT; i++) {
+        stats->classes[i].block_size = i < BUFFER_POOL_CLASS_COUNT ? buffer_pool_class_sizes[i] : 0;
+        stats->classes[i].reserved_blocks = atomic_load_explicit(&buffer_pool_reserved_blocks[i], memory_order_relaxed);
+        stats->classes[i].peak_reserved_blocks = atomic_load_explicit(&buffer_pool_peak_blocks[i], memory_order_relaxed);
+    }
+    for(buffer_pool_cache_t* cache = atomic_load_explicit(&buffer_pool_caches, memory_order_acquire); cache != NULL; cache = cache->next_cache) {
+        stats->thread_caches++;
+        for(uint32_t i = 0; i <= BUFFER_POOL_CLASS_COUNT; i++) {
+            stats->classes[i].allocations += atomic_load_explicit(&cache->counters[i].allocations, memory_order_relaxed);
+            stats->classes[i].system_allocations += atomic_load_explicit(&cache->counters[i].system_allocations, memory_order_relaxed);
+        }
+    }
+    stats->reserved_bytes = atomic_load_explicit(&buffer_pool_reserved_bytes, memory_order_relaxed);
+    stats->peak_reserved_bytes = atomic_load_explicit(&buffer_pool_peak_bytes, memory_order_relaxed);
+    stats->limit_bytes = buffer_pool_limit_bytes;
+    stats->limit_failures = atomic_load_explicit(&buffer_pool_limit_failures, memory_order_relaxed);
+}
+
+void buffer_pool_print_stats() {
+    buffer_pool_stats_t stats;
+    buffer_pool_get_stats(&stats);
+    LOG_INFO(LOG_POOL, "%zu thread caches, %zu bytes reserved (peak %zu, limit %zu), %llu allocations refused by the limit.", stats.thread_caches, stats.reserved_bytes, stats.peak_reserved_bytes, stats.limit_bytes, (unsigned long long)stats.limit_failures);
+    for(uint32_t i = 0; i <= BUFFER_POOL_CLASS_COUNT; i++) {
+        const buffer_pool_class_stats_t* class_stats = &stats.classes[i];
+        if(class_stats->allocations == 0 && class_stats->peak_reserved_blocks == 0) continue;
+        if(i < BUFFER_POOL_CLASS_COUNT) LOG_INFO(LOG_POOL, "  %6zu B blocks: %llu allocations, %llu from the system, %llu reserved (peak %llu).", class_stats->block_size, (unsigned long long)class_stats->allocations, (unsigned long long)class_stats->system_allocations, (unsigned long long)class_stats->reserved_blocks, (unsigned long long)class_stats->peak_reserved_blocks);
+        else LOG_INFO(LOG_POOL, "  oversize: %llu allocations, %llu reserved (peak %llu).", (unsigned long long)class_stats->allocations, (unsigned long long)class_stats->reserved_blocks, (unsigned long long)class_stats->peak_reserved_blocks);
+    }
+}
@@ -0,0 +1,147 @@
+#include "headers/checksum.h"
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+// 64-byte blocks per SSE2 reduction: each 32-bit lane gains at most 2 * 0xFFFF per block.
+#define CHECKSUM_SSE2_FLUSH_BLOCKS 32768
+#endif
+
+// 32-bit words into a 64-bit accumulator; end-around carries are deferred to internet_checksum_fold().
+static uint64_t checksum_add_scalar(uint64_t sum, const unsigned char* data, size_t length) {
+    while(length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        sum += (word & 0xFFFFFFFFu) + (word >> 32);
+        data += 8;
+        length -= 8;
+    }
+    if(length >= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        sum += word;
+        data += 4;
+        length -= 4;
+    }
+    if(length >= 2) {
+        uint16_t word;
+        memcpy(&word, data, 2);
+        sum += word;
+        data += 2;
+        length -= 2;
+    }
+    if(length == 1) {
+        uint16_t word = 0;
+        memcpy(&word, data, 1);
+        sum += word;
+    }
+    return sum;
+}
+
+#if defined(__x86_64__)
+static uint64_t checksum_reduce_sse2(__m128i acc) {
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    return (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+#define CHECKSUM_SSE2_ACCUMULATE(acc, block) \
+    acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_and_si128(block, low_mask), _mm_srli_epi32(block, 16)))
+
+// SSE2 is baseline on x86-64: every 32-bit lane adds up its two 16-bit words, with four independent accumulators
+// so the adds of consecutive vectors do not wait on each other.
+static uint64_t checksum_add_sse2(uint64_t sum, const unsigned char* data, size_t length, unsigned char* copy) {
+    const __m128i low_mask = _mm_set1_epi32(0xFFFF);
+    while(length >= 64) {
+        size_t blocks = length / 64;
+        if(blocks > CHECKSUM_SSE2_FLUSH_BLOCKS) blocks = CHECKSUM_SSE2_FLUSH_BLOCKS;
+        __m128i acc_a = _mm_setzero_si128();
+        __m128i acc_b = _mm_setzero_si128();
+        __m128i acc_c = _mm_setzero_si128();
+        __m128i acc_d = _mm_setzero_si128();
+        for(size_t i = 0; i < blocks; i++) {
+            __m128i a = _mm_loadu_si128((const __m128i*)data);
+            __m128i b = _mm_loadu_si128((const __m128i*)(data + 16));
+            __m128i c = _mm_loadu_si128((const __m128i*)(data + 32));
+            __m128i d = _mm_loadu_si128((const __m128i*)(data + 48));
+            if(copy != NULL) {
+                _mm_storeu_si128((__m128i*)copy, a);
+                _mm_storeu_si128((__m128i*)(copy + 16), b);
+                _mm_storeu_si128((__m128i*)(copy + 32), c);
+                _mm_storeu_si128((__m128i*)(copy + 48), d);
+                copy += 64;
+            }
+            CHECKSUM_SSE2_ACCUMULATE(acc_a, a);
+            CHECKSUM_SSE2_ACCUMULATE(acc_b, b);
+            CHECKSUM_SSE2_ACCUMULATE(acc_c, c);
+            CHECKSUM_SSE2_ACCUMULATE(acc_d, d);
+            data += 64;
+        }
+        length -= blocks * 64;
+        sum += checksum_reduce_sse2(acc_a) + checksum_reduce_sse2(acc_b) + checksum_reduce_sse2(acc_c) + checksum_reduce_sse2(acc_d);
+    }
+    if(copy != NULL) memcpy(copy, data, length);
+    return checksum_add_scalar(sum, data, length);
+}
+#endif
+
+uint64_t internet_checksum_add(uint64_t sum, const void* data, size_t length) {
+#if defined(__x86_64__)
+    return checksum_add_sse2(sum, (const unsigned char*)data, length, NULL);
+#else
+    return checksum_add_scalar(sum, (const unsigned char*)data, length);
+#endif
+}
+
+uint64_t internet_checksum_copy(uint64_t sum, void* dst, const void* src, size_t length) {
+#if defined(__x86_64__)
+    return checksum_add_sse2(sum, (const unsigned char*)src, length, (unsigned char*)dst);
+#else
+    // The copy and the sum run over the same cache-resident chunk before moving on.
+    const unsigned char* in = (const unsigned char*)src;
+    unsigned char* out = (unsigned char*)dst;
+    while(length > 0) {
+        size_t chunk = length > 256 ? 256 : length;
+        memcpy(out, in, chunk);
+        sum = checksum_add_scalar(sum, in, chunk);
+        in += chunk;
+        out += chunk;
+        length -= chunk;
+    }
+    return sum;
+#endif
+}
+
+// Bytes at an odd offset land in the other half of their 16-bit words, and one's-complement sums commute
+// with byte swapping (RFC 1071), so the part is summed as if aligned and its folded sum swapped.
+uint64_t internet_checksum_add_at(uint64_t sum, const void* data, size_t length, size_t offset) {
+    if(offset % 2 == 0) return internet_checksum_add(sum, data, length);
+    uint16_t part = (uint16_t)~internet_checksum_fold(internet_checksum_add(0, data, length));
+    return sum + (uint16_t)((part << 8) | (part >> 8));
+}
+
+uint64_t internet_checksum_add16(uint64_t sum, uint16_t word) {
+    return sum + word;
+}
+
+uint16_t internet_checksum_fold(uint64_t sum) {
+    sum = (sum & 0xFFFFFFFFu) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFFu) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+uint16_t calculate_internet_checksum(const void* buffer, size_t length) {
+    return internet_checksum_fold(internet_checksum_add(0, buffer, length));
+}
+
+uint16_t internet_checksum_update16(uint16_t checksum, uint16_t old_word, uint16_t new_word) {
+    // HC' = ~(~HC + ~m + m')
+    uint32_t sum = (uint16_t)~checksum;
+    sum += (uint16_t)~old_word;
+    sum += new_word;
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
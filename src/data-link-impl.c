@@ -1,109 +1,211 @@
 #include "headers/data-link-impl.h"
+#include "headers/data-link-kernels.h"
 #include "headers/network-impl.h"
 #include "headers/physical-impl.h"
+#include "headers/packet-buffer.h"
 #include "headers/thread-pool.h"
+#include "headers/rx-dispatch.h"
+#include "headers/buffer-pool.h"
+#include "headers/log.h"
+#include "headers/metrics.h"
+#include "headers/latency.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 
-extern bool DEBUG_ENABLED;
+_Static_assert(sizeof(packet_buffer_t) + DATA_LINK_FRAME_CONTENT_SIZE(DATA_LINK_MAX_MTU) <= BUFFER_POOL_LARGEST_CLASS, "A received frame at the largest MTU must fit the largest pool class");
+
 extern threadpool thpool;
+data_link_fcs_mode_t data_link_fcs_mode = DATA_LINK_FCS_SUM8;
+uint32_t data_link_mtu = DATA_LINK_DEFAULT_MTU;
+
+// Hands a destuffed frame (protocol + info, checksum already stripped) to the network layer, which takes ownership.
+static void data_link_deliver_to_network(packet_buffer_t* network_packet) {
+    LATENCY_MARK(LATENCY_RX_DATALINK);
+    if(thpool != NULL) {
+        if(rx_dispatch_next(handle_data_link_to_network, network_packet) != 0) {
+            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Failed to add task to thread pool for Network Layer.\n");
+            packet_buffer_release(network_packet);
+        }
+        else LOG_DEBUG(LOG_DATALINK, "Valid frame (Payload size: %zu) passed to thread pool for NETWORK processing.", network_packet->length);
+    }
+    else {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Thread pool is NULL when trying to add NETWORK work.\n");
+        packet_buffer_release(network_packet);
+    }
+}
 
+// Parses the frame in place from its ring slot. Each frame is destuffed straight into the storage of a
+// packet buffer sized from the slot's frame length, and the slot is released once that is done.
+// The layers above only pull their headers off that buffer, so the payload is not copied again.
 void handle_physical_to_data_link(void* data) {
     if(data == NULL) {
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Received NULL data pointer from physical layer.\n");
         return;
     }
-    unsigned char* raw_data = (unsigned char*)data;
-    size_t data_length = SHARED_MEM_SIZE;
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Processing %zu bytes received from Physical Layer...\n", data_length);
-    bool is_in_frame = false;
-    unsigned char frame_buffer[MAX_FRAME_CONTENT_SIZE];
-    size_t buffer_index = 0;
-    bool next_byte_is_escaped = false;
-    for(size_t i = 0; i < data_length; i++) {
-        unsigned char current_byte = raw_data[i];
-        if(next_byte_is_escaped) {
-            unsigned char unescaped_byte;
-            if(current_byte == (ESC_BYTE ^ XOR_BYTE)) unescaped_byte = ESC_BYTE;
-            else if(current_byte == (FLAG_BYTE ^ XOR_BYTE)) unescaped_byte = FLAG_BYTE;
-            else {
-                if(DEBUG_ENABLED) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Invalid byte 0x%02X after ESC. Discarding frame.\n", current_byte);
-                is_in_frame = false;
-                next_byte_is_escaped = false;
-                continue;
-            }
-            if(buffer_index < MAX_FRAME_CONTENT_SIZE) frame_buffer[buffer_index++] = unescaped_byte;
-            else {
-                if(DEBUG_ENABLED) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Frame buffer overflow during destuffing. Discarding frame.\n");
-                is_in_frame = false;
-            }
-            next_byte_is_escaped = false;
-        }
-        else if(current_byte == FLAG_BYTE) {
-            if(is_in_frame) {
-                if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: End flag found. Buffer index: %zu.\n", buffer_index);
-                if(buffer_index >= (PROTOCOL_SIZE + CHECKSUM_SIZE)) {
-                    uint8_t received_checksum = frame_buffer[buffer_index - 1];
-                    uint16_t checksum_calc = 0;
-                    for(size_t j = 0; j < buffer_index - CHECKSUM_SIZE; j++) checksum_calc += frame_buffer[j];
-                    uint8_t calculated_checksum = (uint8_t)(checksum_calc & 0xFF);
-                    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Received Checksum: 0x%02X, Calculated Checksum: 0x%02X\n", received_checksum, calculated_checksum);
-                    if(calculated_checksum == received_checksum) {
-                        size_t network_payload_size = buffer_index - CHECKSUM_SIZE;
-                        unsigned char* network_payload = (unsigned char*)malloc(network_payload_size);
-                        if(network_payload != NULL) {
-                            memcpy(network_payload, frame_buffer, network_payload_size);
-                            if(thpool != NULL) {
-                                if(thpool_add_work(thpool, (void (*)(void*))handle_data_link_to_network, network_payload) != 0) {
-                                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Failed to add task to thread pool for Network Layer.\n");
-                                    free(network_payload);
-                                }
-                                else if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Valid frame (Payload size: %zu) passed to thread pool for NETWORK processing.\n", network_payload_size);
-                            }
-                            else {
-                                fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Thread pool is NULL when trying to add NETWORK work.\n");
-                                free(network_payload);
-                            }
-                        }
-                        else fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Failed to allocate memory for network payload.\n");
-                    }
-                    else if(DEBUG_ENABLED) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Checksum mismatch. Discarding frame.\n");
-                }
-                else if(DEBUG_ENABLED) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Frame content too short (%zu bytes). Discarding frame.\n", buffer_index);
-                is_in_frame = false;
-                buffer_index = 0;
-                next_byte_is_escaped = false;
-            }
-            else {
-                if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Start flag found at index %zu.\n", i);
-                is_in_frame = true;
-                buffer_index = 0;
-                next_byte_is_escaped = false;
-            }
+    LATENCY_MARK(LATENCY_RX_QUEUE_DATALINK);
+    physical_rx_frame_t* rx_frame = (physical_rx_frame_t*)data;
+    const unsigned char* raw_data = rx_frame->data;
+    size_t data_length = rx_frame->length;
+    LOG_DEBUG(LOG_DATALINK, "Processing %zu bytes received from Physical Layer...", data_length);
+    packet_buffer_t* frame = NULL;
+    size_t frame_capacity = 0;
+    size_t i = 0;
+    while (i < data_length) {
+        // Outside a frame only a start flag matters; everything up to it is skipped in bulk.
+        i += data_link_find_special(raw_data + i, data_length - i);
+        if(i >= data_length) break;
+        if(raw_data[i] == ESC_BYTE) {
+            LOG_TRACE(LOG_DATALINK, "Ignoring ESC byte outside frame at index %zu.", i);
+            i++;
+            continue;
         }
-        else if(current_byte == ESC_BYTE) {
-            if(is_in_frame) {
-                if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Escape byte found at index %zu.\n", i);
-                next_byte_is_escaped = true;
-            }
-            else if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Ignoring ESC byte outside frame at index %zu.\n", i);
+        LOG_TRACE(LOG_DATALINK, "Start flag found at index %zu.", i);
+        i++;
+        // Destuffed content never exceeds the stuffed bytes that follow the start flag.
+        size_t needed_capacity = data_length - i;
+        if(needed_capacity > DATA_LINK_FRAME_CONTENT_SIZE(data_link_mtu)) needed_capacity = DATA_LINK_FRAME_CONTENT_SIZE(data_link_mtu);
+        if(frame_capacity < needed_capacity) {
+            packet_buffer_release(frame);
+            frame = packet_buffer_alloc(0, needed_capacity > 0 ? needed_capacity : 1);
+            frame_capacity = frame != NULL ? needed_capacity : 0;
         }
-        else {
-            if(is_in_frame) {
-                if(buffer_index < MAX_FRAME_CONTENT_SIZE) frame_buffer[buffer_index++] = current_byte;
-                else {
-                    if(DEBUG_ENABLED) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Frame buffer overflow while receiving data. Discarding frame.\n");
-                    is_in_frame = false;
-                }
+        if(frame == NULL) {
+            LOG_WARN(LOG_DATALINK, "Failed to allocate memory for network payload.");
+            break;
+        }
+        size_t consumed = 0;
+        size_t buffer_index = 0;
+        data_link_fcs_t fcs;
+        data_link_fcs_begin(&fcs, data_link_fcs_mode);
+        data_link_destuff_result_t destuff_result = data_link_destuff(raw_data + i, data_length - i, frame->data, frame_capacity, &consumed, &buffer_index, &fcs);
+        i += consumed;
+        if(destuff_result == DATA_LINK_DESTUFF_BAD_ESCAPE) {
+            metrics_inc(METRIC_DL_FRAMING_ERRORS);
+            LOG_WARN(LOG_DATALINK, "Invalid byte 0x%02X after ESC. Discarding frame.", raw_data[i - 1]);
+            continue;
+        }
+        if(destuff_result == DATA_LINK_DESTUFF_OVERFLOW) {
+            metrics_inc(METRIC_DL_FRAMING_ERRORS);
+            LOG_WARN(LOG_DATALINK, "Frame buffer overflow during destuffing. Discarding frame.");
+            continue;
+        }
+        if(destuff_result == DATA_LINK_DESTUFF_INCOMPLETE) {
+            LOG_DEBUG(LOG_DATALINK, "Processing finished, but frame was incomplete (no end flag found).");
+            break;
+        }
+        LOG_TRACE(LOG_DATALINK, "End flag found. Buffer index: %zu.", buffer_index);
+        size_t fcs_size = data_link_fcs_size(data_link_fcs_mode);
+        if(buffer_index < (PROTOCOL_SIZE + fcs_size)) {
+            metrics_inc(METRIC_DL_FRAMING_ERRORS);
+            LOG_WARN(LOG_DATALINK, "Frame content too short (%zu bytes). Discarding frame.", buffer_index);
+            continue;
+        }
+        // The destuffing pass already folded everything but the trailing FCS into fcs.
+        unsigned char calculated_fcs[MAX_CHECKSUM_SIZE];
+        data_link_fcs_finish(&fcs, calculated_fcs);
+        const unsigned char* received_fcs = frame->data + buffer_index - fcs_size;
+        if(LOG_ENABLED(LOG_LEVEL_DEBUG, LOG_DATALINK)) {
+            uint32_t received_value = 0, calculated_value = 0;
+            for(size_t j = 0; j < fcs_size; j++) {
+                received_value |= (uint32_t)received_fcs[j] << (8 * j);
+                calculated_value |= (uint32_t)calculated_fcs[j] << (8 * j);
             }
+            LOG_DEBUG(LOG_DATALINK, "Received FCS (%s): 0x%0*X, Calculated FCS: 0x%0*X", data_link_fcs_name(data_link_fcs_mode), (int)fcs_size * 2, received_value, (int)fcs_size * 2, calculated_value);
+        }
+        if(memcmp(received_fcs, calculated_fcs, fcs_size) != 0) {
+            metrics_inc(METRIC_DL_FCS_FAILURES);
+            LOG_WARN(LOG_DATALINK, "Checksum mismatch. Discarding frame.");
+            continue;
+        }
+        metrics_inc(METRIC_DL_FRAMES_RECEIVED);
+        metrics_add(METRIC_DL_BYTES_RECEIVED, buffer_index - fcs_size);
+        packet_buffer_put(frame, buffer_index - fcs_size);
+        ((data_link_receive_control_t*)frame->control)->flow_hash = rx_frame->flow_hash;
+        data_link_deliver_to_network(frame);
+        frame = NULL;
+        frame_capacity = 0;
+    }
+    packet_buffer_release(frame);
+    physical_layer_release_frame(rx_frame);
+    LOG_DEBUG(LOG_DATALINK, "Finished processing physical layer data block.");
+}
+
+typedef struct {
+    uint16_t protocol;
+    const packet_buffer_t* packet;
+    const unsigned char* header; // Goes in front of the packet's bytes; NULL for none
+    size_t header_size;
+    size_t offset;               // The packet's bytes this frame carries
+    size_t length;
+} data_link_tx_frame_t;
+
+// Stuffs bytes [offset, offset + length) of the packet, its linear bytes first and then its fragments.
+static long data_link_stuff_range(const packet_buffer_t* packet, size_t offset, size_t length, unsigned char* out, size_t capacity, data_link_fcs_t* fcs) {
+    const unsigned char* data = packet->data;
+    size_t available = packet->length;
+    size_t written = 0;
+    for(size_t i = 0; length > 0; i++) {
+        if(i > 0) {
+            if(i > packet->frag_count) return -1;
+            data = packet->frags[i - 1].data;
+            available = packet->frags[i - 1].length;
+        }
+        if(offset >= available) {
+            offset -= available;
+            continue;
         }
+        size_t take = available - offset < length ? available - offset : length;
+        long stuffed = data_link_stuff(data + offset, take, out + written, capacity - written, fcs);
+        if(stuffed < 0) return -1;
+        written += (size_t)stuffed;
+        length -= take;
+        offset = 0;
     }
-    if(is_in_frame && DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Processing finished, but frame was incomplete (no end flag found).\n");
-    free(raw_data);
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Finished processing physical layer data block.\n");
+    return (long)written;
+}
+
+// Frames one packet straight into a ring slot: start flag, then the protocol field, the header and the packet's
+// bytes stuffed with the FCS accumulated in the same pass, then the stuffed FCS and the end flag.
+// Returns the frame length, or -1 if it does not fit in capacity.
+static long data_link_write_frame(void* context, unsigned char* out, size_t capacity) {
+    const data_link_tx_frame_t* tx_frame = (const data_link_tx_frame_t*)context;
+    const packet_buffer_t* packet = tx_frame->packet;
+    if(capacity < 2) return -1;
+    size_t fcs_size = data_link_fcs_size(data_link_fcs_mode);
+    unsigned char protocol_field[PROTOCOL_SIZE];
+    protocol_field[0] = (tx_frame->protocol >> 8) & 0xFF; // Big Endian
+    protocol_field[1] = tx_frame->protocol & 0xFF; // Big Endian
+    data_link_fcs_t fcs;
+    data_link_fcs_begin(&fcs, data_link_fcs_mode);
+    size_t stuffed_index = 0;
+    out[stuffed_index++] = FLAG_BYTE;
+    long stuffed_part = data_link_stuff(protocol_field, PROTOCOL_SIZE, out + stuffed_index, capacity - 1 - stuffed_index, &fcs);
+    if(stuffed_part >= 0 && tx_frame->header != NULL) {
+        stuffed_index += (size_t)stuffed_part;
+        stuffed_part = data_link_stuff(tx_frame->header, tx_frame->header_size, out + stuffed_index, capacity - 1 - stuffed_index, &fcs);
+    }
+    if(stuffed_part >= 0) {
+        stuffed_index += (size_t)stuffed_part;
+        stuffed_part = data_link_stuff_range(packet, tx_frame->offset, tx_frame->length, out + stuffed_index, capacity - 1 - stuffed_index, &fcs);
+    }
+    unsigned char fcs_field[MAX_CHECKSUM_SIZE];
+    data_link_fcs_finish(&fcs, fcs_field);
+    if(stuffed_part >= 0) {
+        stuffed_index += (size_t)stuffed_part;
+        stuffed_part = data_link_stuff(fcs_field, fcs_size, out + stuffed_index, capacity - 1 - stuffed_index, NULL);
+    }
+    if(stuffed_part < 0) {
+        LOG_WARN(LOG_DATALINK, "Stuffed frame does not fit in %zu bytes.", capacity);
+        return -1;
+    }
+    stuffed_index += (size_t)stuffed_part;
+    out[stuffed_index++] = FLAG_BYTE;
+    LOG_DEBUG(LOG_DATALINK, "Frame content (len %zu, %s FCS) stuffed into final frame (len %zu).", PROTOCOL_SIZE + tx_frame->header_size + tx_frame->length + fcs_size, data_link_fcs_name(data_link_fcs_mode), stuffed_index);
+    LOG_HEX(LOG_LEVEL_TRACE, LOG_DATALINK, "Stuffed Frame Hex", out, stuffed_index);
+    return (long)stuffed_index;
 }
 
 int handle_data_link_to_physical(uint16_t protocol, const unsigned char* payload, size_t payload_length) {
@@ -111,57 +213,99 @@ int handle_data_link_to_physical(uint16_t protocol, const unsigned char* payload
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Send request with NULL payload but positive length (%zu).\n", payload_length);
         return -1;
     }
-    if(payload_length > MAX_INFO_SIZE) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Payload length (%zu) exceeds maximum info size (%d).\n", payload_length, MAX_INFO_SIZE);
+    packet_buffer_t* packet = packet_buffer_alloc(0, 0);
+    if(packet == NULL) {
+        LOG_WARN(LOG_DATALINK, "Failed to allocate packet buffer.");
         return -1;
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Preparing to send payload of size %zu with protocol 0x%04X.\n", payload_length, protocol);
-    size_t content_length = PROTOCOL_SIZE + payload_length + CHECKSUM_SIZE;
-    unsigned char frame_content[MAX_FRAME_CONTENT_SIZE];
-    frame_content[0] = (protocol >> 8) & 0xFF; // Big Endian
-    frame_content[1] = protocol & 0xFF; // Big Endian
-    if(payload_length > 0) memcpy(&frame_content[PROTOCOL_SIZE], payload, payload_length);
-    uint16_t checksum_calc = 0;
-    for (size_t i = 0; i < PROTOCOL_SIZE + payload_length; ++i) checksum_calc += frame_content[i];
-    uint8_t checksum = (uint8_t)(checksum_calc & 0xFF);
-    frame_content[content_length - 1] = checksum;
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Calculated Checksum: 0x%02X for content length %zu.\n", checksum, content_length);
-    unsigned char stuffed_frame[MAX_STUFFED_FRAME_SIZE];
-    size_t stuffed_index = 0;
-    stuffed_frame[stuffed_index++] = FLAG_BYTE;
-    for (size_t i = 0; i < content_length; ++i) {
-        unsigned char byte = frame_content[i];
-        if(byte == FLAG_BYTE || byte == ESC_BYTE) {
-            if(stuffed_index + 1 >= MAX_STUFFED_FRAME_SIZE) {
-                fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Stuffed frame buffer overflow during stuffing.\n");
-                return -1;
+    packet_buffer_attach(packet, payload, payload_length, NULL);
+    int result = handle_data_link_to_physical_batch(protocol, &packet, 1, 0, NULL);
+    packet_buffer_release(packet);
+    return result;
+}
+
+// Frames are stuffed directly into the destination ring slots, so a packet's bytes are copied exactly once on the way out.
+int handle_data_link_to_physical_batch(uint16_t protocol, packet_buffer_t* const* packets, size_t packet_count, uint32_t flow_hash, const char* destination) {
+    if(packet_count == 0) return 0;
+    if(packets == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Batch send request with NULL packet array.\n");
+        return -1;
+    }
+    LATENCY_MARK(LATENCY_TX_NETWORK);
+    data_link_tx_frame_t tx_frames[PHYSICAL_MAX_BATCH];
+    physical_frame_t frames[PHYSICAL_MAX_BATCH];
+    int result = 0;
+    for(size_t first = 0; first < packet_count && result == 0; first += PHYSICAL_MAX_BATCH) {
+        size_t chunk_count = packet_count - first < PHYSICAL_MAX_BATCH ? packet_count - first : PHYSICAL_MAX_BATCH;
+        size_t chunk_bytes = 0;
+        for(size_t i = 0; i < chunk_count; i++) {
+            const packet_buffer_t* packet = packets[first + i];
+            size_t payload_length = packet_buffer_length(packet);
+            if(payload_length > data_link_mtu) {
+                fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Payload length (%zu) exceeds the MTU (%u).\n", payload_length, data_link_mtu);
+                result = -1;
+                break;
             }
-            stuffed_frame[stuffed_index++] = ESC_BYTE;
-            stuffed_frame[stuffed_index++] = byte ^ XOR_BYTE;
+            LOG_DEBUG(LOG_DATALINK, "Preparing to send payload of size %zu with protocol 0x%04X.", payload_length, protocol);
+            chunk_bytes += PROTOCOL_SIZE + payload_length;
+            tx_frames[i] = (data_link_tx_frame_t){ .protocol = protocol, .packet = packet, .header = NULL, .header_size = 0, .offset = 0, .length = payload_length };
+            frames[i] = (physical_frame_t){ .data = NULL, .length = 0, .flow_hash = flow_hash, .write = data_link_write_frame, .context = &tx_frames[i] };
         }
-        else {
-            if(stuffed_index >= MAX_STUFFED_FRAME_SIZE) {
-                fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Stuffed frame buffer overflow.\n");
-                return -1;
+        if(result == 0) {
+            int sent = physical_layer_send_batch(destination, frames, chunk_count);
+            if(sent == PHYSICAL_SEND_DROPPED) result = PHYSICAL_SEND_DROPPED;
+            else if(sent != 0) {
+                LOG_WARN(LOG_DATALINK, "Physical layer batch send failed.");
+                result = -1;
             }
-            stuffed_frame[stuffed_index++] = byte;
+        }
+        if(result == 0) {
+            metrics_add(METRIC_DL_FRAMES_SENT, chunk_count);
+            metrics_add(METRIC_DL_BYTES_SENT, chunk_bytes);
         }
     }
-    if(stuffed_index >= MAX_STUFFED_FRAME_SIZE) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Stuffed frame buffer overflow before adding end flag.\n");
+    if(result == 0) LOG_DEBUG(LOG_DATALINK, "Batch of %zu frames successfully sent to physical layer.", packet_count);
+    return result;
+}
+
+// One datagram goes down whole and is cut into frames only here, as each batch of slots is written: the header
+// template is copied and fixed up per segment, and the payload is stuffed straight from the datagram's buffer.
+int handle_data_link_to_physical_gso(uint16_t protocol, const data_link_gso_t* gso, uint32_t flow_hash, const char* destination) {
+    if(gso == NULL || gso->payload == NULL || gso->fix_header == NULL || gso->header_size > DATA_LINK_GSO_MAX_HEADER || gso->segment_size == 0 || gso->header_size + gso->segment_size > data_link_mtu) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Invalid segmentation offload request.\n");
         return -1;
     }
-    stuffed_frame[stuffed_index++] = FLAG_BYTE;
-    if(DEBUG_ENABLED) {
-        printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Frame content (len %zu) stuffed into final frame (len %zu).\n", content_length, stuffed_index);
-        printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Stuffed Frame Hex: ");
-        for(size_t k=0; k < stuffed_index; ++k) printf("%02X ", stuffed_frame[k]);
-        printf("\n");
-    }
-    if(physical_layer_send(stuffed_frame, stuffed_index) != 0) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "DATALINK Error: Physical layer send failed.\n");
-        return -1;
+    LATENCY_MARK(LATENCY_TX_NETWORK);
+    size_t payload_length = packet_buffer_length(gso->payload);
+    size_t segment_count = payload_length > 0 ? (payload_length + gso->segment_size - 1) / gso->segment_size : 1;
+    unsigned char headers[PHYSICAL_MAX_BATCH][DATA_LINK_GSO_MAX_HEADER] __attribute__((aligned(8)));
+    data_link_tx_frame_t tx_frames[PHYSICAL_MAX_BATCH];
+    physical_frame_t frames[PHYSICAL_MAX_BATCH];
+    size_t offset = 0;
+    int result = 0;
+    for(size_t first = 0; first < segment_count && result == 0; first += PHYSICAL_MAX_BATCH) {
+        size_t chunk_count = segment_count - first < PHYSICAL_MAX_BATCH ? segment_count - first : PHYSICAL_MAX_BATCH;
+        size_t chunk_bytes = 0;
+        for(size_t i = 0; i < chunk_count; i++) {
+            size_t length = payload_length - offset < gso->segment_size ? payload_length - offset : gso->segment_size;
+            memcpy(headers[i], gso->header, gso->header_size);
+            gso->fix_header(headers[i], offset, length, offset + length == payload_length);
+            tx_frames[i] = (data_link_tx_frame_t){ .protocol = protocol, .packet = gso->payload, .header = headers[i], .header_size = gso->header_size, .offset = offset, .length = length };
+            frames[i] = (physical_frame_t){ .data = NULL, .length = 0, .flow_hash = flow_hash, .write = data_link_write_frame, .context = &tx_frames[i] };
+            chunk_bytes += PROTOCOL_SIZE + gso->header_size + length;
+            offset += length;
+        }
+        int sent = physical_layer_send_batch(destination, frames, chunk_count);
+        if(sent == PHYSICAL_SEND_DROPPED) result = PHYSICAL_SEND_DROPPED;
+        else if(sent != 0) {
+            LOG_WARN(LOG_DATALINK, "Physical layer batch send failed.");
+            result = -1;
+        }
+        else {
+            metrics_add(METRIC_DL_FRAMES_SENT, chunk_count);
+            metrics_add(METRIC_DL_BYTES_SENT, chunk_bytes);
+        }
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_BLUE "DATALINK: Frame successfully sent to physical layer.\n");
-    return 0;
-}
\ No newline at end of file
+    if(result == 0) LOG_DEBUG(LOG_DATALINK, "Datagram of %zu bytes sent as %zu frames.", payload_length, segment_count);
+    return result;
+}
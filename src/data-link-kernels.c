@@ -0,0 +1,373 @@
+#include "headers/data-link-kernels.h"
+#include "headers/data-link-impl.h"
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DATA_LINK_KERNELS_X86 1
+#endif
+
+typedef size_t (*find_special_fn)(const unsigned char* data, size_t length);
+
+static size_t find_special_scalar(const unsigned char* data, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+        if(data[i] == FLAG_BYTE || data[i] == ESC_BYTE) return i;
+    }
+    return length;
+}
+
+#ifdef DATA_LINK_KERNELS_X86
+__attribute__((target("sse2")))
+static size_t find_special_sse2(const unsigned char* data, size_t length) {
+    const __m128i flag = _mm_set1_epi8((char)FLAG_BYTE);
+    const __m128i esc = _mm_set1_epi8((char)ESC_BYTE);
+    size_t i = 0;
+    for(; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, flag), _mm_cmpeq_epi8(block, esc)));
+        if(mask != 0) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+    return i + find_special_scalar(data + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static size_t find_special_avx2(const unsigned char* data, size_t length) {
+    const __m256i flag = _mm256_set1_epi8((char)FLAG_BYTE);
+    const __m256i esc = _mm256_set1_epi8((char)ESC_BYTE);
+    size_t i = 0;
+    // Two vectors per iteration keep both load ports busy on the common no-special-byte path.
+    for(; i + 64 <= length; i += 64) {
+        __m256i low = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i high = _mm256_loadu_si256((const __m256i*)(data + i + 32));
+        __m256i low_hits = _mm256_or_si256(_mm256_cmpeq_epi8(low, flag), _mm256_cmpeq_epi8(low, esc));
+        __m256i high_hits = _mm256_or_si256(_mm256_cmpeq_epi8(high, flag), _mm256_cmpeq_epi8(high, esc));
+        if(!_mm256_testz_si256(_mm256_or_si256(low_hits, high_hits), _mm256_or_si256(low_hits, high_hits))) {
+            uint64_t mask = (uint32_t)_mm256_movemask_epi8(low_hits) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(high_hits) << 32);
+            return i + (size_t)__builtin_ctzll(mask);
+        }
+    }
+    for(; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, flag), _mm256_cmpeq_epi8(block, esc)));
+        if(mask != 0) return i + (size_t)__builtin_ctz(mask);
+    }
+    // Finish with VEX-encoded 128-bit compares; calling the legacy-SSE kernel with dirty upper
+    // YMM state would pay an AVX/SSE transition penalty on every frame.
+    if(i + 16 <= length) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, _mm256_castsi256_si128(flag)), _mm_cmpeq_epi8(block, _mm256_castsi256_si128(esc))));
+        if(mask != 0) return i + (size_t)__builtin_ctz((unsigned)mask);
+        i += 16;
+    }
+    _mm256_zeroupper();
+    return i + find_special_scalar(data + i, length - i);
+}
+#endif
+
+static const find_special_fn find_special_impls[DATA_LINK_KERNEL_COUNT] = {
+    find_special_scalar,
+#ifdef DATA_LINK_KERNELS_X86
+    find_special_sse2,
+    find_special_avx2,
+#else
+    NULL,
+    NULL,
+#endif
+};
+
+static _Atomic(find_special_fn) find_special = find_special_scalar;
+static _Atomic data_link_kernel_t active_kernel = DATA_LINK_KERNEL_SCALAR;
+
+bool data_link_kernel_supported(data_link_kernel_t kernel) {
+    switch (kernel) {
+        case DATA_LINK_KERNEL_SCALAR:
+            return true;
+#ifdef DATA_LINK_KERNELS_X86
+        case DATA_LINK_KERNEL_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case DATA_LINK_KERNEL_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+int data_link_kernels_select(data_link_kernel_t kernel) {
+    if(kernel >= DATA_LINK_KERNEL_COUNT || !data_link_kernel_supported(kernel)) return -1;
+    atomic_store(&find_special, find_special_impls[kernel]);
+    atomic_store(&active_kernel, kernel);
+    return 0;
+}
+
+data_link_kernel_t data_link_kernel_active() {
+    return atomic_load(&active_kernel);
+}
+
+const char* data_link_kernel_name(data_link_kernel_t kernel) {
+    switch (kernel) {
+        case DATA_LINK_KERNEL_SCALAR: return "scalar";
+        case DATA_LINK_KERNEL_SSE2: return "sse2";
+        case DATA_LINK_KERNEL_AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+#define CRC32C_POLY_REFLECTED 0x82F63B78u
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const unsigned char* data, size_t length);
+
+static uint32_t crc32c_table[8][256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_build_tables() {
+    for(uint32_t byte = 0; byte < 256; byte++) {
+        uint32_t crc = byte;
+        for(int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (CRC32C_POLY_REFLECTED & (0u - (crc & 1u)));
+        crc32c_table[0][byte] = crc;
+    }
+    for(uint32_t byte = 0; byte < 256; byte++) {
+        for(int slice = 1; slice < 8; slice++) crc32c_table[slice][byte] = (crc32c_table[slice - 1][byte] >> 8) ^ crc32c_table[0][crc32c_table[slice - 1][byte] & 0xFF];
+    }
+}
+
+// Slicing-by-8: eight table lookups retire eight input bytes per iteration.
+static uint32_t crc32c_slicing8(uint32_t crc, const unsigned char* data, size_t length) {
+    pthread_once(&crc32c_table_once, crc32c_build_tables);
+    size_t i = 0;
+    for(; i + 8 <= length; i += 8) {
+        uint32_t low, high;
+        memcpy(&low, data + i, 4);
+        memcpy(&high, data + i + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        low = __builtin_bswap32(low);
+        high = __builtin_bswap32(high);
+#endif
+        low ^= crc;
+        crc = crc32c_table[7][low & 0xFF] ^ crc32c_table[6][(low >> 8) & 0xFF] ^ crc32c_table[5][(low >> 16) & 0xFF] ^ crc32c_table[4][low >> 24] ^
+              crc32c_table[3][high & 0xFF] ^ crc32c_table[2][(high >> 8) & 0xFF] ^ crc32c_table[1][(high >> 16) & 0xFF] ^ crc32c_table[0][high >> 24];
+    }
+    for(; i < length; i++) crc = (crc >> 8) ^ crc32c_table[0][(crc ^ data[i]) & 0xFF];
+    return crc;
+}
+
+#ifdef DATA_LINK_KERNELS_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char* data, size_t length) {
+    size_t i = 0;
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for(; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+#endif
+    for(; i + 4 <= length; i += 4) {
+        uint32_t word;
+        memcpy(&word, data + i, 4);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for(; i < length; i++) crc = _mm_crc32_u8(crc, data[i]);
+    return crc;
+}
+#endif
+
+static const crc32c_fn crc32c_impls[DATA_LINK_CRC_IMPL_COUNT] = {
+    crc32c_slicing8,
+#ifdef DATA_LINK_KERNELS_X86
+    crc32c_sse42,
+#else
+    NULL,
+#endif
+};
+
+static _Atomic(crc32c_fn) crc32c_update = crc32c_slicing8;
+static _Atomic data_link_crc_impl_t active_crc = DATA_LINK_CRC_SLICING8;
+
+bool data_link_crc_supported(data_link_crc_impl_t impl) {
+    switch (impl) {
+        case DATA_LINK_CRC_SLICING8:
+            return true;
+#ifdef DATA_LINK_KERNELS_X86
+        case DATA_LINK_CRC_SSE42:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.2");
+#endif
+        default:
+            return false;
+    }
+}
+
+int data_link_crc_select(data_link_crc_impl_t impl) {
+    if(impl >= DATA_LINK_CRC_IMPL_COUNT || !data_link_crc_supported(impl)) return -1;
+    atomic_store(&crc32c_update, crc32c_impls[impl]);
+    atomic_store(&active_crc, impl);
+    return 0;
+}
+
+data_link_crc_impl_t data_link_crc_active() {
+    return atomic_load(&active_crc);
+}
+
+const char* data_link_crc_name(data_link_crc_impl_t impl) {
+    switch (impl) {
+        case DATA_LINK_CRC_SLICING8: return "slicing-by-8";
+        case DATA_LINK_CRC_SSE42: return "sse4.2";
+        default: return "unknown";
+    }
+}
+
+// Picks the widest stuffing kernel and the fastest CRC-32C implementation this CPU supports.
+void data_link_kernels_init() {
+    pthread_once(&crc32c_table_once, crc32c_build_tables);
+    for(int kernel = DATA_LINK_KERNEL_COUNT - 1; kernel >= 0; kernel--) {
+        if(data_link_kernels_select((data_link_kernel_t)kernel) == 0) break;
+    }
+    for(int impl = DATA_LINK_CRC_IMPL_COUNT - 1; impl >= 0; impl--) {
+        if(data_link_crc_select((data_link_crc_impl_t)impl) == 0) break;
+    }
+}
+
+uint32_t data_link_crc32c(uint32_t crc, const unsigned char* data, size_t length) {
+    return atomic_load_explicit(&crc32c_update, memory_order_relaxed)(crc, data, length);
+}
+
+size_t data_link_fcs_size(data_link_fcs_mode_t mode) {
+    return mode == DATA_LINK_FCS_CRC32C ? 4 : 1;
+}
+
+const char* data_link_fcs_name(data_link_fcs_mode_t mode) {
+    switch (mode) {
+        case DATA_LINK_FCS_SUM8: return "sum8";
+        case DATA_LINK_FCS_CRC32C: return "crc32c";
+        default: return "unknown";
+    }
+}
+
+int data_link_fcs_parse(const char* name, data_link_fcs_mode_t* mode) {
+    for(int candidate = 0; candidate < DATA_LINK_FCS_MODE_COUNT; candidate++) {
+        if(strcasecmp(name, data_link_fcs_name((data_link_fcs_mode_t)candidate)) == 0) {
+            *mode = (data_link_fcs_mode_t)candidate;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void data_link_fcs_begin(data_link_fcs_t* fcs, data_link_fcs_mode_t mode) {
+    fcs->mode = mode;
+    fcs->state = mode == DATA_LINK_FCS_CRC32C ? 0xFFFFFFFFu : 0;
+}
+
+void data_link_fcs_update(data_link_fcs_t* fcs, const unsigned char* data, size_t length) {
+    if(fcs->mode == DATA_LINK_FCS_CRC32C) {
+        fcs->state = data_link_crc32c(fcs->state, data, length);
+        return;
+    }
+    uint32_t sum = fcs->state;
+    size_t i = 0;
+#if defined(__x86_64__)
+    // SSE2 is baseline on x86-64: psadbw against zero adds up 16 bytes per instruction.
+    __m128i accumulator = _mm_setzero_si128();
+    for(; i + 16 <= length; i += 16) accumulator = _mm_add_epi64(accumulator, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(data + i)), _mm_setzero_si128()));
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, accumulator);
+    sum += (uint32_t)(lanes[0] + lanes[1]);
+#endif
+    for(; i < length; i++) sum += data[i];
+    fcs->state = sum;
+}
+
+size_t data_link_fcs_finish(const data_link_fcs_t* fcs, unsigned char out[MAX_CHECKSUM_SIZE]) {
+    if(fcs->mode == DATA_LINK_FCS_CRC32C) {
+        uint32_t crc = ~fcs->state;
+        out[0] = crc & 0xFF;
+        out[1] = (crc >> 8) & 0xFF;
+        out[2] = (crc >> 16) & 0xFF;
+        out[3] = (crc >> 24) & 0xFF;
+        return 4;
+    }
+    out[0] = (uint8_t)(fcs->state & 0xFF);
+    return 1;
+}
+
+size_t data_link_find_special(const unsigned char* data, size_t length) {
+    return atomic_load_explicit(&find_special, memory_order_relaxed)(data, length);
+}
+
+long data_link_stuff(const unsigned char* data, size_t length, unsigned char* out, size_t out_capacity, data_link_fcs_t* fcs) {
+    find_special_fn find = atomic_load_explicit(&find_special, memory_order_relaxed);
+    size_t in_index = 0;
+    size_t out_index = 0;
+    while (in_index < length) {
+        size_t run = find(data + in_index, length - in_index);
+        if(out_index + run > out_capacity) return -1;
+        // The FCS reads each run while the copy has it in cache, so the frame is only streamed once.
+        if(fcs != NULL) data_link_fcs_update(fcs, data + in_index, run + (in_index + run < length ? 1 : 0));
+        memcpy(out + out_index, data + in_index, run);
+        in_index += run;
+        out_index += run;
+        if(in_index == length) break;
+        if(out_index + 2 > out_capacity) return -1;
+        out[out_index++] = ESC_BYTE;
+        out[out_index++] = data[in_index++] ^ XOR_BYTE;
+    }
+    return (long)out_index;
+}
+
+data_link_destuff_result_t data_link_destuff(const unsigned char* data, size_t length, unsigned char* out, size_t out_capacity, size_t* consumed, size_t* produced, data_link_fcs_t* fcs) {
+    find_special_fn find = atomic_load_explicit(&find_special, memory_order_relaxed);
+    size_t fcs_lag = fcs != NULL ? data_link_fcs_size(fcs->mode) : 0;
+    size_t fcs_done = 0; // Output bytes already folded into the FCS
+    size_t in_index = 0;
+    size_t out_index = 0;
+    data_link_destuff_result_t result = DATA_LINK_DESTUFF_INCOMPLETE;
+    while (in_index < length) {
+        size_t run = find(data + in_index, length - in_index);
+        if(out_index + run > out_capacity) {
+            in_index += out_capacity - out_index + 1;
+            result = DATA_LINK_DESTUFF_OVERFLOW;
+            break;
+        }
+        memcpy(out + out_index, data + in_index, run);
+        in_index += run;
+        out_index += run;
+        // The last fcs_lag bytes may turn out to be the received FCS, so the running FCS trails the output by that much.
+        if(fcs != NULL && out_index > fcs_done + fcs_lag) {
+            data_link_fcs_update(fcs, out + fcs_done, out_index - fcs_lag - fcs_done);
+            fcs_done = out_index - fcs_lag;
+        }
+        if(in_index == length) break;
+        if(data[in_index] == FLAG_BYTE) {
+            in_index++;
+            result = DATA_LINK_DESTUFF_OK;
+            break;
+        }
+        // ESC_BYTE: the next byte must be an escaped FLAG or ESC.
+        if(in_index + 1 >= length) {
+            in_index = length;
+            break;
+        }
+        unsigned char escaped = data[in_index + 1];
+        in_index += 2;
+        if(escaped != (FLAG_BYTE ^ XOR_BYTE) && escaped != (ESC_BYTE ^ XOR_BYTE)) {
+            result = DATA_LINK_DESTUFF_BAD_ESCAPE;
+            break;
+        }
+        if(out_index >= out_capacity) {
+            result = DATA_LINK_DESTUFF_OVERFLOW;
+            break;
+        }
+        out[out_index++] = escaped ^ XOR_BYTE;
+    }
+    *consumed = in_index;
+    *produced = out_index;
+    return result;
+}
@@ -0,0 +1,127 @@
+#include "headers/latency.h"
+#include "headers/log.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+static const char* const latency_stage_names[LATENCY_STAGE_COUNT] = {
+    "tx.application", "tx.transport", "tx.network", "tx.datalink", "tx.physical", "tx.total",
+    "rx.wire", "rx.queue.datalink", "rx.datalink", "rx.queue.network", "rx.network",
+    "rx.queue.transport", "rx.transport", "rx.queue.application", "rx.application", "rx.total"
+};
+
+bool latency_tracing = false;
+_Thread_local latency_trace_t latency_thread_trace = { 0, 0 };
+static latency_histogram_t latency_histograms[LATENCY_STAGE_COUNT];
+
+static uint32_t latency_bucket_index(uint64_t value) {
+    if(value < LATENCY_SUB_BUCKETS) return (uint32_t)value;
+    if(value >> LATENCY_MAX_BITS) return LATENCY_BUCKETS - 1;
+    int shift = (63 - __builtin_clzll(value)) - LATENCY_SUB_BUCKET_BITS;
+    return (uint32_t)(shift + 1) * LATENCY_SUB_BUCKETS + (uint32_t)((value >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+// Largest value that lands in the bucket.
+static uint64_t latency_bucket_value(uint32_t index) {
+    if(index < LATENCY_SUB_BUCKETS) return index;
+    uint32_t shift = index / LATENCY_SUB_BUCKETS - 1;
+    uint64_t sub_bucket = index % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+static void latency_raise(_Atomic uint64_t* target, uint64_t value) {
+    uint64_t current = atomic_load_explicit(target, memory_order_relaxed);
+    while (value > current && !atomic_compare_exchange_weak_explicit(target, &current, value, memory_order_relaxed, memory_order_relaxed)) { }
+}
+
+uint64_t latency_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+uint64_t latency_begin() {
+    uint64_t now = latency_now_ns();
+    latency_thread_trace.origin_ns = now;
+    latency_thread_trace.last_ns = now;
+    return now;
+}
+
+void latency_histogram_record(latency_histogram_t* histogram, uint64_t nanoseconds) {
+    atomic_fetch_add_explicit(&histogram->buckets[latency_bucket_index(nanoseconds)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum_ns, nanoseconds, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    latency_raise(&histogram->min_inverted, UINT64_MAX - nanoseconds);
+    latency_raise(&histogram->max_ns, nanoseconds);
+}
+
+void latency_record(latency_stage_t stage, uint64_t nanoseconds) {
+    latency_histogram_record(&latency_histograms[stage], nanoseconds);
+}
+
+void latency_mark(latency_stage_t stage) {
+    if(latency_thread_trace.origin_ns == 0) return;
+    uint64_t now = latency_now_ns();
+    latency_record(stage, now - latency_thread_trace.last_ns);
+    latency_thread_trace.last_ns = now;
+}
+
+void latency_end(latency_stage_t total_stage) {
+    if(latency_thread_trace.origin_ns == 0) return;
+    latency_record(total_stage, latency_now_ns() - latency_thread_trace.origin_ns);
+    latency_thread_trace.origin_ns = 0;
+}
+
+const char* latency_stage_name(latency_stage_t stage) {
+    return stage < LATENCY_STAGE_COUNT ? latency_stage_names[stage] : "unknown";
+}
+
+latency_histogram_t* latency_stage_histogram(latency_stage_t stage) {
+    return &latency_histograms[stage];
+}
+
+uint64_t latency_histogram_percentile(latency_histogram_t* histogram, double percentile) {
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        counts[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        total += counts[i];
+    }
+    if(total == 0) return 0;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)total + 0.5);
+    if(rank < 1) rank = 1;
+    if(rank > total) rank = total;
+    uint64_t max = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+    uint64_t seen = 0;
+    for(uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += counts[i];
+        if(seen >= rank) return latency_bucket_value(i) < max ? latency_bucket_value(i) : max;
+    }
+    return max;
+}
+
+void latency_histogram_summarize(latency_histogram_t* histogram, latency_summary_t* summary) {
+    memset(summary, 0, sizeof(*summary));
+    summary->count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    if(summary->count == 0) return;
+    summary->min_ns = UINT64_MAX - atomic_load_explicit(&histogram->min_inverted, memory_order_relaxed);
+    summary->mean_ns = (double)atomic_load_explicit(&histogram->sum_ns, memory_order_relaxed) / (double)summary->count;
+    summary->p50_ns = latency_histogram_percentile(histogram, 50);
+    summary->p90_ns = latency_histogram_percentile(histogram, 90);
+    summary->p99_ns = latency_histogram_percentile(histogram, 99);
+    summary->p999_ns = latency_histogram_percentile(histogram, 99.9);
+    summary->max_ns = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+}
+
+void latency_print() {
+    LOG_INFO(LOG_LATENCY, "%-21s %10s %9s %9s %9s %9s %9s %9s %9s (us)", "stage", "count", "min", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for(int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        latency_summary_t summary;
+        latency_histogram_summarize(&latency_histograms[i], &summary);
+        if(summary.count == 0) continue;
+        LOG_INFO(LOG_LATENCY, "%-21s %10llu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f", latency_stage_names[i], (unsigned long long)summary.count,
+                (double)summary.min_ns / 1e3, summary.mean_ns / 1e3, (double)summary.p50_ns / 1e3, (double)summary.p90_ns / 1e3,
+                (double)summary.p99_ns / 1e3, (double)summary.p999_ns / 1e3, (double)summary.max_ns / 1e3);
+    }
+}
@@ -0,0 +1,230 @@
+#include "headers/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#define LOG_CACHE_LINE 64
+#define LOG_HEX_BYTES_PER_RECORD 32
+
+typedef struct {
+    uint64_t timestamp_ns;
+    uint8_t level;
+    uint8_t category;
+    char text[LOG_RECORD_TEXT];
+} log_record_t;
+
+// Single-producer (owning thread) / single-consumer (writer thread) record ring.
+typedef struct log_ring {
+    _Atomic uint64_t head __attribute__((aligned(LOG_CACHE_LINE))); // Next record the owner fills
+    _Atomic uint64_t dropped; // Written only by the owner
+    _Atomic uint64_t tail __attribute__((aligned(LOG_CACHE_LINE))); // Next record the writer prints
+    atomic_bool in_use; // Cleared when the owning thread exits, so another can adopt the ring
+    struct log_ring* next_ring;
+    log_record_t records[LOG_RING_RECORDS];
+} log_ring_t;
+
+static const char* const log_level_names[LOG_LEVEL_COUNT] = { "trace", "debug", "info", "warn", "error" };
+static const char* const log_category_names[LOG_CATEGORY_COUNT] = { "MAIN", "PHYSICAL", "RX", "DATALINK", "NETWORK", "TRANSPORT", "APP", "POOL", "LATENCY" };
+static const char* const log_category_colors[LOG_CATEGORY_COUNT] = { COLOR_MAIN, COLOR_PHY, COLOR_PHY, COLOR_DL, COLOR_NW, COLOR_TP, COLOR_APP, COLOR_MAIN, COLOR_MAIN };
+int log_level = LOG_DEFAULT_LEVEL;
+uint32_t log_categories = LOG_ALL_CATEGORIES;
+static _Atomic(log_ring_t*) log_rings = NULL;
+static atomic_bool log_running = false;
+static pthread_t log_writer_tid;
+static pthread_key_t log_ring_key;
+static pthread_once_t log_ring_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local log_ring_t* log_thread_ring = NULL;
+
+const char* log_level_name(int level) {
+    return level >= 0 && level < LOG_LEVEL_COUNT ? log_level_names[level] : "unknown";
+}
+
+int log_level_parse(const char* name, int* level) {
+    for(int i = 0; i < LOG_LEVEL_COUNT; i++) {
+        if(strcasecmp(name, log_level_names[i]) == 0) {
+            *level = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int log_categories_parse(const char* list, uint32_t* categories) {
+    uint32_t parsed = 0;
+    const char* name = list;
+    while (*name != '\0') {
+        size_t name_length = strcspn(name, ",");
+        bool found = false;
+        if(name_length == 3 && strncasecmp(name, "all", 3) == 0) {
+            parsed = LOG_ALL_CATEGORIES;
+            found = true;
+        }
+        for(int i = 0; i < LOG_CATEGORY_COUNT && !found; i++) {
+            if(strlen(log_category_names[i]) == name_length && strncasecmp(name, log_category_names[i], name_length) == 0) {
+                parsed |= 1u << i;
+                found = true;
+            }
+        }
+        if(!found) return -1;
+        name += name_length;
+        if(*name == ',') name++;
+    }
+    if(parsed == 0) return -1;
+    *categories = parsed;
+    return 0;
+}
+
+static uint64_t log_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void log_emit(int level, int category, const char* text) {
+    if(level >= LOG_LEVEL_WARN) fprintf(stderr, ANSI_COLOR_RESET "%s%s %s: %s\n", level >= LOG_LEVEL_ERROR ? COLOR_ERR : COLOR_WARN, log_category_names[category], level >= LOG_LEVEL_ERROR ? "Error" : "Warning", text);
+    else fprintf(stdout, ANSI_COLOR_RESET "%s%s: %s\n", log_category_colors[category], log_category_names[category], text);
+}
+
+static void log_thread_exit(void* ring) {
+    atomic_store_explicit(&((log_ring_t*)ring)->in_use, false, memory_order_release);
+}
+
+static void log_make_key() {
+    pthread_key_create(&log_ring_key, log_thread_exit);
+}
+
+static log_ring_t* log_get_ring() {
+    if(log_thread_ring != NULL) return log_thread_ring;
+    pthread_once(&log_ring_key_once, log_make_key);
+    log_ring_t* ring = NULL;
+    // Adopt the ring of an exited thread; whatever it left unprinted stays in order ahead of the new records.
+    for(log_ring_t* candidate = atomic_load_explicit(&log_rings, memory_order_acquire); candidate != NULL; candidate = candidate->next_ring) {
+        bool expected = false;
+        if(atomic_compare_exchange_strong_explicit(&candidate->in_use, &expected, true, memory_order_acquire, memory_order_relaxed)) {
+            ring = candidate;
+            break;
+        }
+    }
+    if(ring == NULL) {
+        if(posix_memalign((void**)&ring, LOG_CACHE_LINE, sizeof(log_ring_t)) != 0) return NULL;
+        memset(ring, 0, sizeof(log_ring_t));
+        atomic_store_explicit(&ring->in_use, true, memory_order_relaxed);
+        log_ring_t* head = atomic_load_explicit(&log_rings, memory_order_relaxed);
+        do {
+            ring->next_ring = head;
+        } while (!atomic_compare_exchange_weak_explicit(&log_rings, &head, ring, memory_order_release, memory_order_relaxed));
+    }
+    pthread_setspecific(log_ring_key, ring);
+    log_thread_ring = ring;
+    return ring;
+}
+
+static void log_vwrite(int level, log_category_t category, const char* format, va_list args) {
+    if(!atomic_load_explicit(&log_running, memory_order_acquire)) {
+        char text[LOG_RECORD_TEXT];
+        vsnprintf(text, sizeof(text), format, args);
+        log_emit(level, category, text);
+        return;
+    }
+    log_ring_t* ring = log_get_ring();
+    if(ring == NULL) return;
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if(head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= LOG_RING_RECORDS) {
+        // Never block the caller on the writer: count the loss instead.
+        atomic_store_explicit(&ring->dropped, atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1, memory_order_relaxed);
+        return;
+    }
+    log_record_t* record = &ring->records[head % LOG_RING_RECORDS];
+    record->timestamp_ns = log_now_ns();
+    record->level = (uint8_t)level;
+    record->category = (uint8_t)category;
+    vsnprintf(record->text, sizeof(record->text), format, args);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void log_write(int level, log_category_t category, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_vwrite(level, category, format, args);
+    va_end(args);
+}
+
+void log_hex(int level, log_category_t category, const char* label, const unsigned char* data, size_t length) {
+    // One record per row keeps every record within LOG_RECORD_TEXT.
+    for(size_t offset = 0; offset < length || offset == 0; offset += LOG_HEX_BYTES_PER_RECORD) {
+        char row[LOG_HEX_BYTES_PER_RECORD * 3 + 1];
+        size_t row_length = 0;
+        for(size_t i = offset; i < length && i < offset + LOG_HEX_BYTES_PER_RECORD; i++) row_length += (size_t)snprintf(row + row_length, sizeof(row) - row_length, "%02X ", data[i]);
+        row[row_length] = '\0';
+        log_write(level, category, "%s [%zu/%zu]: %s", label, offset, length, row);
+        if(length == 0) break;
+    }
+}
+
+// Prints every pending record in timestamp order across the rings. Returns the number printed.
+static size_t log_drain() {
+    size_t printed = 0;
+    while (true) {
+        log_ring_t* oldest_ring = NULL;
+        uint64_t oldest_timestamp = UINT64_MAX;
+        for(log_ring_t* ring = atomic_load_explicit(&log_rings, memory_order_acquire); ring != NULL; ring = ring->next_ring) {
+            uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            if(tail == atomic_load_explicit(&ring->head, memory_order_acquire)) continue;
+            uint64_t timestamp = ring->records[tail % LOG_RING_RECORDS].timestamp_ns;
+            if(timestamp < oldest_timestamp) {
+                oldest_timestamp = timestamp;
+                oldest_ring = ring;
+            }
+        }
+        if(oldest_ring == NULL) break;
+        uint64_t tail = atomic_load_explicit(&oldest_ring->tail, memory_order_relaxed);
+        const log_record_t* record = &oldest_ring->records[tail % LOG_RING_RECORDS];
+        log_emit(record->level, record->category, record->text);
+        atomic_store_explicit(&oldest_ring->tail, tail + 1, memory_order_release);
+        printed++;
+    }
+    if(printed > 0) fflush(stdout);
+    return printed;
+}
+
+static void* log_writer_thread(void* param) {
+    (void)param;
+    while (atomic_load_explicit(&log_running, memory_order_acquire)) {
+        if(log_drain() == 0) {
+            struct timespec idle = { 0, LOG_WRITER_IDLE_US * 1000 };
+            nanosleep(&idle, NULL);
+        }
+    }
+    log_drain();
+    return NULL;
+}
+
+int log_init() {
+    if(atomic_load(&log_running)) return 0;
+    atomic_store(&log_running, true);
+    if(pthread_create(&log_writer_tid, NULL, log_writer_thread, NULL) != 0) {
+        atomic_store(&log_running, false);
+        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "LOG Error: Failed to create log writer thread");
+        return -1;
+    }
+    return 0;
+}
+
+void log_shutdown() {
+    if(!atomic_exchange(&log_running, false)) return;
+    if(pthread_join(log_writer_tid, NULL) != 0) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "LOG Warning: Failed to join log writer thread");
+    uint64_t dropped = log_dropped_records();
+    if(dropped > 0) log_write(LOG_LEVEL_WARN, LOG_MAIN, "%llu log records were dropped because the writer fell behind.", (unsigned long long)dropped);
+    fflush(stdout);
+}
+
+uint64_t log_dropped_records() {
+    uint64_t dropped = 0;
+    for(log_ring_t* ring = atomic_load_explicit(&log_rings, memory_order_acquire); ring != NULL; ring = ring->next_ring) dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    return dropped;
+}
@@ -0,0 +1,123 @@
+#include "headers/metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+static const char* const metric_names[METRIC_COUNT] = {
+    "phy.frames_sent", "phy.bytes_sent", "phy.frames_received", "phy.bytes_received",
+    "phy.ring_full_waits", "phy.send_drops", "phy.invalid_slots", "phy.links_added", "phy.links_aged",
+    "rx.queued", "rx.started", "rx.dispatch_failures",
+    "dl.frames_sent", "dl.bytes_sent", "dl.frames_received", "dl.bytes_received",
+    "dl.fcs_failures", "dl.framing_errors",
+    "nw.packets_sent", "nw.fragments_sent", "nw.bytes_sent", "nw.fragments_received",
+    "nw.datagrams_received", "nw.bytes_received", "nw.checksum_failures", "nw.malformed",
+    "nw.reassembly_timeouts", "nw.reassembly_drops", "nw.forwarded", "nw.bytes_forwarded", "nw.forward_drops",
+    "nw.no_route", "nw.ttl_expired", "nw.gso_datagrams", "nw.gro_coalesced",
+    "tp.segments_sent", "tp.bytes_sent", "tp.segments_received", "tp.bytes_received",
+    "tp.checksum_failures", "tp.malformed", "tp.no_port", "tp.queue_drops",
+    "rt.segments_sent", "rt.retransmits", "rt.timeouts", "rt.acks_sent",
+    "rt.segments_received", "rt.bytes_delivered", "rt.duplicates", "rt.window_drops",
+    "app.messages_sent", "app.messages_received",
+    "alloc.failures"
+};
+
+_Thread_local metrics_slot_t* metrics_thread_slot = NULL;
+// Counters live here until metrics_init publishes them, and for good in tools that never call it.
+static metrics_segment_t metrics_local_segment = { .slot_count = METRICS_MAX_THREADS + 1, .slots[METRICS_MAX_THREADS].shared = true };
+static metrics_segment_t* metrics_segment = &metrics_local_segment;
+static char metrics_shm_name[64];
+static pthread_key_t metrics_key;
+static pthread_once_t metrics_key_once = PTHREAD_ONCE_INIT;
+
+static void metrics_thread_exit(void* slot) {
+    atomic_store_explicit(&((metrics_slot_t*)slot)->in_use, false, memory_order_release);
+}
+
+static void metrics_make_key() {
+    pthread_key_create(&metrics_key, metrics_thread_exit);
+}
+
+metrics_slot_t* metrics_claim_slot() {
+    pthread_once(&metrics_key_once, metrics_make_key);
+    metrics_slot_t* slot = &metrics_segment->slots[METRICS_MAX_THREADS];
+    for(int i = 0; i < METRICS_MAX_THREADS; i++) {
+        bool expected = false;
+        if(atomic_compare_exchange_strong_explicit(&metrics_segment->slots[i].in_use, &expected, true, memory_order_acquire, memory_order_relaxed)) {
+            slot = &metrics_segment->slots[i];
+            pthread_setspecific(metrics_key, slot);
+            break;
+        }
+    }
+    metrics_thread_slot = slot;
+    return slot;
+}
+
+static void metrics_segment_prepare(metrics_segment_t* segment) {
+    segment->magic = METRICS_MAGIC;
+    segment->version = METRICS_VERSION;
+    segment->metric_count = METRIC_COUNT;
+    segment->slot_count = METRICS_MAX_THREADS + 1;
+    segment->slot_size = sizeof(metrics_slot_t);
+    segment->pid = (int32_t)getpid();
+    segment->start_time = (int64_t)time(NULL);
+    for(int i = 0; i < METRIC_COUNT; i++) snprintf(segment->names[i], METRICS_NAME_SIZE, "%s", metric_names[i]);
+    segment->slots[METRICS_MAX_THREADS].shared = true;
+}
+
+void metrics_segment_name(const char* mac_address, char* name, size_t name_size) {
+    snprintf(name, name_size, "/metrics_%s", mac_address);
+}
+
+int metrics_init(const char* mac_address) {
+    metrics_segment_name(mac_address, metrics_shm_name, sizeof(metrics_shm_name));
+    shm_unlink(metrics_shm_name);
+    // Others may read the counters but only this instance writes them.
+    int fd = shm_open(metrics_shm_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd == -1) {
+        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "METRICS Error: shm_open failed");
+        return -1;
+    }
+    if(ftruncate(fd, sizeof(metrics_segment_t)) == -1) {
+        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "METRICS Error: ftruncate failed");
+        close(fd);
+        shm_unlink(metrics_shm_name);
+        return -1;
+    }
+    void* ptr = mmap(NULL, sizeof(metrics_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED) {
+        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "METRICS Error: mmap failed");
+        shm_unlink(metrics_shm_name);
+        return -1;
+    }
+    metrics_segment_t* segment = (metrics_segment_t*)ptr;
+    // Carry over what was counted before the segment existed; the caller's slot moves along with it.
+    memcpy(segment->slots, metrics_local_segment.slots, sizeof(segment->slots));
+    metrics_segment_prepare(segment);
+    if(metrics_thread_slot != NULL) metrics_thread_slot = &segment->slots[metrics_thread_slot - metrics_local_segment.slots];
+    metrics_segment = segment;
+    atomic_store_explicit(&segment->active, true, memory_order_release);
+    return 0;
+}
+
+void metrics_shutdown() {
+    if(metrics_segment == &metrics_local_segment) return;
+    atomic_store_explicit(&metrics_segment->active, false, memory_order_release);
+    // Leave the mapping in place: threads that are still winding down may count into it until exit.
+    shm_unlink(metrics_shm_name);
+}
+
+uint64_t metrics_total(const metrics_segment_t* segment, metric_id_t metric) {
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < segment->slot_count; i++) total += atomic_load_explicit(&segment->slots[i].counters[metric], memory_order_relaxed);
+    return total;
+}
+
+uint64_t metrics_value(metric_id_t metric) {
+    return metrics_total(metrics_segment, metric);
+}
@@ -1,7 +1,16 @@
 #include "headers/network-impl.h"
 #include "headers/transport-impl.h"
+#include "headers/reliable-impl.h"
 #include "headers/data-link-impl.h"
+#include "headers/physical-impl.h"
+#include "headers/variables.h"
+#include "headers/checksum.h"
 #include "headers/thread-pool.h"
+#include "headers/rx-dispatch.h"
+#include "headers/buffer-pool.h"
+#include "headers/log.h"
+#include "headers/metrics.h"
+#include "headers/latency.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,202 +19,635 @@
 #include <time.h>
 #include <errno.h>
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-extern bool DEBUG_ENABLED;
 extern threadpool thpool;
 
-static uint16_t calculate_internet_checksum(const void* buffer, size_t len) {
-    const uint16_t* buf = (const uint16_t*)buffer;
-    uint32_t sum = 0;
-    while (len > 1) {
-        sum += *buf++;
-        len -= 2;
-    }
-    if(len == 1) {
-        sum += *(const uint8_t*)buf;
-    }
-    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
-    return (uint16_t)(~sum);
-}
-
+// Inclusive byte range of a datagram payload that has not arrived yet (RFC 815 hole descriptor).
 typedef struct {
+    uint32_t first;
+    uint32_t last;
+} reassembly_hole_t;
+
+typedef struct reassembly_entry {
+    uint32_t src_address;
     uint16_t id;
-    size_t total_payload_size;
-    size_t received_size;
+    uint8_t protocol;
     unsigned char* buffer;
-    time_t last_fragment_time;
-    bool in_use;
+    size_t capacity;
+    size_t total_payload_size; // Valid once the fragment with MF=0 has arrived
+    bool total_known;
+    size_t received_end;
+    reassembly_hole_t holes[REASSEMBLY_MAX_HOLES];
+    size_t hole_count;
+    uint64_t deadline_ms;
+    struct reassembly_entry* next;
+} reassembly_entry_t;
+
+// Datagrams in flight are spread over lock-striped shards by (source, identification, protocol), so workers reassembling
+// different datagrams rarely contend on the same lock.
+typedef struct {
+    pthread_mutex_t lock;
+    reassembly_entry_t* entries;
+} reassembly_shard_t;
+
+static reassembly_shard_t reassembly_shards[REASSEMBLY_SHARDS];
+static atomic_size_t reassembly_memory = 0;
+static _Atomic uint16_t next_packet_id = 0;
+
+// The datagram a receive worker is coalescing: the payload of its first in-order fragments, not yet in the
+// reassembly table.
+typedef struct {
+    unsigned char* buffer; // NULL while nothing is held
+    size_t capacity;
+    size_t length;
+    size_t frames;
+    uint32_t src_address;
+    uint32_t dest_address;
+    uint16_t identification;
     uint8_t protocol;
-} reassembly_buffer_t;
+} network_gro_t;
+static _Thread_local network_gro_t network_gro;
 
-#define REASSEMBLY_TIMEOUT 30
-static reassembly_buffer_t current_reassembly = { .in_use = false };
-static uint16_t next_packet_id = 0;
+// One level of the forwarding trie. NETWORK_TRIE_STRIDE bits of the address pick a slot, which names the next hop
+// of the longest route ending at this level that covers it (a route is expanded over every slot it covers), and
+// the child holding longer routes. Lookups take no lock: slots only change by single stores, and nodes are only
+// freed at shutdown.
+typedef struct network_trie_node {
+    _Atomic uint8_t next_hop[1 << NETWORK_TRIE_STRIDE]; // Index into network_next_hops, 0 for none
+    uint8_t prefix_length[1 << NETWORK_TRIE_STRIDE]; // Of the route that set next_hop; only writers read it
+    struct network_trie_node* _Atomic child[1 << NETWORK_TRIE_STRIDE];
+} network_trie_node_t;
 
-void network_layer_init() {
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Initializing Network Layer...\n");
-    srand(time(NULL));
-    next_packet_id = rand() % 65535;
-    current_reassembly.in_use = false;
-    current_reassembly.buffer = NULL;
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Network Layer Initialized.\n");
+_Static_assert(NETWORK_MAX_NEXT_HOPS <= 256, "next hop indexes must fit a trie slot");
+
+uint32_t network_local_address = 0;
+bool network_offload = true;
+static network_trie_node_t network_trie_root;
+static _Atomic uint8_t network_default_hop = 0; // The /0 route, which no trie slot holds
+static char network_next_hops[NETWORK_MAX_NEXT_HOPS][PHYSICAL_MAC_SIZE]; // Never change once an index is in use
+static size_t network_next_hop_count = 1;
+static pthread_mutex_t network_routes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t reassembly_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
 }
 
-void network_layer_shutdown() {
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Shutting down Network Layer...\n");
-    if(current_reassembly.in_use) {
-        free(current_reassembly.buffer);
-        current_reassembly.in_use = false;
-        if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Cleared active reassembly buffer.\n");
+static reassembly_shard_t* reassembly_shard(uint32_t src_address, uint16_t id, uint8_t protocol) {
+    return &reassembly_shards[((src_address * 0x9E3779B1u) ^ ((uint32_t)id * 31u + protocol)) % REASSEMBLY_SHARDS];
+}
+
+// Charges size bytes against REASSEMBLY_MEMORY_CAP. Returns -1 without charging if the cap would be exceeded.
+static int reassembly_charge(size_t size) {
+    size_t previous = atomic_fetch_add(&reassembly_memory, size);
+    if(previous + size > REASSEMBLY_MEMORY_CAP) {
+        atomic_fetch_sub(&reassembly_memory, size);
+        return -1;
+    }
+    return 0;
+}
+
+static void reassembly_free_entry(reassembly_entry_t* entry) {
+    atomic_fetch_sub(&reassembly_memory, entry->capacity + sizeof(reassembly_entry_t));
+    buffer_pool_free(entry->buffer);
+    buffer_pool_free(entry);
+}
+
+// Drops every entry of the shard whose deadline has passed. Caller holds the shard lock.
+static void reassembly_expire(reassembly_shard_t* shard, uint64_t now_ms) {
+    reassembly_entry_t** link = &shard->entries;
+    while(*link != NULL) {
+        reassembly_entry_t* entry = *link;
+        if(now_ms >= entry->deadline_ms) {
+            LOG_DEBUG(LOG_NETWORK, "Reassembly timeout for ID %u. Discarding.", entry->id);
+            metrics_inc(METRIC_NW_REASSEMBLY_TIMEOUTS);
+            *link = entry->next;
+            reassembly_free_entry(entry);
+        }
+        else link = &entry->next;
+    }
+}
+
+static int reassembly_reserve(reassembly_entry_t* entry, size_t size) {
+    if(size <= entry->capacity) return 0;
+    size_t new_capacity = entry->capacity * 2;
+    if(new_capacity < size) new_capacity = size;
+    if(new_capacity > NETWORK_MAX_DATAGRAM_PAYLOAD) new_capacity = NETWORK_MAX_DATAGRAM_PAYLOAD;
+    if(entry->total_known) new_capacity = entry->total_payload_size;
+    if(reassembly_charge(new_capacity - entry->capacity) != 0) {
+        LOG_WARN(LOG_NETWORK, "Reassembly memory cap (%d bytes) reached. Discarding datagram ID %u.", REASSEMBLY_MEMORY_CAP, entry->id);
+        return -1;
+    }
+    unsigned char* buffer = (unsigned char*)buffer_pool_realloc(entry->buffer, new_capacity);
+    if(buffer == NULL) {
+        atomic_fetch_sub(&reassembly_memory, new_capacity - entry->capacity);
+        LOG_WARN(LOG_NETWORK, "Failed to allocate reassembly buffer (size %zu).", new_capacity);
+        return -1;
+    }
+    entry->buffer = buffer;
+    entry->capacity = new_capacity;
+    return 0;
+}
+
+// Copies one fragment into the entry and updates its hole list.
+// Returns 1 when the datagram is complete, 0 while holes remain and -1 if the datagram has to be dropped.
+static int reassembly_fill(reassembly_entry_t* entry, size_t offset, const unsigned char* data, size_t length, bool more_fragments) {
+    size_t end = offset + length;
+    if(entry->total_known && end > entry->total_payload_size) return -1;
+    if(!more_fragments) {
+        if((entry->total_known && entry->total_payload_size != end) || entry->received_end > end) return -1;
+        entry->total_payload_size = end;
+        entry->total_known = true;
+    }
+    else if(length == 0) return 0;
+    if(length > 0) {
+        if(reassembly_reserve(entry, end) != 0) return -1;
+        memcpy(entry->buffer + offset, data, length);
+        if(end > entry->received_end) entry->received_end = end;
+    }
+    reassembly_hole_t holes[REASSEMBLY_MAX_HOLES + 2];
+    size_t hole_count = 0;
+    for(size_t i = 0; i < entry->hole_count; i++) {
+        reassembly_hole_t hole = entry->holes[i];
+        if(length > 0 && hole.first < end && hole.last >= offset) {
+            if(hole.first < offset) holes[hole_count++] = (reassembly_hole_t){ hole.first, (uint32_t)offset - 1 };
+            if(hole.last >= end) holes[hole_count++] = (reassembly_hole_t){ (uint32_t)end, hole.last };
+        }
+        else holes[hole_count++] = hole;
+        if(hole_count > REASSEMBLY_MAX_HOLES) {
+            LOG_WARN(LOG_NETWORK, "Too many holes (%d) in datagram ID %u. Discarding.", REASSEMBLY_MAX_HOLES, entry->id);
+            return -1;
+        }
+    }
+    entry->hole_count = 0;
+    for(size_t i = 0; i < hole_count; i++) {
+        if(entry->total_known) {
+            if(holes[i].first >= entry->total_payload_size) continue;
+            if(holes[i].last >= entry->total_payload_size) holes[i].last = (uint32_t)entry->total_payload_size - 1;
+        }
+        entry->holes[entry->hole_count++] = holes[i];
+    }
+    return entry->hole_count == 0 ? 1 : 0;
+}
+
+// Hands a complete datagram to the transport protocol named in its IP header.
+static void network_deliver_to_transport(packet_buffer_t* transport_packet, uint8_t ip_protocol, uint32_t src_address, uint32_t dest_address) {
+    LATENCY_MARK(LATENCY_RX_NETWORK);
+    *(network_receive_control_t*)transport_packet->control = (network_receive_control_t){ .src_address = src_address, .dest_address = dest_address };
+    metrics_inc(METRIC_NW_DATAGRAMS_RECEIVED);
+    metrics_add(METRIC_NW_BYTES_RECEIVED, transport_packet->length);
+    void (*handler)(void*) = NULL;
+    if(ip_protocol == UDP_PROTOCOL_NUMBER) handler = handle_network_to_transport;
+    else if(ip_protocol == RELIABLE_PROTOCOL_NUMBER) handler = handle_network_to_reliable;
+    if(handler == NULL) {
+        metrics_inc(METRIC_NW_MALFORMED);
+        LOG_WARN(LOG_NETWORK, "No transport protocol %u. Discarding datagram.", ip_protocol);
+        packet_buffer_release(transport_packet);
+        return;
+    }
+    if(thpool != NULL) {
+        if(rx_dispatch_next(handler, transport_packet) != 0) {
+            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Failed to add task to thread pool for Transport Layer.\n");
+            packet_buffer_release(transport_packet);
+        }
+        else LOG_DEBUG(LOG_NETWORK, "Reassembled datagram payload (size %zu) passed to thread pool for TRANSPORT processing.", transport_packet->length);
+    }
+    else {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Thread pool is NULL when trying to add TRANSPORT work.\n");
+        packet_buffer_release(transport_packet);
+    }
+}
+
+// Adds a fragment of a fragmented datagram to its reassembly entry and hands the datagram to the transport
+// layer once no holes remain. Safe to call from several workers at once.
+static void network_reassemble(uint32_t src_address, uint32_t dest_address, uint16_t identification, uint8_t ip_protocol, size_t offset, const unsigned char* fragment_data, size_t fragment_payload_size, bool more_fragments) {
+    reassembly_shard_t* shard = reassembly_shard(src_address, identification, ip_protocol);
+    pthread_mutex_lock(&shard->lock);
+    uint64_t now_ms = reassembly_now_ms();
+    reassembly_expire(shard, now_ms);
+    reassembly_entry_t** link = &shard->entries;
+    while(*link != NULL && ((*link)->id != identification || (*link)->protocol != ip_protocol || (*link)->src_address != src_address)) link = &(*link)->next;
+    reassembly_entry_t* entry = *link;
+    if(entry == NULL) {
+        if(reassembly_charge(sizeof(reassembly_entry_t)) != 0) {
+            pthread_mutex_unlock(&shard->lock);
+            metrics_inc(METRIC_NW_REASSEMBLY_DROPS);
+            LOG_WARN(LOG_NETWORK, "Reassembly memory cap (%d bytes) reached. Discarding fragment ID %u.", REASSEMBLY_MEMORY_CAP, identification);
+            return;
+        }
+        entry = (reassembly_entry_t*)buffer_pool_calloc(sizeof(reassembly_entry_t));
+        if(entry == NULL) {
+            atomic_fetch_sub(&reassembly_memory, sizeof(reassembly_entry_t));
+            pthread_mutex_unlock(&shard->lock);
+            metrics_inc(METRIC_NW_REASSEMBLY_DROPS);
+            LOG_WARN(LOG_NETWORK, "Failed to allocate reassembly entry for ID %u.", identification);
+            return;
+        }
+        entry->src_address = src_address;
+        entry->id = identification;
+        entry->protocol = ip_protocol;
+        entry->holes[0] = (reassembly_hole_t){ 0, REASSEMBLY_HOLE_OPEN };
+        entry->hole_count = 1;
+        entry->deadline_ms = now_ms + REASSEMBLY_TIMEOUT * 1000;
+        entry->next = shard->entries;
+        shard->entries = entry;
+        link = &shard->entries;
+        LOG_DEBUG(LOG_NETWORK, "Started reassembly for ID %u.", identification);
+    }
+    int result = reassembly_fill(entry, offset, fragment_data, fragment_payload_size, more_fragments);
+    if(result != 0) *link = entry->next;
+    pthread_mutex_unlock(&shard->lock);
+    if(result < 0) {
+        metrics_inc(METRIC_NW_REASSEMBLY_DROPS);
+        LOG_WARN(LOG_NETWORK, "Inconsistent fragment for ID %u (Offset: %zu, Size: %zu). Discarding datagram.", identification, offset, fragment_payload_size);
+        reassembly_free_entry(entry);
+    }
+    else if(result > 0) {
+        LOG_DEBUG(LOG_NETWORK, "Reassembly complete for ID %u. Total Payload Size: %zu", identification, entry->total_payload_size);
+        // The reassembly buffer becomes the datagram's packet buffer as it is.
+        packet_buffer_t* transport_packet = packet_buffer_wrap(entry->buffer, entry->total_payload_size);
+        if(transport_packet != NULL) entry->buffer = NULL;
+        atomic_fetch_sub(&reassembly_memory, entry->capacity);
+        entry->capacity = 0;
+        reassembly_free_entry(entry);
+        if(transport_packet != NULL) network_deliver_to_transport(transport_packet, ip_protocol, src_address, dest_address);
+        else {
+            metrics_inc(METRIC_ALLOC_FAILURES);
+            LOG_WARN(LOG_NETWORK, "Failed to allocate packet buffer for reassembled ID %u.", identification);
+        }
+    }
+}
+
+// Appends in-order fragments straight to one buffer, without the reassembly table or its lock. Returns false when
+// the fragment was not taken and must be reassembled as usual.
+static bool network_gro_add(uint32_t src_address, uint32_t dest_address, uint16_t identification, uint8_t ip_protocol, size_t offset, const unsigned char* fragment_data, size_t fragment_payload_size, bool more_fragments) {
+    network_gro_t* gro = &network_gro;
+    if(gro->buffer != NULL) {
+        bool in_order = gro->src_address == src_address && gro->identification == identification && gro->protocol == ip_protocol && gro->length == offset && (!more_fragments || fragment_payload_size % 8 == 0);
+        if(!in_order) network_gro_flush();
+    }
+    if(gro->buffer == NULL) {
+        if(offset != 0 || !more_fragments || fragment_payload_size == 0 || fragment_payload_size % 8 != 0) return false;
+        gro->capacity = fragment_payload_size * 4 < NETWORK_MAX_DATAGRAM_PAYLOAD ? fragment_payload_size * 4 : NETWORK_MAX_DATAGRAM_PAYLOAD;
+        gro->buffer = (unsigned char*)buffer_pool_alloc(gro->capacity);
+        if(gro->buffer == NULL) return false;
+        gro->src_address = src_address;
+        gro->dest_address = dest_address;
+        gro->identification = identification;
+        gro->protocol = ip_protocol;
+        gro->length = 0;
+        gro->frames = 0;
+    }
+    if(gro->length + fragment_payload_size > gro->capacity) {
+        size_t capacity = gro->capacity * 2;
+        while(capacity < gro->length + fragment_payload_size) capacity *= 2;
+        if(capacity > NETWORK_MAX_DATAGRAM_PAYLOAD) capacity = NETWORK_MAX_DATAGRAM_PAYLOAD;
+        unsigned char* buffer = (unsigned char*)buffer_pool_realloc(gro->buffer, capacity);
+        if(buffer == NULL) {
+            network_gro_flush();
+            return false;
+        }
+        gro->buffer = buffer;
+        gro->capacity = capacity;
+    }
+    memcpy(gro->buffer + gro->length, fragment_data, fragment_payload_size);
+    gro->length += fragment_payload_size;
+    gro->frames++;
+    if(more_fragments) return true;
+    packet_buffer_t* transport_packet = packet_buffer_wrap(gro->buffer, gro->length);
+    if(transport_packet == NULL) {
+        metrics_inc(METRIC_ALLOC_FAILURES);
+        LOG_WARN(LOG_NETWORK, "Failed to allocate packet buffer for coalesced ID %u.", identification);
+        buffer_pool_free(gro->buffer);
+        gro->buffer = NULL;
+        return true;
+    }
+    gro->buffer = NULL;
+    metrics_add(METRIC_NW_GRO_COALESCED, gro->frames);
+    LOG_DEBUG(LOG_NETWORK, "Coalesced ID %u from %zu in-order fragments (%zu bytes).", identification, gro->frames, transport_packet->length);
+    network_deliver_to_transport(transport_packet, ip_protocol, src_address, dest_address);
+    return true;
+}
+
+void network_gro_flush() {
+    network_gro_t* gro = &network_gro;
+    if(gro->buffer == NULL) return;
+    unsigned char* buffer = gro->buffer;
+    gro->buffer = NULL;
+    LOG_DEBUG(LOG_NETWORK, "Flushing %zu coalesced bytes of ID %u to reassembly.", gro->length, gro->identification);
+    network_reassemble(gro->src_address, gro->dest_address, gro->identification, gro->protocol, 0, buffer, gro->length, true);
+    buffer_pool_free(buffer);
+}
+
+// Every fragment of every datagram of a flow carries the same hash, so the receiver keeps the flow on one worker.
+// UDP and reliable flows are identified by their ports, which both headers start with; anything else falls
+// back to the packet id.
+static uint32_t network_flow_hash(const packet_buffer_t* transport_packet, uint8_t protocol_type, uint16_t packet_id) {
+    uint32_t key = packet_id;
+    if((protocol_type == UDP_PROTOCOL_NUMBER && transport_packet->length >= sizeof(simple_udp_header_t)) || (protocol_type == RELIABLE_PROTOCOL_NUMBER && transport_packet->length >= sizeof(reliable_header_t))) {
+        const simple_udp_header_t* udp_header = (const simple_udp_header_t*)transport_packet->data;
+        key = ((uint32_t)udp_header->src_port << 16) | udp_header->dest_port;
+    }
+    key ^= (uint32_t)protocol_type * 0x9E3779B1u;
+    key ^= key >> 16;
+    key *= 0x85EBCA6Bu;
+    key ^= key >> 13;
+    key *= 0xC2B2AE35u;
+    key ^= key >> 16;
+    return key;
+}
+
+int network_address_parse(const char* text, uint32_t* address) {
+    struct in_addr parsed;
+    if(text == NULL || inet_pton(AF_INET, text, &parsed) != 1) return -1;
+    *address = ntohl(parsed.s_addr);
+    return 0;
+}
+
+int network_prefix_parse(const char* text, uint32_t* prefix, uint8_t* prefix_length) {
+    char address_text[NETWORK_ADDRESS_STRING_SIZE];
+    const char* slash = text != NULL ? strchr(text, '/') : NULL;
+    if(slash == NULL || (size_t)(slash - text) >= sizeof(address_text)) return -1;
+    memcpy(address_text, text, (size_t)(slash - text));
+    address_text[slash - text] = '\0';
+    char* end = NULL;
+    unsigned long length = strtoul(slash + 1, &end, 10);
+    if(end == slash + 1 || *end != '\0' || length > 32 || network_address_parse(address_text, prefix) != 0) return -1;
+    *prefix_length = (uint8_t)length;
+    return 0;
+}
+
+const char* network_address_format(uint32_t address, char* text, size_t text_size) {
+    struct in_addr formatted = { .s_addr = htonl(address) };
+    if(inet_ntop(AF_INET, &formatted, text, (socklen_t)text_size) == NULL) snprintf(text, text_size, "?");
+    return text;
+}
+
+static uint8_t network_route_find(uint32_t address) {
+    uint8_t best = atomic_load_explicit(&network_default_hop, memory_order_acquire);
+    const network_trie_node_t* node = &network_trie_root;
+    for(int shift = 32 - NETWORK_TRIE_STRIDE; node != NULL && shift >= 0; shift -= NETWORK_TRIE_STRIDE) {
+        uint32_t index = (address >> shift) & ((1u << NETWORK_TRIE_STRIDE) - 1);
+        uint8_t hop = atomic_load_explicit(&node->next_hop[index], memory_order_acquire);
+        if(hop != 0) best = hop; // Deeper levels hold longer prefixes
+        node = atomic_load_explicit(&node->child[index], memory_order_acquire);
+    }
+    return best;
+}
+
+const char* network_route_lookup(uint32_t address) {
+    uint8_t hop = network_route_find(address);
+    return hop != 0 ? network_next_hops[hop] : NULL;
+}
+
+int network_route_add(uint32_t prefix, uint8_t prefix_length, const char* next_hop_mac) {
+    char prefix_text[NETWORK_ADDRESS_STRING_SIZE];
+    network_address_format(prefix, prefix_text, sizeof(prefix_text));
+    uint32_t mask = prefix_length == 0 ? 0 : 0xFFFFFFFFu << (32 - prefix_length);
+    if(prefix_length > 32 || (prefix & ~mask) != 0) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Invalid route prefix %s/%u.\n", prefix_text, prefix_length);
+        return -1;
+    }
+    if(next_hop_mac == NULL || next_hop_mac[0] == '\0' || strlen(next_hop_mac) >= PHYSICAL_MAC_SIZE) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Invalid next hop for route %s/%u.\n", prefix_text, prefix_length);
+        return -1;
+    }
+    pthread_mutex_lock(&network_routes_lock);
+    size_t hop = 1;
+    while (hop < network_next_hop_count && strcmp(network_next_hops[hop], next_hop_mac) != 0) hop++;
+    if(hop == NETWORK_MAX_NEXT_HOPS) {
+        pthread_mutex_unlock(&network_routes_lock);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: No room for next hop %s (%d at most).\n", next_hop_mac, NETWORK_MAX_NEXT_HOPS - 1);
+        return -1;
+    }
+    if(hop == network_next_hop_count) {
+        snprintf(network_next_hops[hop], PHYSICAL_MAC_SIZE, "%s", next_hop_mac);
+        network_next_hop_count++;
+    }
+    if(prefix_length == 0) atomic_store_explicit(&network_default_hop, (uint8_t)hop, memory_order_release);
+    else {
+        network_trie_node_t* node = &network_trie_root;
+        int shift = 32 - NETWORK_TRIE_STRIDE;
+        // Descend to the level the prefix ends in, adding the nodes on the way.
+        for(int level_end = NETWORK_TRIE_STRIDE; prefix_length > level_end; level_end += NETWORK_TRIE_STRIDE, shift -= NETWORK_TRIE_STRIDE) {
+            uint32_t index = (prefix >> shift) & ((1u << NETWORK_TRIE_STRIDE) - 1);
+            network_trie_node_t* child = atomic_load_explicit(&node->child[index], memory_order_relaxed);
+            if(child == NULL) {
+                child = (network_trie_node_t*)calloc(1, sizeof(network_trie_node_t));
+                if(child == NULL) {
+                    pthread_mutex_unlock(&network_routes_lock);
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Failed to allocate a trie node for route %s/%u.\n", prefix_text, prefix_length);
+                    return -1;
+                }
+                atomic_store_explicit(&node->child[index], child, memory_order_release);
+            }
+            node = child;
+        }
+        uint32_t first = (prefix >> shift) & ((1u << NETWORK_TRIE_STRIDE) - 1);
+        uint32_t count = 1u << (32 - shift - prefix_length);
+        for(uint32_t index = first; index < first + count; index++) {
+            if(node->prefix_length[index] > prefix_length) continue; // A longer route of this level already covers it
+            node->prefix_length[index] = prefix_length;
+            atomic_store_explicit(&node->next_hop[index], (uint8_t)hop, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&network_routes_lock);
+    LOG_INFO(LOG_NETWORK, "Route %s/%u via %s.", prefix_text, prefix_length, next_hop_mac);
+    return 0;
+}
+
+static void network_trie_free(network_trie_node_t* node, bool is_root) {
+    for(size_t i = 0; i < (1u << NETWORK_TRIE_STRIDE); i++) {
+        network_trie_node_t* child = atomic_load_explicit(&node->child[i], memory_order_relaxed);
+        if(child != NULL) network_trie_free(child, false);
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Network Layer Shutdown complete.\n");
+    if(is_root) memset(&network_trie_root, 0, sizeof(network_trie_root));
+    else free(node);
+}
+
+static bool network_is_local(uint32_t dest_address) {
+    return network_local_address == 0 || dest_address == network_local_address || dest_address == 0 || dest_address == NETWORK_BROADCAST_ADDRESS;
 }
 
-void clear_reassembly_buffer() {
-    if(current_reassembly.in_use) {
-        free(current_reassembly.buffer);
-        current_reassembly.buffer = NULL;
-        current_reassembly.in_use = false;
-        if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Reassembly buffer cleared.\n");
+// Sends a datagram that is not for this instance on towards its destination, fragment by fragment and without
+// reassembling it. The frame's buffer goes back out as it is, with only the TTL and header checksum changed.
+static void network_forward(packet_buffer_t* packet, simple_ip_header_t* ip_header, uint32_t flow_hash) {
+    char destination_text[NETWORK_ADDRESS_STRING_SIZE];
+    // The forwarded frame is not traced on into the send stages.
+    if(latency_tracing) latency_thread_trace.origin_ns = 0;
+    if(ip_header->ttl <= 1) {
+        metrics_inc(METRIC_NW_TTL_EXPIRED);
+        LOG_DEBUG(LOG_NETWORK, "TTL of datagram ID %u to %s expired. Discarding fragment.", ip_header->identification, network_address_format(ip_header->dest_ip, destination_text, sizeof(destination_text)));
+        packet_buffer_release(packet);
+        return;
+    }
+    const char* next_hop = network_route_lookup(ip_header->dest_ip);
+    if(next_hop == NULL) {
+        metrics_inc(METRIC_NW_NO_ROUTE);
+        LOG_DEBUG(LOG_NETWORK, "No route to %s. Discarding fragment.", network_address_format(ip_header->dest_ip, destination_text, sizeof(destination_text)));
+        packet_buffer_release(packet);
+        return;
     }
+    // The TTL shares a 16-bit word with the protocol.
+    uint16_t old_word, new_word;
+    memcpy(&old_word, &ip_header->protocol, sizeof(old_word));
+    ip_header->ttl--;
+    memcpy(&new_word, &ip_header->protocol, sizeof(new_word));
+    ip_header->header_checksum = internet_checksum_update16(ip_header->header_checksum, old_word, new_word);
+    size_t length = ip_header->total_length;
+    packet_buffer_trim(packet, length);
+    // A full next hop drops the frame, as a router's output queue would, rather than holding up this receive worker.
+    physical_send_no_wait = true;
+    int sent = handle_data_link_to_physical_batch(0x0800, &packet, 1, flow_hash, next_hop);
+    physical_send_no_wait = false;
+    if(sent != 0) {
+        metrics_inc(METRIC_NW_FORWARD_DROPS);
+        LOG_DEBUG(LOG_NETWORK, "Failed to forward datagram ID %u to %s.", ip_header->identification, next_hop);
+    }
+    else {
+        metrics_inc(METRIC_NW_FORWARDED);
+        metrics_add(METRIC_NW_BYTES_FORWARDED, length);
+        LOG_DEBUG(LOG_NETWORK, "Forwarded datagram ID %u (%zu bytes) to %s.", ip_header->identification, length, next_hop);
+    }
+    packet_buffer_release(packet);
 }
 
+void network_layer_init() {
+    LOG_INFO(LOG_NETWORK, "Initializing Network Layer...");
+    srand(time(NULL));
+    atomic_store(&next_packet_id, (uint16_t)(rand() % 65535));
+    for(int i = 0; i < REASSEMBLY_SHARDS; i++) {
+        pthread_mutex_init(&reassembly_shards[i].lock, NULL);
+        reassembly_shards[i].entries = NULL;
+    }
+    char address_text[NETWORK_ADDRESS_STRING_SIZE];
+    if(network_local_address != 0) LOG_INFO(LOG_NETWORK, "Address %s; datagrams to other addresses are forwarded.", network_address_format(network_local_address, address_text, sizeof(address_text)));
+    if(atomic_load(&network_default_hop) == 0 && destination_mac_address[0] != '\0') network_route_add(0, 0, destination_mac_address);
+    LOG_INFO(LOG_NETWORK, "Network Layer Initialized.");
+}
+
+void network_layer_shutdown() {
+    LOG_INFO(LOG_NETWORK, "Shutting down Network Layer...");
+    for(int i = 0; i < REASSEMBLY_SHARDS; i++) {
+        pthread_mutex_lock(&reassembly_shards[i].lock);
+        while(reassembly_shards[i].entries != NULL) {
+            reassembly_entry_t* entry = reassembly_shards[i].entries;
+            reassembly_shards[i].entries = entry->next;
+            reassembly_free_entry(entry);
+        }
+        pthread_mutex_unlock(&reassembly_shards[i].lock);
+        pthread_mutex_destroy(&reassembly_shards[i].lock);
+    }
+    LOG_INFO(LOG_NETWORK, "Cleared reassembly table.");
+    pthread_mutex_lock(&network_routes_lock);
+    network_trie_free(&network_trie_root, true);
+    atomic_store(&network_default_hop, 0);
+    network_next_hop_count = 1;
+    pthread_mutex_unlock(&network_routes_lock);
+    LOG_INFO(LOG_NETWORK, "Network Layer Shutdown complete.");
+}
+
+// Takes ownership of the frame's packet buffer. A datagram for another address is forwarded as it is. An unfragmented
+// datagram for us is passed on in the same buffer with the link and IP headers pulled off; fragments are copied into
+// their reassembly buffer.
 void handle_data_link_to_network(void* dl_payload) {
     if(dl_payload == NULL) {
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Received NULL data pointer from data link layer.\n");
         return;
     }
-    unsigned char* data = (unsigned char*)dl_payload;
+    LATENCY_MARK(LATENCY_RX_QUEUE_NETWORK);
+    metrics_inc(METRIC_NW_FRAGMENTS_RECEIVED);
+    packet_buffer_t* packet = (packet_buffer_t*)dl_payload;
+    uint32_t flow_hash = ((const data_link_receive_control_t*)packet->control)->flow_hash;
     size_t header_size = sizeof(simple_ip_header_t);
-    unsigned char* network_pdu = data + PROTOCOL_SIZE;
-    simple_ip_header_t* ip_header = (simple_ip_header_t*)network_pdu;
+    if(packet_buffer_pull(packet, PROTOCOL_SIZE) == NULL || packet->length < header_size) {
+        metrics_inc(METRIC_NW_MALFORMED);
+        LOG_WARN(LOG_NETWORK, "Frame payload too short for an IP header (%zu bytes). Discarding fragment.", packet->length);
+        packet_buffer_release(packet);
+        return;
+    }
+    simple_ip_header_t* ip_header = (simple_ip_header_t*)packet->data;
     uint16_t received_checksum = ip_header->header_checksum;
     ip_header->header_checksum = 0;
     uint16_t calculated_checksum = calculate_internet_checksum(ip_header, header_size);
     ip_header->header_checksum = received_checksum;
     if(calculated_checksum != received_checksum) {
-        if(DEBUG_ENABLED) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: IP Header Checksum mismatch! Received=0x%04X, Calculated=0x%04X. Discarding fragment.\n", received_checksum, calculated_checksum);
-        free(dl_payload);
+        metrics_inc(METRIC_NW_CHECKSUM_FAILURES);
+        LOG_WARN(LOG_NETWORK, "IP Header Checksum mismatch! Received=0x%04X, Calculated=0x%04X. Discarding fragment.", received_checksum, calculated_checksum);
+        packet_buffer_release(packet);
         return;
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: IP Header Checksum OK (0x%04X).\n", received_checksum);
+    LOG_DEBUG(LOG_NETWORK, "IP Header Checksum OK (0x%04X).", received_checksum);
     size_t fragment_total_length_from_header = ip_header->total_length;
     size_t fragment_payload_size;
-    if(fragment_total_length_from_header >= header_size) fragment_payload_size = fragment_total_length_from_header - header_size;
+    if(fragment_total_length_from_header >= header_size && fragment_total_length_from_header <= packet->length) fragment_payload_size = fragment_total_length_from_header - header_size;
     else {
-        if(DEBUG_ENABLED) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Fragment IP header total_length (%zu) < header size (%zu). Discarding fragment.\n", fragment_total_length_from_header, header_size);
-        free(dl_payload);
+        metrics_inc(METRIC_NW_MALFORMED);
+        LOG_WARN(LOG_NETWORK, "Fragment IP header total_length (%zu) outside header size (%zu) to frame payload (%zu). Discarding fragment.", fragment_total_length_from_header, header_size, packet->length);
+        packet_buffer_release(packet);
         return;
     }
+    if(!network_is_local(ip_header->dest_ip)) {
+        network_forward(packet, ip_header, flow_hash);
+        return;
+    }
+    uint32_t src_address = ip_header->src_ip;
+    uint32_t dest_address = ip_header->dest_ip;
     uint16_t identification = ip_header->identification;
     uint16_t flags_offset = ip_header->flags_fragment_offset;
     uint16_t fragment_offset_bytes = (flags_offset & IP_OFFSET_MASK) * 8;
     bool more_fragments = (flags_offset & IP_FLAG_MF) != 0;
     uint8_t ip_protocol = ip_header->protocol;
-    unsigned char* fragment_data = network_pdu + header_size;
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Processing fragment. ID: %u, Offset: %u bytes, MF: %s, Proto: %d, FragPayloadSize: %zu\n", identification, fragment_offset_bytes, more_fragments ? "Yes" : "No", ip_protocol, fragment_payload_size);
-    if(current_reassembly.in_use && (time(NULL) - current_reassembly.last_fragment_time > REASSEMBLY_TIMEOUT)) {
-        if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Reassembly timeout for ID %u. Discarding.\n", current_reassembly.id);
-        clear_reassembly_buffer();
-    }
-    if(fragment_offset_bytes == 0) {
-        if(current_reassembly.in_use) {
-            if(current_reassembly.id != identification && DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Received new first fragment ID %u while assembling ID %u. Discarding old.\n", identification, current_reassembly.id);
-            else if(current_reassembly.id == identification && DEBUG_ENABLED) printf("NETWORK Warning: Received duplicate first fragment for ID %u. Resetting assembly.\n", identification);
-            clear_reassembly_buffer();
-        }
-        if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: First fragment for ID %u detected.\n", identification);
-        if(!more_fragments) current_reassembly.total_payload_size = fragment_payload_size;
-        else {
-            if(DEBUG_ENABLED) printf("NETWORK Error: First fragment has MF=1, simple reassembly logic cannot handle fragmentation. Discarding.\n");
-            free(dl_payload);
-            return;
-        }
-        if(current_reassembly.total_payload_size > 66000) {
-            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Unrealistic total payload size %zu estimated from first fragment.\n", current_reassembly.total_payload_size);
-            free(dl_payload);
-            return;
-        }
-        if(current_reassembly.total_payload_size == 0) current_reassembly.buffer = NULL;
-        else {
-            current_reassembly.buffer = (unsigned char*)malloc(current_reassembly.total_payload_size);
-            if(current_reassembly.buffer == NULL) {
-                fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Failed to allocate reassembly buffer (size %zu).\n", current_reassembly.total_payload_size);
-                free(dl_payload);
-                return;
-            }
-            memset(current_reassembly.buffer, 0, current_reassembly.total_payload_size);
-        }
-        current_reassembly.id = identification;
-        current_reassembly.protocol = ip_protocol;
-        current_reassembly.received_size = 0;
-        current_reassembly.last_fragment_time = time(NULL);
-        current_reassembly.in_use = true;
-        if(fragment_payload_size > 0) {
-            if(current_reassembly.buffer != NULL && fragment_payload_size <= current_reassembly.total_payload_size) {
-                memcpy(current_reassembly.buffer + fragment_offset_bytes, fragment_data, fragment_payload_size);
-                current_reassembly.received_size += fragment_payload_size;
-                if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Copied first fragment data. Received: %zu / %zu\n", current_reassembly.received_size, current_reassembly.total_payload_size);
-            }
-            else {
-                if(DEBUG_ENABLED) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Buffer/size mismatch when copying first fragment data (%p, %zu <= %zu).\n", current_reassembly.buffer, fragment_payload_size, current_reassembly.total_payload_size);
-                clear_reassembly_buffer();
-                free(dl_payload);
-                return;
-            }
-        }
-        else {
-                current_reassembly.received_size = 0;
-                if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: First fragment has 0 payload size. Received: %zu / %zu\n", current_reassembly.received_size, current_reassembly.total_payload_size);
-        }
+    packet_buffer_pull(packet, header_size);
+    packet_buffer_trim(packet, fragment_payload_size);
+    LOG_DEBUG(LOG_NETWORK, "Processing fragment. ID: %u, Offset: %u bytes, MF: %s, Proto: %d, FragPayloadSize: %zu", identification, fragment_offset_bytes, more_fragments ? "Yes" : "No", ip_protocol, fragment_payload_size);
+    if(fragment_offset_bytes + fragment_payload_size > NETWORK_MAX_DATAGRAM_PAYLOAD) {
+        metrics_inc(METRIC_NW_MALFORMED);
+        LOG_WARN(LOG_NETWORK, "Fragment ID %u ends past the maximum datagram payload (%d). Discarding fragment.", identification, NETWORK_MAX_DATAGRAM_PAYLOAD);
+        packet_buffer_release(packet);
+        return;
     }
-    else {
-        if(DEBUG_ENABLED) printf("NETWORK Error: Received subsequent fragment (Offset > 0), but simple reassembly logic cannot handle fragmentation. Discarding fragment ID %u.\n", identification);
-        free(dl_payload);
+    if(fragment_offset_bytes == 0 && !more_fragments) {
+        // Unfragmented datagram: no reassembly state and no copy needed.
+        if(fragment_payload_size == 0) LOG_DEBUG(LOG_NETWORK, "Reassembled datagram has 0 payload size.");
+        network_deliver_to_transport(packet, ip_protocol, src_address, dest_address);
         return;
     }
-    if(current_reassembly.in_use && current_reassembly.id == identification) {
-        if(!more_fragments && current_reassembly.received_size >= current_reassembly.total_payload_size) {
-            if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Reassembly complete for non-fragmented packet ID %u. Total Payload Size: %zu\n", identification, current_reassembly.total_payload_size);
-            unsigned char* transport_payload = NULL;
-            if(current_reassembly.total_payload_size > 0) {
-                transport_payload = (unsigned char*)malloc(current_reassembly.total_payload_size);
-                if(transport_payload) memcpy(transport_payload, current_reassembly.buffer, current_reassembly.total_payload_size);
-                else {
-                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Failed to allocate memory for final transport payload.\n");
-                    clear_reassembly_buffer();
-                    free(dl_payload);
-                    return;
-                }
-            }
-            else {
-                transport_payload = NULL;
-                if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Reassembled datagram has 0 payload size.\n");
-            }
-            if(thpool != NULL) {
-                if(thpool_add_work(thpool, (void (*)(void*))handle_network_to_transport, transport_payload) != 0) {
-                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Failed to add task to thread pool for Transport Layer.\n");
-                    free(transport_payload);
-                } else if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Reassembled datagram payload (size %zu) passed to thread pool for TRANSPORT processing.\n", current_reassembly.total_payload_size);
-            }
-            else {
-                fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Thread pool is NULL when trying to add TRANSPORT work.\n");
-                free(transport_payload);
-            }
-            clear_reassembly_buffer();
-        }
+    // A run-to-completion worker sees every fragment of a flow, in the order they were sent, so it can coalesce
+    // them as they come. Pipeline tasks land on any thread and are left to the reassembly table.
+    if(!(network_offload && rx_mode == RX_MODE_RUN_TO_COMPLETION && network_gro_add(src_address, dest_address, identification, ip_protocol, fragment_offset_bytes, packet->data, fragment_payload_size, more_fragments))) {
+        network_reassemble(src_address, dest_address, identification, ip_protocol, fragment_offset_bytes, packet->data, fragment_payload_size, more_fragments);
     }
-    free(dl_payload);
+    packet_buffer_release(packet);
 }
 
-int handle_transport_to_network(const unsigned char* transport_data, size_t transport_data_length, uint8_t protocol_type) {
-    if(transport_data == NULL && transport_data_length > 0) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Send request from transport with NULL data but positive length (%zu).\n", transport_data_length);
+// Turns a copy of the header template into the header of the fragment at offset.
+static void network_gso_fix_header(void* header, size_t offset, size_t length, bool is_last) {
+    simple_ip_header_t* ip_header = (simple_ip_header_t*)header;
+    uint16_t flags_offset_field = (uint16_t)(offset / 8);
+    if(!is_last) flags_offset_field |= IP_FLAG_MF;
+    ip_header->total_length = (uint16_t)(sizeof(simple_ip_header_t) + length);
+    ip_header->flags_fragment_offset = flags_offset_field;
+    ip_header->header_checksum = internet_checksum_update16(ip_header->header_checksum, 0, ip_header->total_length);
+    ip_header->header_checksum = internet_checksum_update16(ip_header->header_checksum, 0, flags_offset_field);
+}
+
+// Prepends the IP header in place when the datagram fits one frame. Otherwise, with offload on, the datagram goes
+// down whole with a header template; without it every fragment is a slice that references its part of the
+// datagram and carries its own IP header. Either way payload bytes are never copied here.
+int handle_transport_to_network(packet_buffer_t* transport_packet, uint8_t protocol_type, uint32_t dest_address) {
+    if(transport_packet == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Send request from transport with NULL packet.\n");
         return -1;
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Received %zu bytes from Transport layer (Proto: %d) for sending.\n", transport_data_length, protocol_type);
+    LATENCY_MARK(LATENCY_TX_TRANSPORT);
+    size_t transport_data_length = packet_buffer_length(transport_packet);
+    LOG_DEBUG(LOG_NETWORK, "Received %zu bytes from Transport layer (Proto: %d) for sending.", transport_data_length, protocol_type);
     size_t ip_header_size = sizeof(simple_ip_header_t);
-    size_t max_payload_per_fragment = MAX_INFO_SIZE - ip_header_size;
+    size_t max_payload_per_fragment = data_link_mtu - ip_header_size;
     if(max_payload_per_fragment % 8 != 0 && max_payload_per_fragment >= 8) max_payload_per_fragment -= (max_payload_per_fragment % 8);
     else if(max_payload_per_fragment < 8) {
         if(transport_data_length > 0) {
@@ -218,43 +660,92 @@ int handle_transport_to_network(const unsigned char* transport_data, size_t tran
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Network header size >= Data Link MTU. Cannot fragment or send payload.\n");
         return -1;
     }
-    uint16_t current_packet_id = next_packet_id++;
+    if(transport_data_length > NETWORK_MAX_DATAGRAM_PAYLOAD) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Transport data length (%zu) exceeds maximum datagram payload (%d).\n", transport_data_length, NETWORK_MAX_DATAGRAM_PAYLOAD);
+        return -1;
+    }
+    const char* next_hop = network_route_lookup(dest_address);
+    if(next_hop == NULL) {
+        char destination_text[NETWORK_ADDRESS_STRING_SIZE];
+        metrics_inc(METRIC_NW_NO_ROUTE);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: No route to %s.\n", network_address_format(dest_address, destination_text, sizeof(destination_text)));
+        return -1;
+    }
+    uint16_t current_packet_id = atomic_fetch_add(&next_packet_id, 1);
+    uint32_t flow_hash = network_flow_hash(transport_packet, protocol_type, current_packet_id);
     bool needs_fragmentation = (transport_data_length > max_payload_per_fragment);
     if(transport_data_length == 0) needs_fragmentation = false;
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Sending Packet ID: %u. Needs Fragmentation: %s. Max payload/frag: %zu\n", current_packet_id, needs_fragmentation ? "Yes" : "No", max_payload_per_fragment);
+    LOG_DEBUG(LOG_NETWORK, "Sending Packet ID: %u. Needs Fragmentation: %s. Max payload/frag: %zu", current_packet_id, needs_fragmentation ? "Yes" : "No", max_payload_per_fragment);
+    size_t fragment_count = needs_fragmentation ? (transport_data_length + max_payload_per_fragment - 1) / max_payload_per_fragment : 1;
+    // Only total_length and flags_fragment_offset differ between fragments, so the header checksum is computed once
+    // over a zeroed template and then patched per fragment (RFC 1624) instead of being recomputed.
+    simple_ip_header_t header_template;
+    memset(&header_template, 0, sizeof(header_template));
+    header_template.identification = current_packet_id;
+    header_template.protocol = protocol_type;
+    header_template.ttl = NETWORK_DEFAULT_TTL;
+    header_template.src_ip = network_local_address;
+    header_template.dest_ip = dest_address;
+    header_template.header_checksum = calculate_internet_checksum(&header_template, ip_header_size);
+    if(needs_fragmentation && network_offload) {
+        // The datagram goes down whole; the data link cuts it up as it writes the frames.
+        data_link_gso_t gso = { .payload = transport_packet, .header = &header_template, .header_size = ip_header_size, .segment_size = max_payload_per_fragment, .fix_header = network_gso_fix_header };
+        if(handle_data_link_to_physical_gso(0x0800, &gso, flow_hash, next_hop) != 0) {
+            LOG_WARN(LOG_NETWORK, "Data link layer failed to send fragments.");
+            return -1;
+        }
+        metrics_inc(METRIC_NW_PACKETS_SENT);
+        metrics_inc(METRIC_NW_GSO_DATAGRAMS);
+        metrics_add(METRIC_NW_FRAGMENTS_SENT, fragment_count);
+        metrics_add(METRIC_NW_BYTES_SENT, transport_data_length);
+        LOG_DEBUG(LOG_NETWORK, "Handed Packet ID %u down as %zu fragments.", current_packet_id, fragment_count);
+        return 0;
+    }
+    packet_buffer_t** fragments = (packet_buffer_t**)buffer_pool_calloc(fragment_count * sizeof(packet_buffer_t*));
+    if(!fragments) {
+        LOG_WARN(LOG_NETWORK, "Failed to allocate memory for %zu fragment buffers.", fragment_count);
+        return -1;
+    }
     size_t bytes_sent = 0;
     uint16_t fragment_offset_units = 0;
-    do {
+    int result = 0;
+    for(size_t fragment_index = 0; fragment_index < fragment_count; fragment_index++) {
         size_t current_payload_size = transport_data_length - bytes_sent;
         if(current_payload_size > max_payload_per_fragment) current_payload_size = max_payload_per_fragment;
         bool is_last_fragment = (bytes_sent + current_payload_size == transport_data_length);
         size_t fragment_total_size = ip_header_size + current_payload_size;
-        unsigned char* fragment_buffer = (unsigned char*)malloc(fragment_total_size);
-        if(!fragment_buffer) {
-            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Failed to allocate memory for fragment buffer.\n");
-            return -1;
+        packet_buffer_t* fragment = transport_packet;
+        if(needs_fragmentation) fragment = packet_buffer_slice(transport_packet, bytes_sent, current_payload_size, PACKET_BUFFER_DEFAULT_HEADROOM);
+        else packet_buffer_ref(fragment);
+        simple_ip_header_t* ip_header = fragment != NULL ? (simple_ip_header_t*)packet_buffer_push(fragment, ip_header_size) : NULL;
+        fragments[fragment_index] = fragment;
+        if(ip_header == NULL) {
+            LOG_WARN(LOG_NETWORK, "Failed to prepare fragment %zu of Packet ID %u.", fragment_index, current_packet_id);
+            result = -1;
+            break;
         }
-        simple_ip_header_t* ip_header = (simple_ip_header_t*)fragment_buffer;
-        ip_header->total_length = fragment_total_size;
-        ip_header->identification = current_packet_id;
-        ip_header->protocol = protocol_type;
         uint16_t flags_offset_field = fragment_offset_units;
         if(needs_fragmentation && !is_last_fragment) flags_offset_field |= IP_FLAG_MF;
+        memcpy(ip_header, &header_template, ip_header_size);
+        ip_header->total_length = fragment_total_size;
         ip_header->flags_fragment_offset = flags_offset_field;
-        ip_header->header_checksum = 0;
-        ip_header->header_checksum = calculate_internet_checksum(ip_header, ip_header_size);
-        if(current_payload_size > 0) memcpy(fragment_buffer + ip_header_size, transport_data + bytes_sent, current_payload_size);
-        if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Sending Fragment: ID=%u, Offset=%u (bytes), Hdr+Payload Size=%zu, MF=%s, Checksum=0x%04X\n", current_packet_id, fragment_offset_units * 8, fragment_total_size, (flags_offset_field & IP_FLAG_MF) ? "Yes" : "No", ip_header->header_checksum);
-        uint16_t dl_protocol = 0x0800;
-        if(handle_data_link_to_physical(dl_protocol, fragment_buffer, fragment_total_size) != 0) {
-            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "NETWORK Error: Data link layer failed to send fragment.\n");
-            free(fragment_buffer);
-            return -1;
-        }
-        free(fragment_buffer);
+        ip_header->header_checksum = internet_checksum_update16(ip_header->header_checksum, 0, ip_header->total_length);
+        ip_header->header_checksum = internet_checksum_update16(ip_header->header_checksum, 0, flags_offset_field);
+        LOG_DEBUG(LOG_NETWORK, "Sending Fragment: ID=%u, Offset=%u (bytes), Hdr+Payload Size=%zu, MF=%s, Checksum=0x%04X", current_packet_id, fragment_offset_units * 8, fragment_total_size, (flags_offset_field & IP_FLAG_MF) ? "Yes" : "No", ip_header->header_checksum);
         bytes_sent += current_payload_size;
         if(current_payload_size > 0) fragment_offset_units += (current_payload_size / 8);
-    } while (bytes_sent < transport_data_length);
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_YELLOW "NETWORK: Finished sending all fragments for Packet ID %u.\n", current_packet_id);
+    }
+    uint16_t dl_protocol = 0x0800;
+    if(result == 0 && handle_data_link_to_physical_batch(dl_protocol, fragments, fragment_count, flow_hash, next_hop) != 0) {
+        LOG_WARN(LOG_NETWORK, "Data link layer failed to send fragments.");
+        result = -1;
+    }
+    for(size_t fragment_index = 0; fragment_index < fragment_count; fragment_index++) packet_buffer_release(fragments[fragment_index]);
+    buffer_pool_free(fragments);
+    if(result != 0) return -1;
+    metrics_inc(METRIC_NW_PACKETS_SENT);
+    metrics_add(METRIC_NW_FRAGMENTS_SENT, fragment_count);
+    metrics_add(METRIC_NW_BYTES_SENT, transport_data_length);
+    LOG_DEBUG(LOG_NETWORK, "Finished sending all fragments for Packet ID %u.", current_packet_id);
     return 0;
 }
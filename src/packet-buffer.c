@@ -0,0 +1,114 @@
+#include "headers/packet-buffer.h"
+#include "headers/buffer-pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(sizeof(packet_buffer_t) + PACKET_BUFFER_DEFAULT_HEADROOM <= BUFFER_POOL_SMALLEST_CLASS, "A header-only packet buffer must fit the smallest pool class");
+
+packet_buffer_t* packet_buffer_alloc(size_t headroom, size_t tailroom) {
+    packet_buffer_t* buffer = (packet_buffer_t*)buffer_pool_alloc(sizeof(packet_buffer_t) + headroom + tailroom);
+    if(buffer == NULL) return NULL;
+    atomic_init(&buffer->refcount, 1);
+    buffer->data = buffer->storage + headroom;
+    buffer->length = 0;
+    buffer->headroom = headroom;
+    buffer->tailroom = tailroom;
+    buffer->frag_count = 0;
+    buffer->external = NULL;
+    return buffer;
+}
+
+packet_buffer_t* packet_buffer_wrap(void* block, size_t length) {
+    packet_buffer_t* buffer = packet_buffer_alloc(0, 0);
+    if(buffer == NULL) return NULL;
+    buffer->external = block;
+    buffer->data = (unsigned char*)block;
+    buffer->length = length;
+    return buffer;
+}
+
+void packet_buffer_ref(packet_buffer_t* buffer) {
+    atomic_fetch_add_explicit(&buffer->refcount, 1, memory_order_relaxed);
+}
+
+void packet_buffer_release(packet_buffer_t* buffer) {
+    if(buffer == NULL) return;
+    if(atomic_fetch_sub_explicit(&buffer->refcount, 1, memory_order_acq_rel) != 1) return;
+    for(size_t i = 0; i < buffer->frag_count; i++) packet_buffer_release(buffer->frags[i].owner);
+    buffer_pool_free(buffer->external);
+    buffer_pool_free(buffer);
+}
+
+unsigned char* packet_buffer_push(packet_buffer_t* buffer, size_t length) {
+    if(length > buffer->headroom) return NULL;
+    buffer->headroom -= length;
+    buffer->data -= length;
+    buffer->length += length;
+    return buffer->data;
+}
+
+unsigned char* packet_buffer_pull(packet_buffer_t* buffer, size_t length) {
+    if(length > buffer->length) return NULL;
+    unsigned char* pulled = buffer->data;
+    buffer->headroom += length;
+    buffer->data += length;
+    buffer->length -= length;
+    return pulled;
+}
+
+unsigned char* packet_buffer_put(packet_buffer_t* buffer, size_t length) {
+    // Linear bytes always precede the fragments.
+    if(length > buffer->tailroom || buffer->frag_count > 0) return NULL;
+    unsigned char* tail = buffer->data + buffer->length;
+    buffer->tailroom -= length;
+    buffer->length += length;
+    return tail;
+}
+
+int packet_buffer_trim(packet_buffer_t* buffer, size_t length) {
+    if(length > buffer->length || buffer->frag_count > 0) return -1;
+    buffer->tailroom += buffer->length - length;
+    buffer->length = length;
+    return 0;
+}
+
+int packet_buffer_attach(packet_buffer_t* buffer, const unsigned char* data, size_t length, packet_buffer_t* owner) {
+    if(buffer->frag_count >= PACKET_BUFFER_MAX_FRAGS) return -1;
+    if(owner != NULL) packet_buffer_ref(owner);
+    buffer->frags[buffer->frag_count++] = (packet_buffer_frag_t){ .data = data, .length = length, .owner = owner };
+    return 0;
+}
+
+size_t packet_buffer_length(const packet_buffer_t* buffer) {
+    size_t length = buffer->length;
+    for(size_t i = 0; i < buffer->frag_count; i++) length += buffer->frags[i].length;
+    return length;
+}
+
+packet_buffer_t* packet_buffer_slice(packet_buffer_t* buffer, size_t offset, size_t length, size_t headroom) {
+    packet_buffer_t* slice = packet_buffer_alloc(headroom, 0);
+    if(slice == NULL) return NULL;
+    // Walk the linear bytes and then each fragment, referencing whatever part of them overlaps the range.
+    size_t segment_start = 0;
+    for(size_t i = 0; i <= buffer->frag_count && length > 0; i++) {
+        const unsigned char* segment = i == 0 ? buffer->data : buffer->frags[i - 1].data;
+        size_t segment_length = i == 0 ? buffer->length : buffer->frags[i - 1].length;
+        packet_buffer_t* owner = i == 0 ? buffer : buffer->frags[i - 1].owner;
+        if(offset < segment_start + segment_length) {
+            size_t skip = offset - segment_start;
+            size_t piece = segment_length - skip < length ? segment_length - skip : length;
+            if(packet_buffer_attach(slice, segment + skip, piece, owner) != 0) {
+                packet_buffer_release(slice);
+                return NULL;
+            }
+            offset += piece;
+            length -= piece;
+        }
+        segment_start += segment_length;
+    }
+    if(length > 0) {
+        packet_buffer_release(slice);
+        return NULL;
+    }
+    return slice;
+}
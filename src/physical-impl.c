@@ -1,4 +1,4 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE // pthread_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,80 +11,497 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
-#include <sys/select.h>
+#include <sched.h>
 #include "headers/physical-impl.h"
 #include "headers/data-link-impl.h"
+#include "headers/rx-dispatch.h"
 #include "headers/thread-pool.h"
+#include "headers/log.h"
+#include "headers/metrics.h"
+
+// One receive queue of this instance: its ring in the shared segment, the semaphore senders post after
+// publishing into it, and the receiver thread that drains it.
+typedef struct {
+    physical_ring_header_t* ring;
+    char sem_name[50];
+    sem_t* sem;
+    pthread_t tid;
+    physical_rx_frame_t* frames; // One descriptor per slot, indexed by position % slot_count
+} physical_rx_queue_t;
 
 int physical_shm_fd = -1;
-char physical_sem_name[50];
-sem_t *physical_sem = SEM_FAILED;
 void* physical_shm_ptr = MAP_FAILED;
-extern bool DEBUG_ENABLED;
+size_t physical_shm_size = 0;
+uint32_t physical_ring_slots = PHYSICAL_RING_DEFAULT_SLOTS;
+uint32_t physical_rx_queues = 1;
+int physical_rx_first_cpu = -1;
 extern char source_mac_address[20];
 extern char destination_mac_address[20];
 extern threadpool thpool;
-pthread_t receiver_tid = 0;
-int receiver_pipe[2] = {-1, -1};
+static atomic_bool receiver_running = false;
+static physical_rx_queue_t physical_queues[PHYSICAL_MAX_RX_QUEUES];
+uint32_t physical_link_age_s = PHYSICAL_LINK_DEFAULT_AGE_S;
+_Thread_local bool physical_send_no_wait = false;
+// Senders and the receiver's learning only read the table; adding and ageing links write it.
+static physical_link_t* physical_links[PHYSICAL_LINK_BUCKETS];
+static pthread_rwlock_t physical_links_lock = PTHREAD_RWLOCK_INITIALIZER;
+static size_t physical_link_total = 0;
+static char physical_source_mac[PHYSICAL_MAC_SIZE];
+static uint32_t physical_slot_size = 0; // Set from data_link_mtu by physical_layer_init
+static uint64_t physical_last_sweep_ns = 0;
+// Refreshed by the receiver thread at least once per sweep interval; fine enough for ageing, and free for senders.
+static _Atomic uint64_t physical_coarse_now_ns = 0;
 
-int physical_layer_init() {
-    if(pipe(receiver_pipe) == -1) {
-        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: pipe failed");
+static physical_slot_header_t* physical_ring_slot(physical_ring_header_t* ring, uint64_t position) {
+    return (physical_slot_header_t*)((unsigned char*)ring + PHYSICAL_RING_HEADER_SIZE + (size_t)(position % ring->slot_count) * ring->slot_stride);
+}
+
+// Every queue's ring has the geometry of the first, so queue i starts i ring sizes into the segment.
+static physical_ring_header_t* physical_ring_queue(physical_ring_header_t* first, uint32_t queue) {
+    return (physical_ring_header_t*)((unsigned char*)first + (size_t)queue * PHYSICAL_RING_SIZE(first->slot_count, first->slot_stride));
+}
+
+static void physical_queue_sem_name(const char* mac, uint32_t queue, char* name, size_t name_size) {
+    if(queue == 0) snprintf(name, name_size, "/sem_%s", mac);
+    else snprintf(name, name_size, "/sem_%s_q%u", mac, queue);
+}
+
+// The first ring's magic is written last, once every queue is ready for producers.
+static void physical_ring_init(void* shm_ptr, uint32_t slot_count, uint32_t queue_count, uint32_t generation) {
+    physical_ring_header_t* first = (physical_ring_header_t*)shm_ptr;
+    first->slot_count = slot_count;
+    first->slot_stride = PHYSICAL_SLOT_STRIDE(physical_slot_size);
+    for(uint32_t queue = queue_count; queue-- > 0;) {
+        physical_ring_header_t* ring = physical_ring_queue(first, queue);
+        atomic_store_explicit(&ring->generation, generation, memory_order_relaxed);
+        ring->slot_count = slot_count;
+        ring->slot_size = physical_slot_size;
+        ring->slot_stride = PHYSICAL_SLOT_STRIDE(physical_slot_size);
+        ring->mtu = data_link_mtu;
+        ring->queue_count = queue == 0 ? queue_count : 0;
+        atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+        atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+        for(uint32_t i = 0; i < slot_count; i++) {
+            physical_slot_header_t* slot = physical_ring_slot(ring, i);
+            slot->length = 0;
+            atomic_store_explicit(&slot->sequence, i, memory_order_relaxed);
+        }
+        atomic_store_explicit(&ring->magic, PHYSICAL_RING_MAGIC, memory_order_release);
+    }
+}
+
+// Validates the rings mapped from another instance before anything is written into them.
+static bool physical_ring_is_valid(physical_ring_header_t* ring, size_t mapped_size) {
+    if(mapped_size < PHYSICAL_RING_HEADER_SIZE) return false;
+    if(atomic_load_explicit(&ring->magic, memory_order_acquire) != PHYSICAL_RING_MAGIC) return false;
+    if(ring->slot_count == 0 || ring->slot_count > PHYSICAL_RING_MAX_SLOTS) return false;
+    if(ring->slot_stride < PHYSICAL_SLOT_STRIDE(ring->slot_size)) return false;
+    if(ring->queue_count == 0 || ring->queue_count > PHYSICAL_MAX_RX_QUEUES) return false;
+    if((size_t)ring->queue_count * PHYSICAL_RING_SIZE(ring->slot_count, ring->slot_stride) > mapped_size) return false;
+    for(uint32_t queue = 1; queue < ring->queue_count; queue++) {
+        physical_ring_header_t* other = physical_ring_queue(ring, queue);
+        if(other->slot_count != ring->slot_count || other->slot_size != ring->slot_size || other->slot_stride != ring->slot_stride) return false;
+    }
+    return true;
+}
+
+// Multi-producer enqueue. Returns -1 without blocking when every slot is still owned by the receiver,
+// and -2 if a written frame did not fit its slot (the slot is then published empty).
+static int physical_ring_enqueue(physical_ring_header_t* ring, const physical_frame_t* frame) {
+    uint64_t position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    physical_slot_header_t* slot;
+    while (true) {
+        slot = physical_ring_slot(ring, position);
+        uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        int64_t difference = (int64_t)(sequence - position);
+        if(difference == 0) {
+            if(atomic_compare_exchange_weak_explicit(&ring->head, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) break;
+        }
+        else if(difference < 0) return -1;
+        else position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    }
+    int result = 0;
+    if(frame->write != NULL) {
+        long written = frame->write(frame->context, (unsigned char*)(slot + 1), ring->slot_size);
+        slot->length = written >= 0 ? (uint32_t)written : 0;
+        if(written < 0) result = -2;
+    }
+    else {
+        if(frame->length > 0) memcpy((unsigned char*)(slot + 1), frame->data, frame->length);
+        slot->length = (uint32_t)frame->length;
+    }
+    slot->flow_hash = frame->flow_hash;
+    memcpy(slot->source, physical_source_mac, PHYSICAL_MAC_SIZE);
+    slot->published_ns = latency_tracing ? latency_now_ns() : 0;
+    uint32_t length = slot->length;
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    if(result == 0) {
+        metrics_inc(METRIC_PHY_FRAMES_SENT);
+        metrics_add(METRIC_PHY_BYTES_SENT, length);
+    }
+    return result;
+}
+
+// Single-consumer claim of the oldest published slot, or NULL when the ring is empty.
+// The slot stays unavailable to producers until physical_ring_release().
+static physical_slot_header_t* physical_ring_claim(physical_ring_header_t* ring, uint64_t* position_out) {
+    uint64_t position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    physical_slot_header_t* slot = physical_ring_slot(ring, position);
+    if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + 1) return NULL;
+    atomic_store_explicit(&ring->tail, position + 1, memory_order_release);
+    *position_out = position;
+    return slot;
+}
+
+static void physical_ring_release(physical_ring_header_t* ring, uint64_t position) {
+    physical_slot_header_t* slot = physical_ring_slot(ring, position);
+    atomic_store_explicit(&slot->sequence, position + ring->slot_count, memory_order_release);
+}
+
+static uint32_t physical_new_generation() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint32_t generation = (uint32_t)now.tv_nsec ^ ((uint32_t)now.tv_sec << 16) ^ (uint32_t)getpid();
+    return generation != 0 ? generation : 1;
+}
+
+// Marks a segment left behind under our name (e.g. by a crashed run) as retired,
+// so peers still mapping it notice the restart before we unlink it.
+static void physical_retire_stale_segment(const char* shm_name) {
+    int fd = shm_open(shm_name, O_RDWR, 0666);
+    if(fd == -1) return;
+    struct stat shm_stat;
+    if(fstat(fd, &shm_stat) == 0 && (size_t)shm_stat.st_size >= PHYSICAL_RING_HEADER_SIZE) {
+        void* ptr = mmap(NULL, PHYSICAL_RING_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(ptr != MAP_FAILED) {
+            physical_ring_header_t* ring = (physical_ring_header_t*)ptr;
+            if(atomic_load_explicit(&ring->magic, memory_order_acquire) == PHYSICAL_RING_MAGIC) atomic_store_explicit(&ring->generation, 0, memory_order_release);
+            munmap(ptr, PHYSICAL_RING_HEADER_SIZE);
+        }
+    }
+    close(fd);
+}
+
+static void physical_peer_disconnect(physical_peer_t* peer) {
+    if(peer->ring != NULL && munmap(peer->ring, peer->map_size) == -1) perror("PHYSICAL Send Warning: munmap for destination failed");
+    for(uint32_t queue = 0; queue < peer->queue_count; queue++) {
+        if(sem_close(peer->sems[queue]) == -1) perror("PHYSICAL Send Warning: sem_close for destination failed");
+    }
+    peer->ring = NULL;
+    peer->map_size = 0;
+    peer->queue_count = 0;
+    peer->generation = 0;
+}
+
+// Opens and maps the peer's rings and their semaphores. Caller holds the peer lock exclusively.
+static int physical_peer_connect(physical_peer_t* peer) {
+    struct stat shm_stat;
+    void* ptr = MAP_FAILED;
+    // The owner creates the first queue's semaphore last, so once it exists the segment and the other semaphores do.
+    sem_t* first_sem = sem_open(peer->sem_name, 0);
+    if(first_sem == SEM_FAILED) {
+        // A destination that is not running yet is expected, not an error.
+        if(errno != ENOENT) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: sem_open ('%s') failed: %s. Is destination '%s' running?\n", peer->sem_name, strerror(errno), peer->name);
+        else LOG_DEBUG(LOG_PHYSICAL, "Semaphore %s does not exist. Is destination '%s' running?", peer->sem_name, peer->name);
         return -1;
     }
-    // Set the read end of the pipe to non-blocking for select check
-    int flags = fcntl(receiver_pipe[0], F_GETFL, 0);
-    if(flags == -1 || fcntl(receiver_pipe[0], F_SETFL, flags | O_NONBLOCK) == -1) {
-        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: fcntl failed to set pipe non-blocking");
-        close(receiver_pipe[0]);
-        close(receiver_pipe[1]);
+    peer->sems[0] = first_sem;
+    peer->queue_count = 1;
+    int fd = shm_open(peer->name, O_RDWR, 0666);
+    if(fd == -1) {
+        if(errno != ENOENT) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: shm_open ('%s') failed: %s. Is destination running and initialized?\n", peer->name, strerror(errno));
+        else LOG_DEBUG(LOG_PHYSICAL, "Shared memory %s does not exist. Is destination running and initialized?", peer->name);
+        physical_peer_disconnect(peer);
+        return -1;
+    }
+    if(fstat(fd, &shm_stat) == -1) {
+        perror("PHYSICAL Send Error: fstat failed for destination");
+        close(fd);
+        physical_peer_disconnect(peer);
+        return -1;
+    }
+    size_t map_size = (size_t)shm_stat.st_size;
+    if(map_size >= PHYSICAL_RING_HEADER_SIZE) ptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: Could not map destination shared memory %s (%zu bytes): %s\n", peer->name, map_size, strerror(errno));
+        physical_peer_disconnect(peer);
+        return -1;
+    }
+    peer->ring = (physical_ring_header_t*)ptr;
+    peer->map_size = map_size;
+    if(!physical_ring_is_valid(peer->ring, map_size)) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: Destination shared memory %s does not hold a valid receive ring.\n", peer->name);
+        physical_peer_disconnect(peer);
+        return -1;
+    }
+    peer->generation = atomic_load_explicit(&peer->ring->generation, memory_order_acquire);
+    if(peer->generation == 0) {
+        LOG_DEBUG(LOG_PHYSICAL, "Destination ring %s has been retired by its owner.", peer->name);
+        physical_peer_disconnect(peer);
+        return -1;
+    }
+    if(peer->ring->mtu != data_link_mtu) {
+        // Reported once per incarnation of the peer; every send to it fails until one end restarts.
+        if(peer->mismatch_generation != peer->generation) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: Destination %s uses an MTU of %u bytes, this instance %u. Both ends of a link must use the same MTU.\n", peer->name, peer->ring->mtu, data_link_mtu);
+        peer->mismatch_generation = peer->generation;
+        physical_peer_disconnect(peer);
+        return -1;
+    }
+    for(uint32_t queue = 1; queue < peer->ring->queue_count; queue++) {
+        char sem_name[50];
+        physical_queue_sem_name(peer->name, queue, sem_name, sizeof(sem_name));
+        sem_t* sem = sem_open(sem_name, 0);
+        if(sem == SEM_FAILED) {
+            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: sem_open ('%s') failed: %s.\n", sem_name, strerror(errno));
+            physical_peer_disconnect(peer);
+            return -1;
+        }
+        peer->sems[peer->queue_count++] = sem;
+    }
+    LOG_INFO(LOG_PHYSICAL, "Connected to %s (generation %u, %u queue(s) of %u slots).", peer->name, peer->generation, peer->queue_count, peer->ring->slot_count);
+    return 0;
+}
+
+static bool physical_peer_is_current(physical_peer_t* peer) {
+    return peer->ring != NULL && atomic_load_explicit(&peer->ring->generation, memory_order_acquire) == peer->generation;
+}
+
+// Returns with the peer lock held shared and a mapping that matches the peer's current generation.
+static int physical_peer_acquire(physical_peer_t* peer) {
+    pthread_rwlock_rdlock(&peer->lock);
+    while (!physical_peer_is_current(peer)) {
+        pthread_rwlock_unlock(&peer->lock);
+        pthread_rwlock_wrlock(&peer->lock);
+        if(!physical_peer_is_current(peer)) {
+            if(peer->ring != NULL) LOG_INFO(LOG_PHYSICAL, "Destination %s restarted (generation %u). Remapping...", peer->name, peer->generation);
+            physical_peer_disconnect(peer);
+            if(physical_peer_connect(peer) != 0) {
+                pthread_rwlock_unlock(&peer->lock);
+                return -1;
+            }
+        }
+        pthread_rwlock_unlock(&peer->lock);
+        pthread_rwlock_rdlock(&peer->lock);
+    }
+    return 0;
+}
+
+static void physical_peer_invalidate(physical_peer_t* peer) {
+    pthread_rwlock_wrlock(&peer->lock);
+    physical_peer_disconnect(peer);
+    pthread_rwlock_unlock(&peer->lock);
+}
+
+static uint64_t physical_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// FNV-1a over the MAC, which is at most PHYSICAL_MAC_SIZE - 1 bytes.
+static uint32_t physical_mac_hash(const char* mac) {
+    uint32_t hash = 2166136261u;
+    for(; *mac != '\0'; mac++) hash = (hash ^ (unsigned char)*mac) * 16777619u;
+    return hash;
+}
+
+static bool physical_mac_is_valid(const char* mac) {
+    return mac != NULL && mac[0] != '\0' && memchr(mac, '\0', PHYSICAL_MAC_SIZE) != NULL;
+}
+
+static void physical_link_release(physical_link_t* link) {
+    if(atomic_fetch_sub_explicit(&link->references, 1, memory_order_acq_rel) != 1) return;
+    physical_peer_disconnect(&link->peer);
+    pthread_rwlock_destroy(&link->peer.lock);
+    free(link);
+}
+
+// Caller holds physical_links_lock.
+static physical_link_t* physical_link_find_locked(const char* mac, uint32_t hash) {
+    for(physical_link_t* link = physical_links[hash % PHYSICAL_LINK_BUCKETS]; link != NULL; link = link->next) {
+        if(link->hash == hash && strcmp(link->peer.name, mac) == 0) return link;
+    }
+    return NULL;
+}
+
+// Returns the link to mac with a reference the caller releases, adding it first if create is set.
+// The link is refreshed as seen at now_ns, and made static if is_static is set.
+static physical_link_t* physical_link_get(const char* mac, bool create, bool is_static, uint64_t now_ns) {
+    uint32_t hash = physical_mac_hash(mac);
+    physical_link_t* link = NULL;
+    // is_static is only written under the write lock, where the sweep reads it, so a static request skips this path.
+    if(!is_static) {
+        pthread_rwlock_rdlock(&physical_links_lock);
+        link = physical_link_find_locked(mac, hash);
+        if(link != NULL) atomic_fetch_add_explicit(&link->references, 1, memory_order_relaxed);
+        pthread_rwlock_unlock(&physical_links_lock);
+    }
+    if(link == NULL && create) {
+        pthread_rwlock_wrlock(&physical_links_lock);
+        link = physical_link_find_locked(mac, hash);
+        if(link == NULL && physical_link_total < PHYSICAL_MAX_LINKS && (link = (physical_link_t*)calloc(1, sizeof(physical_link_t))) != NULL) {
+            snprintf(link->peer.name, sizeof(link->peer.name), "%s", mac);
+            physical_queue_sem_name(mac, 0, link->peer.sem_name, sizeof(link->peer.sem_name));
+            pthread_rwlock_init(&link->peer.lock, NULL);
+            link->hash = hash;
+            atomic_store_explicit(&link->references, 1, memory_order_relaxed);
+            link->next = physical_links[hash % PHYSICAL_LINK_BUCKETS];
+            physical_links[hash % PHYSICAL_LINK_BUCKETS] = link;
+            physical_link_total++;
+            metrics_inc(METRIC_PHY_LINKS_ADDED);
+            LOG_INFO(LOG_PHYSICAL, "Added link to %s (%zu links).", mac, physical_link_total);
+        }
+        if(link != NULL) {
+            atomic_fetch_add_explicit(&link->references, 1, memory_order_relaxed);
+            if(is_static) link->is_static = true;
+        }
+        pthread_rwlock_unlock(&physical_links_lock);
+        if(link == NULL) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: No room for a link to %s (%d links at most).\n", mac, PHYSICAL_MAX_LINKS);
+    }
+    if(link == NULL) return NULL;
+    // Many senders refresh the same link, so skip the store while it is already recent.
+    if(now_ns > atomic_load_explicit(&link->last_seen_ns, memory_order_relaxed) + 1000000ull) atomic_store_explicit(&link->last_seen_ns, now_ns, memory_order_relaxed);
+    return link;
+}
+
+// Drops learned links that have seen no traffic for physical_link_age_s. Senders still holding one finish first.
+static void physical_link_sweep(uint64_t now_ns) {
+    uint64_t age_ns = (uint64_t)physical_link_age_s * 1000000000ull;
+    pthread_rwlock_wrlock(&physical_links_lock);
+    for(size_t bucket = 0; bucket < PHYSICAL_LINK_BUCKETS; bucket++) {
+        physical_link_t** previous = &physical_links[bucket];
+        while (*previous != NULL) {
+            physical_link_t* link = *previous;
+            uint64_t last_seen_ns = atomic_load_explicit(&link->last_seen_ns, memory_order_relaxed);
+            if(link->is_static || now_ns < last_seen_ns || now_ns - last_seen_ns <= age_ns) {
+                previous = &link->next;
+                continue;
+            }
+            *previous = link->next;
+            physical_link_total--;
+            metrics_inc(METRIC_PHY_LINKS_AGED);
+            LOG_INFO(LOG_PHYSICAL, "Link to %s aged out after %u s without traffic.", link->peer.name, physical_link_age_s);
+            physical_link_release(link);
+        }
+    }
+    pthread_rwlock_unlock(&physical_links_lock);
+}
+
+static void physical_links_clear() {
+    pthread_rwlock_wrlock(&physical_links_lock);
+    for(size_t bucket = 0; bucket < PHYSICAL_LINK_BUCKETS; bucket++) {
+        while (physical_links[bucket] != NULL) {
+            physical_link_t* link = physical_links[bucket];
+            physical_links[bucket] = link->next;
+            physical_link_release(link);
+        }
+    }
+    physical_link_total = 0;
+    pthread_rwlock_unlock(&physical_links_lock);
+}
+
+int physical_layer_add_link(const char* mac) {
+    if(!physical_mac_is_valid(mac)) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: Invalid MAC for a link (1-%d characters).\n", PHYSICAL_MAC_SIZE - 1);
         return -1;
     }
-    snprintf(physical_sem_name, sizeof(physical_sem_name), "/sem_%s", source_mac_address);
-    sem_unlink(physical_sem_name);
+    physical_link_t* link = physical_link_get(mac, true, true, physical_now_ns());
+    if(link == NULL) return -1;
+    physical_link_release(link);
+    return 0;
+}
+
+size_t physical_layer_link_count() {
+    pthread_rwlock_rdlock(&physical_links_lock);
+    size_t count = physical_link_total;
+    pthread_rwlock_unlock(&physical_links_lock);
+    return count;
+}
+
+int physical_layer_init() {
+    char physical_sem_name[50];
+    snprintf(physical_source_mac, sizeof(physical_source_mac), "%s", source_mac_address);
+    for(uint32_t queue = 0; queue < PHYSICAL_MAX_RX_QUEUES; queue++) {
+        // Also clears semaphores of queues a previous run had and this one does not.
+        physical_queue_sem_name(source_mac_address, queue, physical_sem_name, sizeof(physical_sem_name));
+        sem_unlink(physical_sem_name);
+        physical_queues[queue] = (physical_rx_queue_t){ .ring = NULL, .sem = SEM_FAILED, .tid = 0, .frames = NULL };
+        snprintf(physical_queues[queue].sem_name, sizeof(physical_queues[queue].sem_name), "%s", physical_sem_name);
+    }
+    physical_retire_stale_segment(source_mac_address);
     shm_unlink(source_mac_address);
-    if(DEBUG_ENABLED) {
-        printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Initializing Physical Layer (Listening on %s)...\n", source_mac_address);
-        printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Shared Memory Name: %s\n", source_mac_address);
-        printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Semaphore Name: %s\n", physical_sem_name);
+    LOG_INFO(LOG_PHYSICAL, "Initializing Physical Layer (Listening on %s)...", source_mac_address);
+    LOG_DEBUG(LOG_PHYSICAL, "Shared Memory Name: %s", source_mac_address);
+    LOG_DEBUG(LOG_PHYSICAL, "Semaphore Name: %s", physical_queues[0].sem_name);
+    if(physical_ring_slots == 0 || physical_ring_slots > PHYSICAL_RING_MAX_SLOTS) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: Ring slot count %u out of range (1-%d).\n", physical_ring_slots, PHYSICAL_RING_MAX_SLOTS);
+        return -1;
+    }
+    if(physical_rx_queues == 0 || physical_rx_queues > PHYSICAL_MAX_RX_QUEUES) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: Receive queue count %u out of range (1-%d).\n", physical_rx_queues, PHYSICAL_MAX_RX_QUEUES);
+        return -1;
+    }
+    if(data_link_mtu < DATA_LINK_MIN_MTU || data_link_mtu > DATA_LINK_MAX_MTU) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: MTU %u out of range (%d-%d).\n", data_link_mtu, DATA_LINK_MIN_MTU, DATA_LINK_MAX_MTU);
+        return -1;
     }
+    // Each queue feeds workers of its own, so that every worker still has a single producer.
+    if(rx_mode == RX_MODE_RUN_TO_COMPLETION && rx_worker_count < (int)physical_rx_queues) {
+        LOG_INFO(LOG_PHYSICAL, "Raising receive workers from %d to one per receive queue (%u).", rx_worker_count, physical_rx_queues);
+        rx_worker_count = (int)physical_rx_queues;
+    }
+    physical_slot_size = (uint32_t)DATA_LINK_STUFFED_FRAME_SIZE(data_link_mtu);
+    physical_shm_size = (size_t)physical_rx_queues * PHYSICAL_RING_SIZE(physical_ring_slots, PHYSICAL_SLOT_STRIDE(physical_slot_size));
+    LOG_INFO(LOG_PHYSICAL, "Receive rings: %u queue(s) of %u slots of %u bytes for an MTU of %u (%zu KiB).", physical_rx_queues, physical_ring_slots, physical_slot_size, data_link_mtu, physical_shm_size / 1024);
     physical_shm_fd = shm_open(source_mac_address, O_CREAT | O_RDWR, 0666);
     if(physical_shm_fd == -1) {
         perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: shm_open failed");
-        close(receiver_pipe[0]);
-        close(receiver_pipe[1]);
         return -1;
     }
-    if(ftruncate(physical_shm_fd, SHARED_MEM_SIZE) == -1) {
+    if(ftruncate(physical_shm_fd, physical_shm_size) == -1) {
         perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: ftruncate failed");
         close(physical_shm_fd);
+        physical_shm_fd = -1;
         shm_unlink(source_mac_address);
-        close(receiver_pipe[0]);
-        close(receiver_pipe[1]);
         return -1;
     }
-    physical_shm_ptr = mmap(NULL, SHARED_MEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, physical_shm_fd, 0);
+    physical_shm_ptr = mmap(NULL, physical_shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, physical_shm_fd, 0);
     if(physical_shm_ptr == MAP_FAILED) {
         perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: mmap failed");
         close(physical_shm_fd);
+        physical_shm_fd = -1;
         shm_unlink(source_mac_address);
-        close(receiver_pipe[0]);
-        close(receiver_pipe[1]);
         return -1;
     }
-    memset(physical_shm_ptr, 0, SHARED_MEM_SIZE);
-    physical_sem = sem_open(physical_sem_name, O_CREAT, 0666, 0);
-    if(physical_sem == SEM_FAILED) {
-        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: sem_open (creating) failed");
-        munmap(physical_shm_ptr, SHARED_MEM_SIZE);
-        close(physical_shm_fd);
-        shm_unlink(source_mac_address);
-        close(receiver_pipe[0]);
-        close(receiver_pipe[1]);
+    memset(physical_shm_ptr, 0, physical_shm_size);
+    physical_ring_init(physical_shm_ptr, physical_ring_slots, physical_rx_queues, physical_new_generation());
+    for(uint32_t queue = 0; queue < physical_rx_queues; queue++) {
+        physical_queues[queue].ring = physical_ring_queue((physical_ring_header_t*)physical_shm_ptr, queue);
+        physical_queues[queue].frames = (physical_rx_frame_t*)calloc(physical_ring_slots, sizeof(physical_rx_frame_t));
+        if(physical_queues[queue].frames == NULL) {
+            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: Failed to allocate %u receive frame descriptors.\n", physical_ring_slots);
+            physical_layer_shutdown();
+            return -1;
+        }
+    }
+    // The first queue's semaphore goes last: senders take it as the sign that the rest is in place.
+    for(uint32_t queue = physical_rx_queues; queue-- > 0;) {
+        physical_queues[queue].sem = sem_open(physical_queues[queue].sem_name, O_CREAT, 0666, 0);
+        if(physical_queues[queue].sem == SEM_FAILED) {
+            perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: sem_open (creating) failed");
+            physical_layer_shutdown();
+            return -1;
+        }
+    }
+    LOG_INFO(LOG_PHYSICAL, "Listening shared memory and semaphores initialized successfully.");
+    if(destination_mac_address[0] != '\0' && physical_layer_add_link(destination_mac_address) != 0) {
+        physical_layer_shutdown();
         return -1;
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Listening shared memory and semaphore initialized successfully.\n");
-    if(start_physical_receiver_thread() != 0) {
+    physical_last_sweep_ns = physical_now_ns();
+    atomic_store_explicit(&physical_coarse_now_ns, physical_last_sweep_ns, memory_order_relaxed);
+    if(rx_dispatch_init(physical_ring_slots) != 0 || start_physical_receiver_thread() != 0) {
         physical_layer_shutdown();
         return -1;
     }
@@ -92,25 +509,23 @@ int physical_layer_init() {
 }
 
 void physical_layer_shutdown() {
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Shutting down Physical Layer (Listening on %s)...\n", source_mac_address);
-    if(receiver_pipe[1] != -1) {
-        char exit_signal = 'X';
-        if(write(receiver_pipe[1], &exit_signal, 1) == -1) {
-            if(errno != EPIPE) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: Failed to write exit signal to pipe");
-        }
-        close(receiver_pipe[1]);
-        receiver_pipe[1] = -1;
-    }
-    if(receiver_tid != 0) {
-        if(pthread_join(receiver_tid, NULL) != 0) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: Failed to join receiver thread");
-        receiver_tid = 0;
-    }
-    if(receiver_pipe[0] != -1) {
-        close(receiver_pipe[0]);
-        receiver_pipe[0] = -1;
+    LOG_INFO(LOG_PHYSICAL, "Shutting down Physical Layer (Listening on %s)...", source_mac_address);
+    // Receivers sleep in sem_wait, so clear the run flag and post each queue's semaphore to wake them.
+    atomic_store_explicit(&receiver_running, false, memory_order_release);
+    for(uint32_t queue = 0; queue < PHYSICAL_MAX_RX_QUEUES; queue++) {
+        physical_rx_queue_t* rx_queue = &physical_queues[queue];
+        if(rx_queue->tid == 0) continue;
+        if(rx_queue->sem != SEM_FAILED && sem_post(rx_queue->sem) == -1) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: Failed to post shutdown wakeup to receiver");
+        if(pthread_join(rx_queue->tid, NULL) != 0) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: Failed to join receiver thread");
+        rx_queue->tid = 0;
     }
+    // Handlers parse frames in place, so every queued frame must be done with its slot before the ring goes away.
+    rx_dispatch_shutdown();
+    if(thpool != NULL) thpool_wait(thpool);
+    physical_links_clear();
     if(physical_shm_ptr != MAP_FAILED) {
-        if(munmap(physical_shm_ptr, SHARED_MEM_SIZE) == -1) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: munmap failed during shutdown");
+        atomic_store_explicit(&((physical_ring_header_t*)physical_shm_ptr)->generation, 0, memory_order_release);
+        if(munmap(physical_shm_ptr, physical_shm_size) == -1) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: munmap failed during shutdown");
         physical_shm_ptr = MAP_FAILED;
     }
     if(physical_shm_fd != -1) {
@@ -118,12 +533,18 @@ void physical_layer_shutdown() {
         if(shm_unlink(source_mac_address) == -1 && errno != ENOENT) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: shm_unlink failed for source");
         physical_shm_fd = -1;
     }
-    if(physical_sem != SEM_FAILED) {
-        if(sem_close(physical_sem) == -1) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: sem_close failed during shutdown");
-        if(sem_unlink(physical_sem_name) == -1 && errno != ENOENT) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: sem_unlink failed for source");
-        physical_sem = SEM_FAILED;
+    for(uint32_t queue = 0; queue < PHYSICAL_MAX_RX_QUEUES; queue++) {
+        physical_rx_queue_t* rx_queue = &physical_queues[queue];
+        free(rx_queue->frames);
+        rx_queue->frames = NULL;
+        rx_queue->ring = NULL;
+        if(rx_queue->sem != SEM_FAILED) {
+            if(sem_close(rx_queue->sem) == -1) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: sem_close failed during shutdown");
+            if(sem_unlink(rx_queue->sem_name) == -1 && errno != ENOENT) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: sem_unlink failed for source");
+            rx_queue->sem = SEM_FAILED;
+        }
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Physical Layer shutdown complete.\n");
+    LOG_INFO(LOG_PHYSICAL, "Physical Layer shutdown complete.");
 }
 
 int start_physical_receiver_thread() {
@@ -131,135 +552,255 @@ int start_physical_receiver_thread() {
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: Thread pool not initialized before starting receiver.\n");
         return -1;
     }
-    if(pthread_create(&receiver_tid, NULL, receive_frame_thread, NULL) != 0) {
-        perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: Failed to create receiver thread");
-        return -1;
+    atomic_store_explicit(&receiver_running, true, memory_order_release);
+    for(uint32_t queue = 0; queue < physical_rx_queues; queue++) {
+        if(pthread_create(&physical_queues[queue].tid, NULL, receive_frame_thread, (void*)(uintptr_t)queue) != 0) {
+            perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: Failed to create receiver thread");
+            physical_queues[queue].tid = 0;
+            return -1;
+        }
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Receiver thread started (Listening on %s).\n", source_mac_address);
+    LOG_INFO(LOG_PHYSICAL, "%u receiver thread(s) started (Listening on %s).", physical_rx_queues, source_mac_address);
     return 0;
 }
 
+// Pins the calling receiver thread to the core its queue is given, counted among the cores this process may use.
+static void physical_pin_receiver(uint32_t queue) {
+    if(physical_rx_first_cpu < 0 && physical_rx_queues == 1) return;
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) return;
+    int target = (int)(((uint32_t)(physical_rx_first_cpu < 0 ? 0 : physical_rx_first_cpu) + queue) % (uint32_t)CPU_COUNT(&allowed));
+    int cpu = 0;
+    for(int seen = -1; cpu < CPU_SETSIZE; cpu++) {
+        if(CPU_ISSET(cpu, &allowed) && ++seen == target) break;
+    }
+    cpu_set_t pinned;
+    CPU_ZERO(&pinned);
+    CPU_SET(cpu, &pinned);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+    if(error != 0) fprintf(stderr, ANSI_COLOR_RESET ANSI_COLOR_YELLOW "PHYSICAL Warning: Could not pin receive queue %u to core %d: %s\n", queue, cpu, strerror(error));
+    else LOG_INFO(LOG_PHYSICAL, "Receive queue %u pinned to core %d.", queue, cpu);
+}
+
+static void physical_receive_pending_frames(uint32_t queue) {
+    physical_ring_header_t* ring = physical_queues[queue].ring;
+    physical_slot_header_t* slot;
+    uint64_t position;
+    uint64_t now_ns = atomic_load_explicit(&physical_coarse_now_ns, memory_order_relaxed);
+    char learned[PHYSICAL_MAC_SIZE] = "";
+    // Posts can coalesce with frames already drained, so take everything that is published.
+    while ((slot = physical_ring_claim(ring, &position)) != NULL) {
+        // Bursts mostly come from one sender, so the table is only consulted when the source changes.
+        if(memcmp(slot->source, learned, PHYSICAL_MAC_SIZE) != 0) {
+            memcpy(learned, slot->source, PHYSICAL_MAC_SIZE);
+            if(physical_mac_is_valid(learned) && strcmp(learned, source_mac_address) != 0) {
+                physical_link_t* link = physical_link_get(learned, true, false, now_ns);
+                if(link != NULL) physical_link_release(link);
+            }
+        }
+        size_t frame_length = slot->length;
+        const unsigned char* frame_data = (const unsigned char*)(slot + 1);
+        if(frame_length > ring->slot_size) {
+            metrics_inc(METRIC_PHY_INVALID_SLOTS);
+            LOG_WARN(LOG_PHYSICAL, "Slot %llu carries invalid length %zu. Dropping frame.", (unsigned long long)position, frame_length);
+            physical_ring_release(ring, position);
+            continue;
+        }
+        metrics_inc(METRIC_PHY_FRAMES_RECEIVED);
+        metrics_add(METRIC_PHY_BYTES_RECEIVED, frame_length);
+        if(latency_tracing) {
+            uint64_t claimed_ns = latency_begin();
+            if(slot->published_ns != 0 && claimed_ns > slot->published_ns) latency_record(LATENCY_RX_WIRE, claimed_ns - slot->published_ns);
+        }
+        LOG_DEBUG(LOG_PHYSICAL, "Receiver (%s) claimed slot %llu (%zu bytes)...", source_mac_address, (unsigned long long)position, frame_length);
+        if(LOG_ENABLED(LOG_LEVEL_TRACE, LOG_PHYSICAL)) {
+            char preview[33];
+            size_t preview_length = frame_length < 32 ? frame_length : 32;
+            for(size_t i = 0; i < preview_length; i++) preview[i] = isprint(frame_data[i]) ? (char)frame_data[i] : '.';
+            preview[preview_length] = '\0';
+            LOG_TRACE(LOG_PHYSICAL, "Slot (%s) start: [%s]", source_mac_address, preview);
+        }
+        physical_rx_frame_t* frame = &physical_queues[queue].frames[position % ring->slot_count];
+        frame->data = frame_data;
+        frame->length = frame_length;
+        frame->position = position;
+        frame->queue = queue;
+        frame->flow_hash = slot->flow_hash;
+        if(rx_dispatch_frame(frame) != 0) {
+            LOG_WARN(LOG_PHYSICAL, "Failed to dispatch frame in slot %llu (%s mode).", (unsigned long long)position, rx_mode_name(rx_mode));
+            physical_ring_release(ring, position);
+        }
+        else LOG_DEBUG(LOG_PHYSICAL, "Frame in slot %llu from %s dispatched (%s mode, flow hash 0x%08X).", (unsigned long long)position, source_mac_address, rx_mode_name(rx_mode), frame->flow_hash);
+    }
+}
+
+void physical_layer_release_frame(physical_rx_frame_t* frame) {
+    if(frame == NULL || physical_shm_ptr == MAP_FAILED) return;
+    physical_ring_release(physical_queues[frame->queue].ring, frame->position);
+}
+
 void* receive_frame_thread(void* param) {
-    (void)param;
-    fd_set read_fds;
-    int pipe_read_fd = receiver_pipe[0];
-    struct timespec sleep_duration = {0, 100000000L}; // 100 milliseconds
-    if(physical_shm_ptr == MAP_FAILED || physical_sem == SEM_FAILED || pipe_read_fd == -1) {
+    uint32_t queue = (uint32_t)(uintptr_t)param;
+    if(physical_shm_ptr == MAP_FAILED || queue >= physical_rx_queues || physical_queues[queue].sem == SEM_FAILED) {
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: Receiver thread started with uninitialized resources.\n");
         return NULL;
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Receiver thread waiting for data on %s (using polling)...\n", source_mac_address);
-    while (true) {
-        int sem_result = sem_trywait(physical_sem);
-        if(sem_result == 0) {
-            if(DEBUG_ENABLED) {
-                printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Receiver (%s) got semaphore. Reading frame...\n", source_mac_address);
-                printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Shared Mem (%s) start: [", source_mac_address);
-                for(int i=0; i<32 && i<SHARED_MEM_SIZE; ++i){
-                    char c = ((char*)physical_shm_ptr)[i];
-                    if(isprint(c)) printf("%c", c); else printf(".");
-                }
-                printf("]\n");
-            }
-            unsigned char* received_data_copy = (unsigned char*)malloc(SHARED_MEM_SIZE);
-            if(received_data_copy == NULL) {
-                fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: Failed to allocate memory for received data copy.\n");
-                continue;
-            }
-            memcpy(received_data_copy, physical_shm_ptr, SHARED_MEM_SIZE);
-            if(thpool != NULL) {
-                if(thpool_add_work(thpool, (void (*)(void*))handle_physical_to_data_link, received_data_copy) != 0) {
-                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: Failed to add task to thread pool.\n");
-                    free(received_data_copy);
-                } else if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Frame data from %s passed to thread pool.\n", source_mac_address);
-            }
-            else {
-                fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Error: Thread pool is NULL when trying to add work.\n");
-                free(received_data_copy);
-            }
+    sem_t* sem = physical_queues[queue].sem;
+    physical_pin_receiver(queue);
+    LOG_INFO(LOG_PHYSICAL, "Receiver thread for queue %u waiting for data on %s (blocking on semaphore)...", queue, source_mac_address);
+    while (atomic_load_explicit(&receiver_running, memory_order_acquire)) {
+        // Wakes at least once per sweep interval to age out idle links, even when nothing arrives.
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += PHYSICAL_LINK_SWEEP_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (long)(PHYSICAL_LINK_SWEEP_INTERVAL_MS % 1000) * 1000000L;
+        if(deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
         }
-        else if(errno == EAGAIN) nanosleep(&sleep_duration, NULL);
-        else if(errno == EINTR && DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: sem_trywait interrupted, checking pipe...\n");
-        else {
-            perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: sem_trywait failed");
-            break;
-        }
-        FD_ZERO(&read_fds);
-        FD_SET(pipe_read_fd, &read_fds);
-        struct timeval tv = {0, 0}; // Timeout of 0 for non-blocking check
-        int activity = select(pipe_read_fd + 1, &read_fds, NULL, NULL, &tv);
-        if(activity < 0) {
-            if(errno != EINTR) {
-                perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: select on pipe failed");
+        bool timed_out = false;
+        if(sem_timedwait(sem, &deadline) == -1) {
+            if(errno == EINTR) continue;
+            if(errno != ETIMEDOUT) {
+                perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "PHYSICAL Error: sem_timedwait failed");
                 break;
             }
-            if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: select on pipe interrupted, looping again...\n");
+            timed_out = true;
         }
-        else if(activity > 0 && FD_ISSET(pipe_read_fd, &read_fds)) {
-            if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Receiver thread received shutdown signal via pipe.\n");
+        if(!atomic_load_explicit(&receiver_running, memory_order_acquire)) {
+            LOG_INFO(LOG_PHYSICAL, "Receiver thread received shutdown signal.");
             break;
         }
+        uint64_t now_ns = physical_now_ns();
+        atomic_store_explicit(&physical_coarse_now_ns, now_ns, memory_order_relaxed);
+        if(!timed_out) physical_receive_pending_frames(queue);
+        // The first queue's receiver does the ageing for all of them.
+        if(queue == 0 && now_ns - physical_last_sweep_ns >= PHYSICAL_LINK_SWEEP_INTERVAL_MS * 1000000ull) {
+            physical_last_sweep_ns = now_ns;
+            physical_link_sweep(now_ns);
+        }
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Receiver thread (%s) exiting.\n", source_mac_address);
+    LOG_INFO(LOG_PHYSICAL, "Receiver thread for queue %u (%s) exiting.", queue, source_mac_address);
     return NULL;
 }
 
-int physical_layer_send(const unsigned char* frame_data, size_t frame_length) {
-    if(destination_mac_address[0] == '\0') {
+int physical_layer_send(const char* destination, const unsigned char* frame_data, size_t frame_length) {
+    physical_frame_t frame = { .data = frame_data, .length = frame_length, .flow_hash = 0, .write = NULL, .context = NULL };
+    return physical_layer_send_batch(destination, &frame, 1);
+}
+
+// Wakes the receiver of every queue whose bit is set.
+static int physical_peer_post(physical_peer_t* peer, uint32_t queues) {
+    int result = 0;
+    for(uint32_t queue = 0; queues != 0; queue++, queues >>= 1) {
+        if((queues & 1) == 0) continue;
+        if(sem_post(peer->sems[queue]) == -1) {
+            perror("PHYSICAL Send Error: sem_post failed for destination");
+            result = -1;
+        }
+        else LOG_DEBUG(LOG_PHYSICAL, "Destination %s queue %u posted.", peer->name, queue);
+    }
+    return result;
+}
+
+// Writes every frame into the destination ring its flow hash picks and wakes each receiver it used once for the
+// whole batch.
+int physical_layer_send_batch(const char* destination, const physical_frame_t* frames, size_t frame_count) {
+    const char* destination_mac = destination != NULL ? destination : destination_mac_address;
+    if(destination_mac[0] == '\0') {
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: Destination MAC address not set.\n");
         return -1;
     }
-    if(strcmp(source_mac_address, destination_mac_address) == 0) {
+    if(!physical_mac_is_valid(destination_mac)) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: Destination MAC longer than %d characters.\n", PHYSICAL_MAC_SIZE - 1);
+        return -1;
+    }
+    if(strcmp(source_mac_address, destination_mac) == 0) {
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: Attempted to send to self using physical_layer_send. Loopback should occur naturally if needed.\n");
         return -1;
     }
-    if(frame_data == NULL) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: frame_data is NULL for sending to %s.\n", destination_mac_address);
+    if(frames == NULL && frame_count > 0) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: frames is NULL for sending to %s.\n", destination_mac);
         return -1;
     }
-    if(frame_length == 0) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Info: Attempted to send zero-length frame to %s. Sending anyway.\n", destination_mac_address);
-    if(frame_length > SHARED_MEM_SIZE) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Error: Frame length (%zu) exceeds shared memory size (%d) for sending to %s.\n", frame_length, SHARED_MEM_SIZE, destination_mac_address);
+    for(size_t i = 0; i < frame_count; i++) {
+        if(frames[i].write != NULL) continue; // Sized and checked against the slot as it is written
+        if(frames[i].data == NULL && frames[i].length > 0) {
+            LOG_WARN(LOG_PHYSICAL, "Frame data is NULL for sending to %s.", destination_mac);
+            return -1;
+        }
+        if(frames[i].length == 0) LOG_DEBUG(LOG_PHYSICAL, "Attempted to send zero-length frame to %s. Sending anyway.", destination_mac);
+        if(frames[i].length > physical_slot_size) {
+            LOG_WARN(LOG_PHYSICAL, "Frame length (%zu) exceeds ring slot size (%u) for sending to %s.", frames[i].length, physical_slot_size, destination_mac);
+            return -1;
+        }
+    }
+    if(frame_count == 0) return 0;
+    LATENCY_MARK(LATENCY_TX_DATALINK);
+    LOG_DEBUG(LOG_PHYSICAL, "Sending %zu frame(s) to %s...", frame_count, destination_mac);
+    physical_link_t* link = physical_link_get(destination_mac, true, false, atomic_load_explicit(&physical_coarse_now_ns, memory_order_relaxed));
+    if(link == NULL) return -1;
+    physical_peer_t* peer = &link->peer;
+    if(physical_peer_acquire(peer) != 0) {
+        physical_link_release(link);
         return -1;
     }
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Sending frame of length %zu to %s...\n", frame_length, destination_mac_address);
-    char dest_shm_name[50];
-    char dest_sem_name[50];
-    int dest_shm_fd = -1;
-    sem_t* dest_sem = SEM_FAILED;
-    void* dest_shm_ptr = MAP_FAILED;
-    int result = -1;
-    snprintf(dest_shm_name, sizeof(dest_shm_name), "%s", destination_mac_address);
-    snprintf(dest_sem_name, sizeof(dest_sem_name), "/sem_%s", destination_mac_address);
-    dest_sem = sem_open(dest_sem_name, 0);
-    if(dest_sem == SEM_FAILED) {
-        if(DEBUG_ENABLED || errno != ENOENT) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Info/Error: sem_open ('%s') failed: %s. Is destination '%s' running?\n", dest_sem_name, strerror(errno), dest_shm_name);
-        goto cleanup_send;
-    }
-    dest_shm_fd = shm_open(dest_shm_name, O_RDWR, 0666);
-    if(dest_shm_fd == -1) {
-        if(DEBUG_ENABLED || errno != ENOENT) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "PHYSICAL Send Info/Error: shm_open ('%s') failed: %s. Is destination running and initialized?\n", dest_shm_name, strerror(errno));
-        goto cleanup_send;
-    }
-    dest_shm_ptr = mmap(NULL, SHARED_MEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, dest_shm_fd, 0);
-    if(dest_shm_ptr == MAP_FAILED) {
-        perror("PHYSICAL Send Error: mmap failed for destination");
-        goto cleanup_send;
-    }
-    memcpy(dest_shm_ptr, frame_data, frame_length);
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Frame data written to destination shared memory %s.\n", dest_shm_name);
-    if(sem_post(dest_sem) == -1) {
-        perror("PHYSICAL Send Error: sem_post failed for destination");
-        goto cleanup_send;
-    }
-    if(DEBUG_ENABLED) {
-        printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Destination semaphore %s posted.\n", dest_sem_name);
-        printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_MAGENTA "PHYSICAL: Send to %s successful.\n", destination_mac_address);
-    }
-    result = 0;
-cleanup_send:
-    if(dest_shm_ptr != MAP_FAILED && munmap(dest_shm_ptr, SHARED_MEM_SIZE) == -1) perror("PHYSICAL Send Warning: munmap for destination failed");
-    if(dest_shm_fd != -1 && close(dest_shm_fd) == -1) perror("PHYSICAL Send Warning: close for destination shm fd failed");
-    if(dest_sem != SEM_FAILED && sem_close(dest_sem) == -1) perror("PHYSICAL Send Warning: sem_close for destination failed");
+    uint32_t unsignalled = 0; // Bit i: frames published into queue i since its semaphore was last posted
+    int result = 0;
+    bool stale = false;
+    for(size_t i = 0; i < frame_count && result == 0; i++) {
+        uint32_t queue = frames[i].flow_hash % peer->queue_count;
+        physical_ring_header_t* dest_ring = physical_ring_queue(peer->ring, queue);
+        if(frames[i].write == NULL && frames[i].length > dest_ring->slot_size) {
+            LOG_WARN(LOG_PHYSICAL, "Frame length (%zu) exceeds destination slot size (%u).", frames[i].length, dest_ring->slot_size);
+            result = -1;
+            break;
+        }
+        int enqueued = physical_ring_enqueue(dest_ring, &frames[i]);
+        if(enqueued == -1 && physical_send_no_wait) {
+            LOG_DEBUG(LOG_PHYSICAL, "Destination ring %s full. Dropping %zu frame(s).", peer->name, frame_count - i);
+            metrics_add(METRIC_PHY_SEND_DROPS, frame_count - i);
+            result = PHYSICAL_SEND_DROPPED;
+            break;
+        }
+        if(enqueued == -1) {
+            // The receiver still owns every slot. Make sure it is awake to drain what this batch
+            // already published, then back off until it frees one instead of dropping the frame.
+            physical_peer_post(peer, unsignalled);
+            unsignalled = 0;
+            struct timespec start_time, now;
+            clock_gettime(CLOCK_MONOTONIC, &start_time);
+            metrics_inc(METRIC_PHY_RING_FULL_WAITS);
+            LOG_DEBUG(LOG_PHYSICAL, "Destination ring %s full, waiting for a free slot...", peer->name);
+            while ((enqueued = physical_ring_enqueue(dest_ring, &frames[i])) == -1) {
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                long waited_ms = (now.tv_sec - start_time.tv_sec) * 1000 + (now.tv_nsec - start_time.tv_nsec) / 1000000;
+                if(waited_ms >= PHYSICAL_SEND_FULL_TIMEOUT_MS || !physical_peer_is_current(peer)) {
+                    LOG_WARN(LOG_PHYSICAL, "Destination ring %s stayed full for %ld ms. Dropping %zu frame(s).", peer->name, waited_ms, frame_count - i);
+                    metrics_add(METRIC_PHY_SEND_DROPS, frame_count - i);
+                    stale = true;
+                    result = -1;
+                    break;
+                }
+                sched_yield();
+            }
+        }
+        if(result != 0) break;
+        unsignalled |= 1u << queue;
+        if(enqueued == -2) {
+            LOG_WARN(LOG_PHYSICAL, "Frame does not fit destination slot size (%u).", dest_ring->slot_size);
+            result = -1;
+        }
+    }
+    if(unsignalled != 0) {
+        LOG_DEBUG(LOG_PHYSICAL, "Frame data written to destination rings of %s.", peer->name);
+        if(physical_peer_post(peer, unsignalled) != 0) result = -1;
+    }
+    pthread_rwlock_unlock(&peer->lock);
+    LATENCY_MARK(LATENCY_TX_PHYSICAL);
+    // The owner may have died without retiring its ring; map it afresh on the next send.
+    if(stale) physical_peer_invalidate(peer);
+    physical_link_release(link);
+    if(result == 0) LOG_DEBUG(LOG_PHYSICAL, "Send to %s successful.", destination_mac);
     return result;
 }
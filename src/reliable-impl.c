@@ -0,0 +1,776 @@
+#include "headers/reliable-impl.h"
+#include "headers/network-impl.h"
+#include "headers/checksum.h"
+#include "headers/log.h"
+#include "headers/metrics.h"
+#include "headers/latency.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// A queued segment of the send stream. Its payload is kept until the peer acknowledges it cumulatively.
+typedef struct {
+    packet_buffer_t* payload;
+    uint64_t payload_sum; // Unfolded checksum of the payload, so a retransmission only sums its new header
+    uint64_t sent_ns;
+    uint16_t length;
+    bool sacked;
+    bool lost;            // Waiting to be retransmitted
+    bool retransmitted;   // Sent more than once, so its acknowledgement gives no RTT sample (Karn)
+} reliable_segment_t;
+
+struct reliable_connection {
+    uint16_t local_port;
+    uint16_t remote_port;
+    uint32_t remote_address;
+    _Atomic uint32_t references; // The binding plus every thread working on the connection outside the table lock
+    reliable_receive_callback_t callback;
+    void* context;
+    pthread_mutex_t lock;
+    // Taken before lock is released and held while a burst is sent, so bursts reach the link in the order built.
+    pthread_mutex_t send_lock;
+    pthread_cond_t writable; // Send buffer space freed, or everything acknowledged
+    pthread_cond_t readable;
+    bool closed;
+    reliable_connection_t* next; // In the transmit thread's list of open connections
+    // Send side. Segments [snd_una, snd_nxt) are in flight and [snd_nxt, snd_end) still queued.
+    uint32_t tx_session;
+    uint32_t snd_una;
+    uint32_t snd_nxt;
+    uint32_t snd_end;
+    reliable_segment_t segments[RELIABLE_SEND_BUFFER];
+    uint32_t sacked_count;
+    uint32_t lost_count;
+    uint32_t cwnd;
+    uint32_t cwnd_count; // Acknowledgements towards the next congestion avoidance increase
+    uint32_t ssthresh;
+    uint32_t peer_window;
+    uint32_t dupacks;
+    bool in_recovery; // Fast recovery: the window holds at ssthresh
+    bool timed_out; // Slow start after a timeout, with no fast retransmit of what was already in flight
+    uint32_t recovery_point; // Either state ends once everything sent before it started is acknowledged
+    bool rtt_valid;
+    uint32_t srtt_us;
+    uint32_t rttvar_us;
+    uint32_t rto_us;
+    uint64_t rto_deadline_ns; // 0 while nothing is in flight
+    uint64_t persist_deadline_ns; // Zero window probe while the peer has no room and nothing is in flight
+    uint64_t delivered_sent_ns; // Latest send time of a first transmission the peer has acknowledged
+    // Receive side
+    bool rx_open;
+    uint32_t rx_session;
+    uint32_t rcv_nxt;
+    packet_buffer_t* out_of_order[RELIABLE_RECEIVE_WINDOW]; // Indexed by sequence number
+    uint32_t ack_pending; // In-order segments not acknowledged yet
+    bool ack_now;
+    uint64_t ack_deadline_ns;
+    uint32_t advertised_window;
+    packet_buffer_t* queue[RELIABLE_RECEIVE_WINDOW];
+    uint32_t queue_head;
+    uint32_t queue_count;
+    // Segments of one connection may be processed by several threads at once in pipeline mode. Each batch
+    // of in-order segments takes a ticket under the lock, and batches are handed to the callback in ticket order.
+    _Atomic uint32_t delivery_next;
+    _Atomic uint32_t delivery_serving;
+    reliable_stats_t stats;
+};
+
+// Built under the connection lock, sent after it is released.
+typedef struct {
+    packet_buffer_t* packets[RELIABLE_MAX_BURST + 1]; // Room for a pure acknowledgement behind a full burst
+    size_t count;
+} reliable_burst_t;
+
+_Static_assert(sizeof(transport_message_t) <= PACKET_BUFFER_CONTROL_SIZE, "received segment state must fit the packet buffer control area");
+
+// One table of local ports, separate from UDP's as in TCP/IP.
+static reliable_connection_t* reliable_ports[TRANSPORT_PORT_COUNT];
+static pthread_mutex_t reliable_port_locks[TRANSPORT_PORT_LOCK_STRIPES];
+static reliable_connection_t* reliable_connections = NULL;
+static pthread_mutex_t reliable_connections_lock = PTHREAD_MUTEX_INITIALIZER;
+// Acknowledgements, retransmissions and segments let out by an acknowledgement are sent by one transmit thread,
+// which also runs the timers. A receive worker that waited for room in the peer's ring could wait forever:
+// the peer's worker may be waiting for room in this instance's ring, whose slots the first worker holds.
+static pthread_t reliable_transmit_thread;
+static atomic_bool reliable_transmit_running = false;
+static atomic_bool reliable_transmit_pending = false;
+static pthread_mutex_t reliable_transmit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reliable_transmit_wakeup;
+
+static uint64_t reliable_pseudo_header_sum(uint32_t src_address, uint32_t dest_address, uint16_t length) {
+    uint64_t sum = internet_checksum_add16(internet_checksum_add16(0, RELIABLE_PROTOCOL_NUMBER), length);
+    sum = internet_checksum_add16(internet_checksum_add16(sum, (uint16_t)(src_address >> 16)), (uint16_t)src_address);
+    return internet_checksum_add16(internet_checksum_add16(sum, (uint16_t)(dest_address >> 16)), (uint16_t)dest_address);
+}
+
+static uint32_t reliable_pipe(const reliable_connection_t* connection) {
+    return connection->snd_nxt - connection->snd_una - connection->sacked_count - connection->lost_count;
+}
+
+static uint32_t reliable_receive_window(const reliable_connection_t* connection) {
+    return RELIABLE_RECEIVE_WINDOW - connection->queue_count;
+}
+
+static uint32_t reliable_sack_bits(const reliable_connection_t* connection) {
+    uint32_t sack = 0;
+    for(uint32_t i = 0; i < RELIABLE_SACK_BITS; i++) {
+        if(connection->out_of_order[(connection->rcv_nxt + 1 + i) % RELIABLE_RECEIVE_WINDOW] != NULL) sack |= 1u << i;
+    }
+    return sack;
+}
+
+static void reliable_connection_release(reliable_connection_t* connection) {
+    if(atomic_fetch_sub_explicit(&connection->references, 1, memory_order_acq_rel) != 1) return;
+    for(uint32_t seq = connection->snd_una; seq != connection->snd_end; seq++) packet_buffer_release(connection->segments[seq % RELIABLE_SEND_BUFFER].payload);
+    for(uint32_t i = 0; i < RELIABLE_RECEIVE_WINDOW; i++) packet_buffer_release(connection->out_of_order[i]);
+    for(uint32_t i = 0; i < connection->queue_count; i++) packet_buffer_release(connection->queue[(connection->queue_head + i) % RELIABLE_RECEIVE_WINDOW]);
+    pthread_cond_destroy(&connection->readable);
+    pthread_cond_destroy(&connection->writable);
+    pthread_mutex_destroy(&connection->send_lock);
+    pthread_mutex_destroy(&connection->lock);
+    free(connection);
+}
+
+static reliable_connection_t* reliable_lookup(uint16_t port) {
+    pthread_mutex_t* lock = &reliable_port_locks[port % TRANSPORT_PORT_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    reliable_connection_t* connection = reliable_ports[port];
+    if(connection != NULL) atomic_fetch_add_explicit(&connection->references, 1, memory_order_relaxed);
+    pthread_mutex_unlock(lock);
+    return connection;
+}
+
+static void reliable_wake_transmitter() {
+    if(atomic_exchange_explicit(&reliable_transmit_pending, true, memory_order_acq_rel)) return;
+    pthread_mutex_lock(&reliable_transmit_lock);
+    pthread_cond_signal(&reliable_transmit_wakeup);
+    pthread_mutex_unlock(&reliable_transmit_lock);
+}
+
+static bool reliable_has_work(const reliable_connection_t* connection) {
+    if(connection->ack_now || connection->lost_count > 0) return true;
+    return connection->snd_nxt != connection->snd_end && reliable_pipe(connection) < connection->cwnd && connection->snd_nxt - connection->snd_una < connection->peer_window;
+}
+
+static void reliable_deadline(struct timespec* deadline, int timeout_ms) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    if(timeout_ms <= 0) return;
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if(deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+// Builds a segment carrying the connection's current acknowledgement state. The payload is referenced, not copied.
+static packet_buffer_t* reliable_build(reliable_connection_t* connection, uint8_t flags, uint32_t seq, const reliable_segment_t* segment) {
+    packet_buffer_t* packet = packet_buffer_alloc(PACKET_BUFFER_DEFAULT_HEADROOM, 0);
+    if(packet == NULL) {
+        metrics_inc(METRIC_ALLOC_FAILURES);
+        return NULL;
+    }
+    size_t header_size = sizeof(reliable_header_t);
+    size_t payload_length = segment != NULL ? segment->length : 0;
+    reliable_header_t* header = (reliable_header_t*)packet_buffer_push(packet, header_size);
+    memset(header, 0, header_size);
+    header->src_port = connection->local_port;
+    header->dest_port = connection->remote_port;
+    header->session = connection->tx_session;
+    header->seq = seq;
+    header->length = (uint16_t)(header_size + payload_length);
+    header->flags = flags;
+    if(connection->rx_open) {
+        header->flags |= RELIABLE_FLAG_ACK;
+        header->ack_session = connection->rx_session;
+        header->ack = connection->rcv_nxt;
+        header->sack = reliable_sack_bits(connection);
+        header->window = (uint16_t)reliable_receive_window(connection);
+        connection->advertised_window = header->window;
+        connection->ack_pending = 0;
+        connection->ack_now = false;
+        connection->ack_deadline_ns = 0;
+    }
+    uint64_t sum = internet_checksum_add(reliable_pseudo_header_sum(network_local_address, connection->remote_address, header->length), header, header_size);
+    if(segment != NULL && payload_length > 0) {
+        packet_buffer_attach(packet, segment->payload->data, payload_length, segment->payload);
+        sum += segment->payload_sum;
+    }
+    header->checksum = internet_checksum_fold(sum);
+    return packet;
+}
+
+static void reliable_emit(reliable_connection_t* connection, reliable_burst_t* burst, uint32_t seq, uint64_t now) {
+    reliable_segment_t* segment = &connection->segments[seq % RELIABLE_SEND_BUFFER];
+    segment->sent_ns = now;
+    // A segment that cannot be built counts as sent and lost; the retransmission timer recovers it.
+    packet_buffer_t* packet = reliable_build(connection, RELIABLE_FLAG_DATA, seq, segment);
+    if(packet != NULL) burst->packets[burst->count++] = packet;
+    if(connection->rto_deadline_ns == 0) connection->rto_deadline_ns = now + (uint64_t)connection->rto_us * 1000;
+    connection->stats.segments_sent++;
+}
+
+static void reliable_emit_ack(reliable_connection_t* connection, reliable_burst_t* burst) {
+    packet_buffer_t* packet = reliable_build(connection, 0, connection->snd_nxt, NULL);
+    if(packet != NULL) burst->packets[burst->count++] = packet;
+}
+
+// Retransmissions go first, then new segments, while the congestion window has room. The oldest segment holds
+// up the whole stream, so it is retransmitted even when the window is full (RFC 6675). New segments must also
+// fit the window the peer advertised.
+static void reliable_push_window(reliable_connection_t* connection, reliable_burst_t* burst, uint64_t now) {
+    for(uint32_t seq = connection->snd_una; connection->lost_count > 0 && seq != connection->snd_nxt && burst->count < RELIABLE_MAX_BURST; seq++) {
+        reliable_segment_t* segment = &connection->segments[seq % RELIABLE_SEND_BUFFER];
+        if(!segment->lost) continue;
+        if(seq != connection->snd_una && reliable_pipe(connection) >= connection->cwnd) break;
+        segment->lost = false;
+        segment->retransmitted = true;
+        connection->lost_count--;
+        connection->stats.retransmits++;
+        metrics_inc(METRIC_RT_RETRANSMITS);
+        LOG_DEBUG(LOG_TRANSPORT, "Retransmitting segment %u on port %u.", seq, connection->local_port);
+        reliable_emit(connection, burst, seq, now);
+    }
+    while (connection->snd_nxt != connection->snd_end && burst->count < RELIABLE_MAX_BURST && reliable_pipe(connection) < connection->cwnd && connection->snd_nxt - connection->snd_una < connection->peer_window) {
+        reliable_emit(connection, burst, connection->snd_nxt, now);
+        connection->snd_nxt++;
+    }
+}
+
+// Sends outside the connection lock.
+static void reliable_send_burst(const reliable_connection_t* connection, reliable_burst_t* burst) {
+    for(size_t i = 0; i < burst->count; i++) {
+        const reliable_header_t* header = (const reliable_header_t*)burst->packets[i]->data;
+        if(header->flags & RELIABLE_FLAG_DATA) metrics_inc(METRIC_RT_SEGMENTS_SENT);
+        else metrics_inc(METRIC_RT_ACKS_SENT);
+        if(handle_transport_to_network(burst->packets[i], RELIABLE_PROTOCOL_NUMBER, connection->remote_address) != 0) LOG_DEBUG(LOG_TRANSPORT, "Network layer did not take segment %u; it will be retransmitted.", header->seq);
+        packet_buffer_release(burst->packets[i]);
+    }
+    burst->count = 0;
+}
+
+// RFC 6298 smoothed RTT and variance, with RELIABLE_TIMER_TICK_US as the clock granularity.
+static void reliable_rtt_sample(reliable_connection_t* connection, uint64_t rtt_ns) {
+    uint32_t rtt_us = rtt_ns / 1000 > RELIABLE_MAX_RTO_US ? RELIABLE_MAX_RTO_US : (uint32_t)(rtt_ns / 1000);
+    if(!connection->rtt_valid) {
+        connection->srtt_us = rtt_us;
+        connection->rttvar_us = rtt_us / 2;
+        connection->rtt_valid = true;
+    }
+    else {
+        uint32_t delta = connection->srtt_us > rtt_us ? connection->srtt_us - rtt_us : rtt_us - connection->srtt_us;
+        connection->rttvar_us = (3 * connection->rttvar_us + delta) / 4;
+        connection->srtt_us = (7 * connection->srtt_us + rtt_us) / 8;
+    }
+    uint32_t variance = 4 * connection->rttvar_us > RELIABLE_TIMER_TICK_US ? 4 * connection->rttvar_us : RELIABLE_TIMER_TICK_US;
+    uint32_t rto = connection->srtt_us + variance;
+    connection->rto_us = rto < RELIABLE_MIN_RTO_US ? RELIABLE_MIN_RTO_US : rto > RELIABLE_MAX_RTO_US ? RELIABLE_MAX_RTO_US : rto;
+}
+
+static void reliable_reduce_window(reliable_connection_t* connection) {
+    uint32_t flight = connection->snd_nxt - connection->snd_una;
+    connection->ssthresh = flight / 2 > 2 ? flight / 2 : 2;
+    connection->recovery_point = connection->snd_nxt;
+    connection->cwnd_count = 0;
+}
+
+static void reliable_on_ack(reliable_connection_t* connection, const reliable_header_t* header, bool pure_ack, uint64_t now) {
+    uint32_t ack = header->ack;
+    // Ignore acknowledgements older than the last one, and any of segments never sent.
+    if((int32_t)(ack - connection->snd_una) < 0 || (int32_t)(ack - connection->snd_nxt) > 0) return;
+    connection->peer_window = header->window;
+    if(ack != connection->snd_una) {
+        reliable_segment_t* newest = &connection->segments[(ack - 1) % RELIABLE_SEND_BUFFER];
+        if(!newest->retransmitted) reliable_rtt_sample(connection, now - newest->sent_ns);
+        for(uint32_t seq = connection->snd_una; seq != ack; seq++) {
+            reliable_segment_t* segment = &connection->segments[seq % RELIABLE_SEND_BUFFER];
+            if(segment->sacked) connection->sacked_count--;
+            if(segment->lost) connection->lost_count--;
+            if(!segment->retransmitted && segment->sent_ns > connection->delivered_sent_ns) connection->delivered_sent_ns = segment->sent_ns;
+            packet_buffer_release(segment->payload);
+            memset(segment, 0, sizeof(*segment));
+            // Slow start below ssthresh, then one segment per window of acknowledgements.
+            if(connection->in_recovery || connection->cwnd >= RELIABLE_SEND_BUFFER) continue;
+            if(connection->cwnd < connection->ssthresh) connection->cwnd++;
+            else if(++connection->cwnd_count >= connection->cwnd) {
+                connection->cwnd++;
+                connection->cwnd_count = 0;
+            }
+        }
+        connection->snd_una = ack;
+        connection->dupacks = 0;
+        if((connection->in_recovery || connection->timed_out) && (int32_t)(ack - connection->recovery_point) >= 0) {
+            if(connection->in_recovery) connection->cwnd = connection->ssthresh;
+            connection->in_recovery = false;
+            connection->timed_out = false;
+        }
+        connection->rto_deadline_ns = ack != connection->snd_nxt ? now + (uint64_t)connection->rto_us * 1000 : 0;
+        pthread_cond_broadcast(&connection->writable);
+    }
+    else if(pure_ack && ack != connection->snd_nxt) connection->dupacks++;
+    uint32_t highest_sacked = ack;
+    for(uint32_t i = 0; i < RELIABLE_SACK_BITS; i++) {
+        if((header->sack & (1u << i)) == 0) continue;
+        uint32_t seq = ack + 1 + i;
+        if((int32_t)(seq - connection->snd_nxt) >= 0) break;
+        highest_sacked = seq;
+        reliable_segment_t* segment = &connection->segments[seq % RELIABLE_SEND_BUFFER];
+        if(segment->sacked) continue;
+        segment->sacked = true;
+        connection->sacked_count++;
+        if(!segment->retransmitted && segment->sent_ns > connection->delivered_sent_ns) connection->delivered_sent_ns = segment->sent_ns;
+        if(segment->lost) {
+            segment->lost = false;
+            connection->lost_count--;
+        }
+    }
+    if(ack == connection->snd_nxt || connection->segments[ack % RELIABLE_SEND_BUFFER].sacked) return;
+    if(connection->dupacks < RELIABLE_DUPACK_THRESHOLD && connection->sacked_count < RELIABLE_DUPACK_THRESHOLD) return;
+    // Fast retransmit: every hole below the highest selectively acknowledged segment is presumed lost.
+    // After a timeout the window is already cut, and the holes are already marked lost.
+    if(!connection->in_recovery && !connection->timed_out) {
+        reliable_reduce_window(connection);
+        connection->in_recovery = true;
+        connection->cwnd = connection->ssthresh;
+        connection->stats.fast_recoveries++;
+        LOG_DEBUG(LOG_TRANSPORT, "Fast retransmit from segment %u on port %u (cwnd %u).", ack, connection->local_port, connection->cwnd);
+    }
+    // A retransmission is presumed lost too once something sent well after it has arrived (RFC 8985, RACK).
+    uint64_t reordering_ns = (uint64_t)(connection->srtt_us / 4 > RELIABLE_TIMER_TICK_US ? connection->srtt_us / 4 : RELIABLE_TIMER_TICK_US) * 1000;
+    if(highest_sacked == ack) highest_sacked = ack + 1;
+    for(uint32_t seq = ack; seq != highest_sacked; seq++) {
+        reliable_segment_t* segment = &connection->segments[seq % RELIABLE_SEND_BUFFER];
+        if(segment->sacked || segment->lost) continue;
+        if(segment->retransmitted && segment->sent_ns + reordering_ns >= connection->delivered_sent_ns) continue;
+        segment->lost = true;
+        connection->lost_count++;
+    }
+}
+
+// Takes ownership of packet. Returns the number of segments now in order for the callback, stored in deliver.
+static size_t reliable_on_data(reliable_connection_t* connection, const reliable_header_t* header, packet_buffer_t* packet, packet_buffer_t** deliver, uint64_t now) {
+    if(!connection->rx_open || header->session != connection->rx_session) {
+        // The peer opened a new connection: its stream starts over.
+        for(uint32_t i = 0; i < RELIABLE_RECEIVE_WINDOW; i++) {
+            packet_buffer_release(connection->out_of_order[i]);
+            connection->out_of_order[i] = NULL;
+        }
+        connection->rx_open = true;
+        connection->rx_session = header->session;
+        connection->rcv_nxt = 0;
+        connection->ack_pending = 0;
+        LOG_DEBUG(LOG_TRANSPORT, "Port %u: peer session %08x started.", connection->local_port, header->session);
+    }
+    uint32_t offset = header->seq - connection->rcv_nxt;
+    if((int32_t)offset >= 0 && offset >= reliable_receive_window(connection)) {
+        metrics_inc(METRIC_RT_WINDOW_DROPS);
+        connection->ack_now = true;
+        packet_buffer_release(packet);
+        return 0;
+    }
+    if((int32_t)offset < 0 || connection->out_of_order[header->seq % RELIABLE_RECEIVE_WINDOW] != NULL) {
+        metrics_inc(METRIC_RT_DUPLICATES);
+        connection->ack_now = true;
+        packet_buffer_release(packet);
+        return 0;
+    }
+    connection->out_of_order[header->seq % RELIABLE_RECEIVE_WINDOW] = packet;
+    if(offset > 0) {
+        // Out of order: acknowledge at once so the sender sees the hole in the SACK bitmap.
+        connection->ack_now = true;
+        return 0;
+    }
+    size_t count = 0;
+    packet_buffer_t* next;
+    while ((next = connection->out_of_order[connection->rcv_nxt % RELIABLE_RECEIVE_WINDOW]) != NULL) {
+        connection->out_of_order[connection->rcv_nxt % RELIABLE_RECEIVE_WINDOW] = NULL;
+        connection->rcv_nxt++;
+        connection->stats.segments_received++;
+        metrics_add(METRIC_RT_BYTES_DELIVERED, next->length);
+        if(connection->callback != NULL) deliver[count] = next;
+        else {
+            connection->queue[(connection->queue_head + connection->queue_count) % RELIABLE_RECEIVE_WINDOW] = next;
+            connection->queue_count++;
+        }
+        count++;
+    }
+    if(connection->callback == NULL) pthread_cond_signal(&connection->readable);
+    if(count > 1) connection->ack_now = true;
+    if(connection->ack_pending == 0) connection->ack_deadline_ns = now + RELIABLE_DELAYED_ACK_US * 1000ull;
+    connection->ack_pending += count;
+    if(connection->ack_pending >= RELIABLE_ACK_EVERY) connection->ack_now = true;
+    return connection->callback != NULL ? count : 0;
+}
+
+void handle_network_to_reliable(void* network_payload) {
+    if(network_payload == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Received NULL data pointer from network layer.\n");
+        return;
+    }
+    LATENCY_MARK(LATENCY_RX_QUEUE_TRANSPORT);
+    packet_buffer_t* packet = (packet_buffer_t*)network_payload;
+    network_receive_control_t addresses = *(const network_receive_control_t*)packet->control;
+    size_t header_size = sizeof(reliable_header_t);
+    if(packet->length < header_size) {
+        metrics_inc(METRIC_TP_MALFORMED);
+        LOG_WARN(LOG_TRANSPORT, "Received data block too small for reliable segment header.");
+        packet_buffer_release(packet);
+        return;
+    }
+    reliable_header_t header;
+    memcpy(&header, packet->data, header_size);
+    if(header.length < header_size || header.length > packet->length) {
+        metrics_inc(METRIC_TP_MALFORMED);
+        LOG_WARN(LOG_TRANSPORT, "Reliable segment length (%u) outside header size (%zu) to datagram size (%zu). Discarding.", header.length, header_size, packet->length);
+        packet_buffer_release(packet);
+        return;
+    }
+    packet_buffer_trim(packet, header.length);
+    if(internet_checksum_fold(internet_checksum_add(reliable_pseudo_header_sum(addresses.src_address, addresses.dest_address, header.length), packet->data, header.length)) != 0) {
+        metrics_inc(METRIC_TP_CHECKSUM_FAILURES);
+        LOG_WARN(LOG_TRANSPORT, "Reliable segment checksum mismatch (Received=0x%04X). Discarding.", header.checksum);
+        packet_buffer_release(packet);
+        return;
+    }
+    metrics_inc(METRIC_RT_SEGMENTS_RECEIVED);
+    LOG_DEBUG(LOG_TRANSPORT, "Received reliable segment. Src Port: %u, Dest Port: %u, Seq: %u, Ack: %u, Window: %u, Length: %u", header.src_port, header.dest_port, header.seq, header.ack, header.window, header.length);
+    reliable_connection_t* connection = reliable_lookup(header.dest_port);
+    if(connection == NULL || connection->remote_port != header.src_port || (connection->remote_address != 0 && connection->remote_address != addresses.src_address)) {
+        metrics_inc(METRIC_TP_NO_PORT);
+        LOG_DEBUG(LOG_TRANSPORT, "No reliable connection from port %u to port %u. Discarding.", header.src_port, header.dest_port);
+        if(connection != NULL) reliable_connection_release(connection);
+        packet_buffer_release(packet);
+        return;
+    }
+    packet_buffer_pull(packet, header_size);
+    *(transport_message_t*)packet->control = (transport_message_t){ .data = packet->data, .length = packet->length, .src_address = addresses.src_address, .src_port = header.src_port, .dest_port = header.dest_port, .block = packet };
+    packet_buffer_t* deliver[RELIABLE_RECEIVE_WINDOW];
+    size_t deliver_count = 0;
+    uint32_t ticket = 0;
+    uint64_t now = latency_now_ns();
+    pthread_mutex_lock(&connection->lock);
+    if((header.flags & RELIABLE_FLAG_ACK) && header.ack_session == connection->tx_session) reliable_on_ack(connection, &header, (header.flags & RELIABLE_FLAG_DATA) == 0, now);
+    if(header.flags & RELIABLE_FLAG_DATA) deliver_count = reliable_on_data(connection, &header, packet, deliver, now);
+    else packet_buffer_release(packet);
+    bool wake = reliable_has_work(connection);
+    if(deliver_count > 0) ticket = atomic_fetch_add_explicit(&connection->delivery_next, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&connection->lock);
+    if(wake) reliable_wake_transmitter();
+    LATENCY_MARK(LATENCY_RX_TRANSPORT);
+    if(deliver_count > 0) {
+        while (atomic_load_explicit(&connection->delivery_serving, memory_order_acquire) != ticket) sched_yield();
+        for(size_t i = 0; i < deliver_count; i++) {
+            metrics_inc(METRIC_APP_MESSAGES_RECEIVED);
+            connection->callback(connection, (transport_message_t*)deliver[i]->control, connection->context);
+        }
+        atomic_fetch_add_explicit(&connection->delivery_serving, 1, memory_order_release);
+    }
+    reliable_connection_release(connection);
+    LATENCY_MARK(LATENCY_RX_APPLICATION);
+    LATENCY_END(LATENCY_RX_TOTAL);
+}
+
+int reliable_send(reliable_connection_t* connection, const void* data, size_t length) {
+    if(connection == NULL || (data == NULL && length > 0)) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Reliable send with NULL connection or data.\n");
+        return -1;
+    }
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t offset = 0;
+    int result = 0;
+    pthread_mutex_lock(&connection->lock);
+    while (offset < length && result == 0) {
+        while (!connection->closed && connection->snd_end - connection->snd_una >= RELIABLE_SEND_BUFFER) pthread_cond_wait(&connection->writable, &connection->lock);
+        if(connection->closed) {
+            result = -1;
+            break;
+        }
+        while (offset < length && connection->snd_end - connection->snd_una < RELIABLE_SEND_BUFFER) {
+            size_t piece = length - offset < RELIABLE_MSS ? length - offset : RELIABLE_MSS;
+            packet_buffer_t* payload = packet_buffer_alloc(0, piece);
+            if(payload == NULL) {
+                metrics_inc(METRIC_ALLOC_FAILURES);
+                LOG_WARN(LOG_TRANSPORT, "Failed to allocate a reliable segment for port %u.", connection->local_port);
+                result = -1;
+                break;
+            }
+            reliable_segment_t* segment = &connection->segments[connection->snd_end % RELIABLE_SEND_BUFFER];
+            segment->payload_sum = internet_checksum_copy(0, packet_buffer_put(payload, piece), bytes + offset, piece);
+            segment->payload = payload;
+            segment->length = (uint16_t)piece;
+            connection->snd_end++;
+            offset += piece;
+        }
+        reliable_burst_t burst = { .count = 0 };
+        reliable_push_window(connection, &burst, latency_now_ns());
+        pthread_mutex_lock(&connection->send_lock);
+        pthread_mutex_unlock(&connection->lock);
+        reliable_send_burst(connection, &burst);
+        pthread_mutex_unlock(&connection->send_lock);
+        pthread_mutex_lock(&connection->lock);
+    }
+    pthread_mutex_unlock(&connection->lock);
+    if(result == 0) metrics_inc(METRIC_APP_MESSAGES_SENT);
+    return result;
+}
+
+int reliable_flush(reliable_connection_t* connection, int timeout_ms) {
+    if(connection == NULL) return -1;
+    struct timespec deadline;
+    reliable_deadline(&deadline, timeout_ms);
+    pthread_mutex_lock(&connection->lock);
+    int error = 0;
+    while (connection->snd_una != connection->snd_end && !connection->closed && error != ETIMEDOUT) {
+        if(timeout_ms < 0) pthread_cond_wait(&connection->writable, &connection->lock);
+        else error = pthread_cond_timedwait(&connection->writable, &connection->lock, &deadline);
+    }
+    int result = connection->snd_una == connection->snd_end ? 0 : -1;
+    pthread_mutex_unlock(&connection->lock);
+    return result;
+}
+
+int reliable_recv_many(reliable_connection_t* connection, transport_message_t* messages, size_t max_messages, int timeout_ms) {
+    if(connection == NULL || connection->callback != NULL || (messages == NULL && max_messages > 0)) return -1;
+    atomic_fetch_add_explicit(&connection->references, 1, memory_order_relaxed);
+    struct timespec deadline;
+    reliable_deadline(&deadline, timeout_ms);
+    pthread_mutex_lock(&connection->lock);
+    int error = 0;
+    while (connection->queue_count == 0 && !connection->closed && timeout_ms != 0 && error != ETIMEDOUT) {
+        if(timeout_ms < 0) pthread_cond_wait(&connection->readable, &connection->lock);
+        else error = pthread_cond_timedwait(&connection->readable, &connection->lock, &deadline);
+    }
+    int received = 0;
+    if(connection->queue_count == 0 && connection->closed) received = -1;
+    while (connection->queue_count > 0 && (size_t)received < max_messages) {
+        packet_buffer_t* packet = connection->queue[connection->queue_head];
+        connection->queue_head = (connection->queue_head + 1) % RELIABLE_RECEIVE_WINDOW;
+        connection->queue_count--;
+        messages[received] = *(transport_message_t*)packet->control;
+        received++;
+    }
+    // Tell a sender that found the window closed, or nearly so, that there is room again.
+    bool wake = received > 0 && connection->rx_open && reliable_receive_window(connection) >= connection->advertised_window + RELIABLE_RECEIVE_WINDOW / 4;
+    if(wake) connection->ack_now = true;
+    pthread_mutex_unlock(&connection->lock);
+    if(wake) reliable_wake_transmitter();
+    reliable_connection_release(connection);
+    return received;
+}
+
+// Everything one connection has to send: retransmissions after a timeout, zero window probes, segments the
+// windows let out, and acknowledgements that are due.
+static void reliable_transmit(reliable_connection_t* connection, reliable_burst_t* burst, uint64_t now) {
+    if(connection->rto_deadline_ns != 0 && now >= connection->rto_deadline_ns && connection->snd_una != connection->snd_nxt) {
+        // Everything still unacknowledged is presumed lost and the window collapses to one segment, then grows
+        // again in slow start (RFC 5681, 3.1). A repeated timeout keeps the ssthresh of the first.
+        if(!connection->timed_out) reliable_reduce_window(connection);
+        connection->in_recovery = false;
+        connection->timed_out = true;
+        connection->cwnd = 1;
+        connection->dupacks = 0;
+        for(uint32_t seq = connection->snd_una; seq != connection->snd_nxt; seq++) {
+            reliable_segment_t* segment = &connection->segments[seq % RELIABLE_SEND_BUFFER];
+            if(segment->sacked || segment->lost) continue;
+            segment->lost = true;
+            connection->lost_count++;
+        }
+        connection->rto_us = connection->rto_us * 2 > RELIABLE_MAX_RTO_US ? RELIABLE_MAX_RTO_US : connection->rto_us * 2;
+        connection->rto_deadline_ns = now + (uint64_t)connection->rto_us * 1000;
+        connection->stats.timeouts++;
+        metrics_inc(METRIC_RT_TIMEOUTS);
+        LOG_DEBUG(LOG_TRANSPORT, "Retransmission timeout on port %u at segment %u (RTO now %u us).", connection->local_port, connection->snd_una, connection->rto_us);
+    }
+    if(connection->snd_una == connection->snd_nxt && connection->snd_nxt != connection->snd_end && connection->peer_window == 0) {
+        if(connection->persist_deadline_ns == 0) connection->persist_deadline_ns = now + (uint64_t)connection->rto_us * 1000;
+        else if(now >= connection->persist_deadline_ns) {
+            // Send one segment past the closed window. The peer drops it if there is still no room, but its
+            // acknowledgement carries the current window; the retransmission timer keeps probing from here on.
+            connection->persist_deadline_ns = 0;
+            reliable_emit(connection, burst, connection->snd_nxt, now);
+            connection->snd_nxt++;
+        }
+    }
+    else connection->persist_deadline_ns = 0;
+    reliable_push_window(connection, burst, now);
+    // Outgoing data already carried the acknowledgement if there was any.
+    if(connection->ack_now || (connection->ack_pending > 0 && now >= connection->ack_deadline_ns)) reliable_emit_ack(connection, burst);
+}
+
+static void* reliable_transmit_loop(void* argument) {
+    (void)argument;
+    reliable_connection_t** snapshot = NULL;
+    size_t snapshot_capacity = 0;
+    while (atomic_load(&reliable_transmit_running)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += RELIABLE_TIMER_TICK_US * 1000;
+        if(deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_mutex_lock(&reliable_transmit_lock);
+        while (!atomic_load_explicit(&reliable_transmit_pending, memory_order_acquire) && atomic_load(&reliable_transmit_running)) {
+            if(pthread_cond_timedwait(&reliable_transmit_wakeup, &reliable_transmit_lock, &deadline) == ETIMEDOUT) break;
+        }
+        pthread_mutex_unlock(&reliable_transmit_lock);
+        atomic_store_explicit(&reliable_transmit_pending, false, memory_order_release);
+        // Work on referenced copies of the list, so connections can be opened and closed during the sends.
+        pthread_mutex_lock(&reliable_connections_lock);
+        size_t count = 0;
+        for(reliable_connection_t* connection = reliable_connections; connection != NULL; connection = connection->next) count++;
+        if(count > snapshot_capacity) {
+            reliable_connection_t** grown = (reliable_connection_t**)realloc(snapshot, count * sizeof(reliable_connection_t*));
+            if(grown != NULL) {
+                snapshot = grown;
+                snapshot_capacity = count;
+            }
+        }
+        count = 0;
+        for(reliable_connection_t* connection = reliable_connections; connection != NULL && count < snapshot_capacity; connection = connection->next) {
+            atomic_fetch_add_explicit(&connection->references, 1, memory_order_relaxed);
+            snapshot[count++] = connection;
+        }
+        pthread_mutex_unlock(&reliable_connections_lock);
+        for(size_t i = 0; i < count; i++) {
+            reliable_burst_t burst = { .count = 0 };
+            pthread_mutex_lock(&snapshot[i]->lock);
+            if(!snapshot[i]->closed) reliable_transmit(snapshot[i], &burst, latency_now_ns());
+            // A full burst may have left more to send; come straight back for it.
+            if(!snapshot[i]->closed && reliable_has_work(snapshot[i])) atomic_store(&reliable_transmit_pending, true);
+            pthread_mutex_lock(&snapshot[i]->send_lock);
+            pthread_mutex_unlock(&snapshot[i]->lock);
+            reliable_send_burst(snapshot[i], &burst);
+            pthread_mutex_unlock(&snapshot[i]->send_lock);
+            reliable_connection_release(snapshot[i]);
+        }
+    }
+    free(snapshot);
+    return NULL;
+}
+
+int reliable_layer_init() {
+    for(int i = 0; i < TRANSPORT_PORT_LOCK_STRIPES; i++) pthread_mutex_init(&reliable_port_locks[i], NULL);
+    memset(reliable_ports, 0, sizeof(reliable_ports));
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&reliable_transmit_wakeup, &attributes);
+    pthread_condattr_destroy(&attributes);
+    atomic_store(&reliable_transmit_running, true);
+    if(pthread_create(&reliable_transmit_thread, NULL, reliable_transmit_loop, NULL) != 0) {
+        atomic_store(&reliable_transmit_running, false);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Failed to start the reliable transmit thread.\n");
+        return -1;
+    }
+    return 0;
+}
+
+void reliable_layer_shutdown() {
+    if(!atomic_exchange(&reliable_transmit_running, false)) return;
+    pthread_mutex_lock(&reliable_transmit_lock);
+    pthread_cond_signal(&reliable_transmit_wakeup);
+    pthread_mutex_unlock(&reliable_transmit_lock);
+    pthread_join(reliable_transmit_thread, NULL);
+    for(uint32_t port = 0; port < TRANSPORT_PORT_COUNT; port++) {
+        if(reliable_ports[port] != NULL) {
+            LOG_DEBUG(LOG_TRANSPORT, "Closing reliable connection on port %u.", port);
+            reliable_close(reliable_ports[port]);
+        }
+    }
+}
+
+void reliable_layer_destroy() {
+    pthread_cond_destroy(&reliable_transmit_wakeup);
+    for(int i = 0; i < TRANSPORT_PORT_LOCK_STRIPES; i++) pthread_mutex_destroy(&reliable_port_locks[i]);
+}
+
+reliable_connection_t* reliable_open(uint16_t local_port, uint32_t remote_address, uint16_t remote_port, reliable_receive_callback_t callback, void* context) {
+    reliable_connection_t* connection = (reliable_connection_t*)calloc(1, sizeof(reliable_connection_t));
+    if(connection == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Failed to allocate reliable connection for port %u.\n", local_port);
+        return NULL;
+    }
+    connection->local_port = local_port;
+    connection->remote_address = remote_address;
+    connection->remote_port = remote_port;
+    connection->callback = callback;
+    connection->context = context;
+    atomic_init(&connection->references, 1);
+    // Distinguishes this incarnation's stream from segments of an earlier one still on the link.
+    uint64_t seed = latency_now_ns() ^ ((uint64_t)getpid() << 32) ^ ((uint64_t)local_port << 16) ^ remote_port ^ ((uint64_t)remote_address << 24);
+    seed ^= seed >> 33;
+    seed *= 0xFF51AFD7ED558CCDull;
+    seed ^= seed >> 33;
+    connection->tx_session = (uint32_t)seed != 0 ? (uint32_t)seed : 1;
+    connection->cwnd = RELIABLE_INITIAL_CWND;
+    connection->ssthresh = RELIABLE_SEND_BUFFER;
+    connection->peer_window = RELIABLE_RECEIVE_WINDOW;
+    connection->rto_us = RELIABLE_INITIAL_RTO_US;
+    connection->advertised_window = RELIABLE_RECEIVE_WINDOW;
+    pthread_mutex_init(&connection->lock, NULL);
+    pthread_mutex_init(&connection->send_lock, NULL);
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&connection->writable, &attributes);
+    pthread_cond_init(&connection->readable, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_mutex_t* lock = &reliable_port_locks[local_port % TRANSPORT_PORT_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    bool taken = reliable_ports[local_port] != NULL;
+    if(!taken) reliable_ports[local_port] = connection;
+    pthread_mutex_unlock(lock);
+    if(taken) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Reliable port %u already has a connection.\n", local_port);
+        reliable_connection_release(connection);
+        return NULL;
+    }
+    pthread_mutex_lock(&reliable_connections_lock);
+    connection->next = reliable_connections;
+    reliable_connections = connection;
+    pthread_mutex_unlock(&reliable_connections_lock);
+    LOG_DEBUG(LOG_TRANSPORT, "Opened reliable connection from port %u to port %u (%s, session %08x).", local_port, remote_port, callback != NULL ? "callback" : "receive queue", connection->tx_session);
+    return connection;
+}
+
+void reliable_close(reliable_connection_t* connection) {
+    if(connection == NULL) return;
+    pthread_mutex_t* lock = &reliable_port_locks[connection->local_port % TRANSPORT_PORT_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    if(reliable_ports[connection->local_port] == connection) reliable_ports[connection->local_port] = NULL;
+    pthread_mutex_unlock(lock);
+    pthread_mutex_lock(&reliable_connections_lock);
+    reliable_connection_t** link = &reliable_connections;
+    while (*link != NULL && *link != connection) link = &(*link)->next;
+    if(*link != NULL) *link = connection->next;
+    pthread_mutex_unlock(&reliable_connections_lock);
+    pthread_mutex_lock(&connection->lock);
+    connection->closed = true;
+    pthread_cond_broadcast(&connection->writable);
+    pthread_cond_broadcast(&connection->readable);
+    pthread_mutex_unlock(&connection->lock);
+    LOG_DEBUG(LOG_TRANSPORT, "Closed reliable connection on port %u.", connection->local_port);
+    reliable_connection_release(connection);
+}
+
+void reliable_get_stats(reliable_connection_t* connection, reliable_stats_t* stats) {
+    pthread_mutex_lock(&connection->lock);
+    *stats = connection->stats;
+    stats->cwnd = connection->cwnd;
+    stats->ssthresh = connection->ssthresh;
+    stats->peer_window = connection->peer_window;
+    stats->srtt_us = connection->srtt_us;
+    stats->rto_us = connection->rto_us;
+    stats->in_flight = connection->snd_nxt - connection->snd_una;
+    stats->queued = connection->snd_end - connection->snd_nxt;
+    pthread_mutex_unlock(&connection->lock);
+}
@@ -0,0 +1,203 @@
+#include "headers/rx-dispatch.h"
+#include "headers/data-link-impl.h"
+#include "headers/network-impl.h"
+#include "headers/thread-pool.h"
+#include "headers/log.h"
+#include "headers/metrics.h"
+#include "headers/buffer-pool.h"
+#include "headers/latency.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+
+// Single-producer (receiver thread of one receive queue) / single-consumer (worker) queue of claimed frames.
+typedef struct {
+    _Atomic uint64_t head __attribute__((aligned(PHYSICAL_CACHE_LINE))); // Next position the receiver fills
+    _Atomic uint64_t tail __attribute__((aligned(PHYSICAL_CACHE_LINE))); // Next position the worker takes
+    atomic_bool sleeping; // Set while the worker may be blocked on wakeup
+    sem_t wakeup;
+    pthread_t tid;
+    bool started;
+    physical_rx_frame_t** queue;
+} rx_worker_t;
+
+// A pipeline hop queued on the thread pool; the wrapper lets the metrics see when it leaves the queue
+// and carries the latency trace of the packet to the thread that picks it up.
+typedef struct {
+    void (*handler)(void*);
+    void* data;
+    latency_trace_t trace;
+} rx_task_t;
+
+extern threadpool thpool;
+rx_mode_t rx_mode = RX_MODE_RUN_TO_COMPLETION;
+int rx_worker_count = RX_DEFAULT_WORKERS;
+static rx_worker_t* rx_workers = NULL;
+static int rx_workers_started = 0;
+static uint32_t rx_queue_capacity = 0;
+static atomic_bool rx_workers_running = false;
+
+const char* rx_mode_name(rx_mode_t mode) {
+    switch (mode) {
+        case RX_MODE_RUN_TO_COMPLETION: return "rtc";
+        case RX_MODE_PIPELINE: return "pipeline";
+        default: return "unknown";
+    }
+}
+
+int rx_mode_parse(const char* name, rx_mode_t* mode) {
+    for(int i = 0; i < RX_MODE_COUNT; i++) {
+        if(strcmp(name, rx_mode_name((rx_mode_t)i)) == 0) {
+            *mode = (rx_mode_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void* rx_worker_thread(void* param) {
+    rx_worker_t* worker = (rx_worker_t*)param;
+    while (true) {
+        uint64_t tail = atomic_load_explicit(&worker->tail, memory_order_relaxed);
+        if(tail != atomic_load(&worker->head)) {
+            physical_rx_frame_t* frame = worker->queue[tail % rx_queue_capacity];
+            atomic_store_explicit(&worker->tail, tail + 1, memory_order_release);
+            metrics_inc(METRIC_RX_STARTED);
+            if(latency_tracing) latency_thread_trace = frame->trace;
+            handle_physical_to_data_link(frame);
+            continue;
+        }
+        // An idle worker hands a partly coalesced datagram to the reassembly table, where it is charged to the
+        // memory cap and times out if the rest never comes.
+        network_gro_flush();
+        if(!atomic_load(&rx_workers_running)) break;
+        // Announce the sleep before the final emptiness check; the receiver posts only when it sees the flag.
+        atomic_store(&worker->sleeping, true);
+        if(tail != atomic_load(&worker->head) || !atomic_load(&rx_workers_running)) {
+            atomic_store(&worker->sleeping, false);
+            continue;
+        }
+        while (sem_wait(&worker->wakeup) == -1 && errno == EINTR) { }
+        atomic_store(&worker->sleeping, false);
+    }
+    return NULL;
+}
+
+int rx_dispatch_init(uint32_t queue_capacity) {
+    if(rx_mode != RX_MODE_RUN_TO_COMPLETION) return 0;
+    if(rx_worker_count < 1 || rx_worker_count > RX_MAX_WORKERS) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "RX Error: Worker count %d out of range (1-%d).\n", rx_worker_count, RX_MAX_WORKERS);
+        return -1;
+    }
+    rx_workers = (rx_worker_t*)aligned_alloc(PHYSICAL_CACHE_LINE, sizeof(rx_worker_t) * (size_t)rx_worker_count);
+    if(rx_workers == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "RX Error: Failed to allocate %d receive workers.\n", rx_worker_count);
+        return -1;
+    }
+    memset(rx_workers, 0, sizeof(rx_worker_t) * (size_t)rx_worker_count);
+    rx_queue_capacity = queue_capacity;
+    atomic_store(&rx_workers_running, true);
+    for(int i = 0; i < rx_worker_count; i++) {
+        rx_worker_t* worker = &rx_workers[i];
+        // A ring slot is queued at most once, so a queue as deep as the ring can never overflow.
+        worker->queue = (physical_rx_frame_t**)calloc(queue_capacity, sizeof(physical_rx_frame_t*));
+        if(worker->queue == NULL || sem_init(&worker->wakeup, 0, 0) == -1) {
+            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "RX Error: Failed to set up receive worker %d.\n", i);
+            free(worker->queue);
+            worker->queue = NULL;
+            rx_dispatch_shutdown();
+            return -1;
+        }
+        rx_workers_started = i + 1;
+        if(pthread_create(&worker->tid, NULL, rx_worker_thread, worker) != 0) {
+            perror(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_RED "RX Error: Failed to create receive worker thread");
+            rx_dispatch_shutdown();
+            return -1;
+        }
+        worker->started = true;
+    }
+    LOG_INFO(LOG_RX, "Started %d run-to-completion workers (queue depth %u).", rx_worker_count, queue_capacity);
+    return 0;
+}
+
+void rx_dispatch_shutdown() {
+    if(rx_workers == NULL) return;
+    atomic_store(&rx_workers_running, false);
+    for(int i = 0; i < rx_workers_started; i++) {
+        rx_worker_t* worker = &rx_workers[i];
+        if(worker->started) {
+            sem_post(&worker->wakeup);
+            if(pthread_join(worker->tid, NULL) != 0) perror(ANSI_COLOR_RESET ANSI_COLOR_YELLOW "RX Warning: Failed to join receive worker thread");
+        }
+        sem_destroy(&worker->wakeup);
+        free(worker->queue);
+    }
+    free(rx_workers);
+    rx_workers = NULL;
+    rx_workers_started = 0;
+    LOG_INFO(LOG_RX, "Receive workers stopped.");
+}
+
+static void rx_task_run(void* param) {
+    rx_task_t task = *(rx_task_t*)param;
+    buffer_pool_free(param);
+    metrics_inc(METRIC_RX_STARTED);
+    if(latency_tracing) latency_thread_trace = task.trace;
+    task.handler(task.data);
+}
+
+static int rx_pipeline_submit(void (*handler)(void*), void* data) {
+    if(thpool == NULL) return -1;
+    rx_task_t* task = (rx_task_t*)buffer_pool_alloc(sizeof(rx_task_t));
+    if(task == NULL) return -1;
+    task->handler = handler;
+    task->data = data;
+    task->trace = latency_thread_trace;
+    metrics_inc(METRIC_RX_QUEUED);
+    if(thpool_add_work(thpool, rx_task_run, task) != 0) {
+        metrics_inc(METRIC_RX_STARTED); // Keeps queued - started equal to the queue depth
+        buffer_pool_free(task);
+        return -1;
+    }
+    return 0;
+}
+
+int rx_dispatch_frame(physical_rx_frame_t* frame) {
+    if(rx_mode == RX_MODE_PIPELINE) {
+        if(rx_pipeline_submit((void (*)(void*))handle_physical_to_data_link, frame) == 0) return 0;
+        metrics_inc(METRIC_RX_DISPATCH_FAILURES);
+        return -1;
+    }
+    if(rx_workers == NULL) return -1;
+    // Frames of one flow share a hash, so they stay on one worker and in order. Receive queue q feeds only the
+    // workers w with w % queues == q, so each worker is filled by one receiver thread.
+    uint32_t queues = physical_rx_queues;
+    uint32_t owned = ((uint32_t)rx_worker_count - frame->queue + queues - 1) / queues;
+    rx_worker_t* worker = &rx_workers[frame->queue + queues * ((frame->flow_hash / queues) % owned)];
+    uint64_t head = atomic_load_explicit(&worker->head, memory_order_relaxed);
+    if(head - atomic_load_explicit(&worker->tail, memory_order_acquire) >= rx_queue_capacity) {
+        metrics_inc(METRIC_RX_DISPATCH_FAILURES);
+        return -1;
+    }
+    if(latency_tracing) frame->trace = latency_thread_trace;
+    worker->queue[head % rx_queue_capacity] = frame;
+    metrics_inc(METRIC_RX_QUEUED);
+    atomic_store(&worker->head, head + 1);
+    if(atomic_exchange(&worker->sleeping, false)) sem_post(&worker->wakeup);
+    return 0;
+}
+
+int rx_dispatch_next(void (*handler)(void*), void* data) {
+    if(rx_mode == RX_MODE_RUN_TO_COMPLETION) {
+        handler(data);
+        return 0;
+    }
+    if(rx_pipeline_submit(handler, data) == 0) return 0;
+    metrics_inc(METRIC_RX_DISPATCH_FAILURES);
+    return -1;
+}
@@ -0,0 +1,76 @@
+#include "headers/stack.h"
+#include "headers/variables.h"
+#include "headers/thread-pool.h"
+#include "headers/physical-impl.h"
+#include "headers/data-link-impl.h"
+#include "headers/data-link-kernels.h"
+#include "headers/rx-dispatch.h"
+#include "headers/buffer-pool.h"
+#include "headers/log.h"
+#include "headers/metrics.h"
+#include "headers/latency.h"
+#include "headers/network-impl.h"
+#include "headers/transport-impl.h"
+#include "headers/reliable-impl.h"
+#include "headers/application-impl.h"
+#include <stdio.h>
+#include <string.h>
+
+char source_mac_address[20];
+char destination_mac_address[20];
+threadpool thpool = NULL;
+
+int stack_init(const char* source_mac, const char* destination_mac) {
+    snprintf(source_mac_address, sizeof(source_mac_address), "%s", source_mac);
+    snprintf(destination_mac_address, sizeof(destination_mac_address), "%s", destination_mac);
+    if(metrics_init(source_mac_address) != 0) LOG_WARN(LOG_MAIN, "Metrics are not published; protocol_stack_stats cannot attach to this instance.");
+    LOG_INFO(LOG_MAIN, "Source MAC (Listening ID): %s", source_mac_address);
+    LOG_INFO(LOG_MAIN, "Destination MAC (Sending Target ID): %s", destination_mac_address);
+    thpool = thpool_init(STACK_THREAD_POOL_THREADS);
+    if(thpool == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "STACK Error: Failed to initialize thread pool.\n");
+        metrics_shutdown();
+        return -1;
+    }
+    LOG_INFO(LOG_MAIN, "Thread pool initialized with %d threads.", STACK_THREAD_POOL_THREADS);
+    data_link_kernels_init();
+    LOG_INFO(LOG_MAIN, "Data link stuffing kernel: %s, FCS: %s (CRC-32C via %s).", data_link_kernel_name(data_link_kernel_active()), data_link_fcs_name(data_link_fcs_mode), data_link_crc_name(data_link_crc_active()));
+    if(rx_mode == RX_MODE_RUN_TO_COMPLETION) LOG_INFO(LOG_MAIN, "Receive mode: %s with %d flow-affine workers.", rx_mode_name(rx_mode), rx_worker_count);
+    else LOG_INFO(LOG_MAIN, "Receive mode: %s (thread pool task per layer).", rx_mode_name(rx_mode));
+    network_layer_init();
+    transport_layer_init();
+    int failed = reliable_layer_init();
+    if(failed == 0) failed = application_layer_init();
+    if(failed == 0 && (failed = physical_layer_init()) != 0) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "STACK Error: Failed to initialize physical layer.\n");
+    if(failed != 0) {
+        thpool_destroy(thpool);
+        thpool = NULL;
+        reliable_layer_shutdown();
+        reliable_layer_destroy();
+        transport_layer_shutdown();
+        network_layer_shutdown();
+        metrics_shutdown();
+        return -1;
+    }
+    LOG_INFO(LOG_MAIN, "Physical layer initialized and receiver started.");
+    return 0;
+}
+
+void stack_shutdown() {
+    // Stop retransmitting before the link goes away.
+    reliable_layer_shutdown();
+    physical_layer_shutdown();
+    network_layer_shutdown();
+    if(thpool) {
+        thpool_destroy(thpool);
+        thpool = NULL;
+        LOG_INFO(LOG_MAIN, "Thread pool destroyed.");
+    }
+    application_layer_shutdown();
+    // The receive paths are gone, so nothing can still take a port lock or wake the transmitter.
+    reliable_layer_destroy();
+    transport_layer_shutdown();
+    if(LOG_ENABLED(LOG_LEVEL_DEBUG, LOG_POOL)) buffer_pool_print_stats();
+    if(latency_tracing) latency_print();
+    metrics_shutdown();
+}
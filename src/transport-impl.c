@@ -1,84 +1,343 @@
 #include "headers/transport-impl.h"
 #include "headers/application-impl.h"
 #include "headers/network-impl.h"
+#include "headers/checksum.h"
 #include "headers/thread-pool.h"
+#include "headers/rx-dispatch.h"
+#include "headers/buffer-pool.h"
+#include "headers/log.h"
+#include "headers/metrics.h"
+#include "headers/latency.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 
-extern bool DEBUG_ENABLED;
 extern threadpool thpool;
 
+struct transport_endpoint {
+    uint16_t port;
+    _Atomic uint32_t references; // The binding plus every datagram on its way to the endpoint
+    transport_receive_callback_t callback;
+    void* context;
+    pthread_mutex_t lock;
+    pthread_cond_t readable;
+    bool closed;
+    packet_buffer_t** queue;
+    uint32_t queue_capacity;
+    uint32_t queue_head;
+    uint32_t queue_count;
+};
+
+// Kept in the control area of a received datagram's packet buffer from the transport hop until it is released.
+typedef struct {
+    transport_message_t message;
+    transport_endpoint_t* endpoint;
+} transport_receive_control_t;
+
+_Static_assert(sizeof(transport_receive_control_t) <= PACKET_BUFFER_CONTROL_SIZE, "transport state must fit the packet buffer control area");
+
+// Indexed by port. Lookups take only the lock of their stripe, so different ports rarely contend.
+static transport_endpoint_t* transport_ports[TRANSPORT_PORT_COUNT];
+static pthread_mutex_t transport_port_locks[TRANSPORT_PORT_LOCK_STRIPES];
+
+// Both addresses, the protocol number and the UDP length.
+static uint64_t udp_pseudo_header_sum(uint32_t src_address, uint32_t dest_address, uint16_t udp_length) {
+    uint64_t sum = internet_checksum_add16(internet_checksum_add16(0, UDP_PROTOCOL_NUMBER), udp_length);
+    sum = internet_checksum_add16(internet_checksum_add16(sum, (uint16_t)(src_address >> 16)), (uint16_t)src_address);
+    return internet_checksum_add16(internet_checksum_add16(sum, (uint16_t)(dest_address >> 16)), (uint16_t)dest_address);
+}
+
+static void transport_endpoint_release(transport_endpoint_t* endpoint) {
+    if(atomic_fetch_sub_explicit(&endpoint->references, 1, memory_order_acq_rel) != 1) return;
+    for(uint32_t i = 0; i < endpoint->queue_count; i++) packet_buffer_release(endpoint->queue[(endpoint->queue_head + i) % endpoint->queue_capacity]);
+    free(endpoint->queue);
+    pthread_cond_destroy(&endpoint->readable);
+    pthread_mutex_destroy(&endpoint->lock);
+    free(endpoint);
+}
+
+static transport_endpoint_t* transport_endpoint_lookup(uint16_t port) {
+    pthread_mutex_t* lock = &transport_port_locks[port % TRANSPORT_PORT_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    transport_endpoint_t* endpoint = transport_ports[port];
+    if(endpoint != NULL) atomic_fetch_add_explicit(&endpoint->references, 1, memory_order_relaxed);
+    pthread_mutex_unlock(lock);
+    return endpoint;
+}
+
+// Final receive hop: lends the datagram to the endpoint's callback or appends it to its queue.
+static void transport_deliver(void* data) {
+    packet_buffer_t* packet = (packet_buffer_t*)data;
+    transport_receive_control_t* control = (transport_receive_control_t*)packet->control;
+    transport_endpoint_t* endpoint = control->endpoint;
+    LATENCY_MARK(LATENCY_RX_QUEUE_APPLICATION);
+    if(endpoint->callback != NULL) {
+        metrics_inc(METRIC_APP_MESSAGES_RECEIVED);
+        endpoint->callback(endpoint, &control->message, endpoint->context);
+    }
+    else {
+        pthread_mutex_lock(&endpoint->lock);
+        if(endpoint->closed || endpoint->queue_count == endpoint->queue_capacity) {
+            pthread_mutex_unlock(&endpoint->lock);
+            metrics_inc(METRIC_TP_QUEUE_DROPS);
+            LOG_DEBUG(LOG_TRANSPORT, "Receive queue of port %u is full. Dropping datagram.", endpoint->port);
+            packet_buffer_release(packet);
+        }
+        else {
+            endpoint->queue[(endpoint->queue_head + endpoint->queue_count) % endpoint->queue_capacity] = packet;
+            endpoint->queue_count++;
+            pthread_cond_signal(&endpoint->readable);
+            pthread_mutex_unlock(&endpoint->lock);
+            metrics_inc(METRIC_APP_MESSAGES_RECEIVED);
+        }
+    }
+    transport_endpoint_release(endpoint);
+    LATENCY_MARK(LATENCY_RX_APPLICATION);
+    LATENCY_END(LATENCY_RX_TOTAL);
+}
+
+// Takes ownership of the datagram's packet buffer. The checksum is verified in place and the UDP header
+// pulled off, so the application receives a view of the same buffer the data link destuffed into.
 void handle_network_to_transport(void* network_payload) {
     if(network_payload == NULL) {
         fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Received NULL data pointer from network layer.\n");
         return;
     }
-    unsigned char* udp_segment = (unsigned char*)network_payload;
-    if(true) {
-        simple_udp_header_t* udp_header = (simple_udp_header_t*)udp_segment;
+    LATENCY_MARK(LATENCY_RX_QUEUE_TRANSPORT);
+    packet_buffer_t* packet = (packet_buffer_t*)network_payload;
+    network_receive_control_t addresses = *(const network_receive_control_t*)packet->control;
+    size_t header_size = sizeof(simple_udp_header_t);
+    if(packet->length >= header_size) {
+        simple_udp_header_t* udp_header = (simple_udp_header_t*)packet->data;
         uint16_t src_port = udp_header->src_port;
         uint16_t dest_port = udp_header->dest_port;
         uint16_t udp_length = udp_header->length;
         uint16_t checksum = udp_header->checksum;
-        size_t header_size = sizeof(simple_udp_header_t);
-        if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_CYAN "TRANSPORT: Received UDP segment. Src Port: %u, Dest Port: %u, Length Field: %u\n", src_port, dest_port, udp_length);
-        if(udp_length < header_size) {
-            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: UDP header length (%u) < UDP header struct size (%zu). Discarding.\n", udp_length, header_size);
-            free(network_payload);
+        LOG_DEBUG(LOG_TRANSPORT, "Received UDP segment. Src Port: %u, Dest Port: %u, Length Field: %u", src_port, dest_port, udp_length);
+        metrics_inc(METRIC_TP_SEGMENTS_RECEIVED);
+        if(udp_length < header_size || udp_length > packet->length) {
+            metrics_inc(METRIC_TP_MALFORMED);
+            LOG_WARN(LOG_TRANSPORT, "UDP header length (%u) outside UDP header size (%zu) to datagram size (%zu). Discarding.", udp_length, header_size, packet->length);
+            packet_buffer_release(packet);
             return;
         }
-        if(checksum != 0) { }
-        size_t app_payload_size = udp_length - header_size;
-        unsigned char* app_payload = (unsigned char*)malloc(app_payload_size);
-        if(app_payload) {
-            memcpy(app_payload, udp_segment + header_size, app_payload_size);
-            if(thpool != NULL) {
-                if(thpool_add_work(thpool, (void (*)(void*))handle_transport_to_application, app_payload) != 0) {
-                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Failed to add task to thread pool for Application Layer.\n");
-                    free(app_payload);
-                }
-                else if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_CYAN "TRANSPORT: UDP Payload (Size: %zu) passed to thread pool for APP processing.\n", app_payload_size);
-            }
-            else {
-                fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Thread pool is NULL when trying to add APP work.\n");
-                free(app_payload);
+        packet_buffer_trim(packet, udp_length);
+        // A zero checksum means the sender did not compute one.
+        if(checksum != 0 && internet_checksum_fold(internet_checksum_add(udp_pseudo_header_sum(addresses.src_address, addresses.dest_address, udp_length), packet->data, udp_length)) != 0) {
+            metrics_inc(METRIC_TP_CHECKSUM_FAILURES);
+            LOG_WARN(LOG_TRANSPORT, "UDP checksum mismatch (Received=0x%04X). Discarding.", checksum);
+            packet_buffer_release(packet);
+            return;
+        }
+        transport_endpoint_t* endpoint = transport_endpoint_lookup(dest_port);
+        if(endpoint == NULL) {
+            metrics_inc(METRIC_TP_NO_PORT);
+            LOG_DEBUG(LOG_TRANSPORT, "No endpoint bound to port %u. Discarding.", dest_port);
+            packet_buffer_release(packet);
+            return;
+        }
+        packet_buffer_pull(packet, header_size);
+        transport_receive_control_t* control = (transport_receive_control_t*)packet->control;
+        control->message = (transport_message_t){ .data = packet->data, .length = packet->length, .src_address = addresses.src_address, .src_port = src_port, .dest_port = dest_port, .block = packet };
+        control->endpoint = endpoint;
+        if(thpool != NULL) {
+            metrics_add(METRIC_TP_BYTES_RECEIVED, packet->length);
+            LATENCY_MARK(LATENCY_RX_TRANSPORT);
+            if(rx_dispatch_next(transport_deliver, packet) == 0) {
+                LOG_DEBUG(LOG_TRANSPORT, "UDP Payload (Size: %u) passed to thread pool for port %u.", udp_length - (unsigned)header_size, dest_port);
+                return;
             }
+            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Failed to add task to thread pool for Application Layer.\n");
         }
-        else fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Failed to allocate memory for application payload.\n");
+        else fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Thread pool is NULL when trying to add APP work.\n");
+        transport_endpoint_release(endpoint);
     }
-    else if(DEBUG_ENABLED) fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Received data block too small for UDP header.\n");
-    free(network_payload);
+    else LOG_WARN(LOG_TRANSPORT, "Received data block too small for UDP header.");
+    packet_buffer_release(packet);
 }
 
-int handle_application_to_transport(const unsigned char* app_data, size_t app_data_length, uint16_t src_port, uint16_t dest_port) {
-    if(app_data == NULL && app_data_length > 0) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Send request from application with NULL data but positive length (%zu).\n", app_data_length);
+int handle_application_to_transport(const unsigned char* app_data, size_t app_data_length, uint16_t src_port, uint32_t dest_address, uint16_t dest_port) {
+    struct iovec iov = { (void*)app_data, app_data_length };
+    return handle_application_to_transport_iov(&iov, 1, src_port, dest_address, dest_port);
+}
+
+// The application's bytes are borrowed, not copied: the segment only references them until the send returns,
+// and the data link stuffs them straight into the outgoing frames.
+int handle_application_to_transport_iov(const struct iovec* iov, int iov_count, uint16_t src_port, uint32_t dest_address, uint16_t dest_port) {
+    if(iov_count < 0 || iov_count > TRANSPORT_MAX_IOV || (iov == NULL && iov_count > 0)) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Send request from application with %d buffers (0-%d).\n", iov_count, TRANSPORT_MAX_IOV);
         return -1;
     }
+    size_t app_data_length = 0;
+    for(int i = 0; i < iov_count; i++) {
+        if(iov[i].iov_base == NULL && iov[i].iov_len > 0) {
+            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Send request from application with NULL data but positive length (%zu).\n", iov[i].iov_len);
+            return -1;
+        }
+        app_data_length += iov[i].iov_len;
+    }
+    LATENCY_MARK(LATENCY_TX_APPLICATION);
     size_t udp_header_size = sizeof(simple_udp_header_t);
     size_t udp_segment_length = udp_header_size + app_data_length;
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_CYAN "TRANSPORT: Sending %zu bytes of app data from Port %u to Port %u.\n", app_data_length, src_port, dest_port);
-    unsigned char* udp_segment = (unsigned char*)malloc(udp_segment_length);
+    if(udp_segment_length > UINT16_MAX) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Application data (%zu bytes) does not fit a UDP segment.\n", app_data_length);
+        return -1;
+    }
+    LOG_DEBUG(LOG_TRANSPORT, "Sending %zu bytes of app data in %d buffer(s) from Port %u to Port %u.", app_data_length, iov_count, src_port, dest_port);
+    packet_buffer_t* udp_segment = packet_buffer_alloc(PACKET_BUFFER_DEFAULT_HEADROOM, 0);
     if(!udp_segment) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Failed to allocate memory for UDP segment.\n");
+        LOG_WARN(LOG_TRANSPORT, "Failed to allocate memory for UDP segment.");
         return -1;
     }
-    simple_udp_header_t* udp_header = (simple_udp_header_t*)udp_segment;
+    simple_udp_header_t* udp_header = (simple_udp_header_t*)packet_buffer_push(udp_segment, udp_header_size);
     udp_header->src_port = src_port;
     udp_header->dest_port = dest_port;
     udp_header->length = udp_segment_length;
     udp_header->checksum = 0;
-    memcpy(udp_segment + udp_header_size, app_data, app_data_length);
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_CYAN "TRANSPORT: UDP Segment created (Total Length: %zu).\n", udp_segment_length);
-    if(handle_transport_to_network(udp_segment, udp_segment_length, UDP_PROTOCOL_NUMBER) != 0) {
-        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Network layer failed to send UDP segment.\n");
-        free(udp_segment);
+    uint64_t sum = internet_checksum_add(udp_pseudo_header_sum(network_local_address, dest_address, udp_header->length), udp_header, udp_header_size);
+    size_t offset = 0;
+    for(int i = 0; i < iov_count; i++) {
+        if(iov[i].iov_len == 0) continue;
+        packet_buffer_attach(udp_segment, (const unsigned char*)iov[i].iov_base, iov[i].iov_len, NULL);
+        sum = internet_checksum_add_at(sum, iov[i].iov_base, iov[i].iov_len, offset);
+        offset += iov[i].iov_len;
+    }
+    uint16_t checksum = internet_checksum_fold(sum);
+    udp_header->checksum = checksum == 0 ? 0xFFFF : checksum;
+    LOG_DEBUG(LOG_TRANSPORT, "UDP Segment created (Total Length: %zu, Checksum: 0x%04X).", udp_segment_length, udp_header->checksum);
+    if(handle_transport_to_network(udp_segment, UDP_PROTOCOL_NUMBER, dest_address) != 0) {
+        LOG_WARN(LOG_TRANSPORT, "Network layer failed to send UDP segment.");
+        packet_buffer_release(udp_segment);
         return -1;
     }
-    free(udp_segment);
-    if(DEBUG_ENABLED) printf(ANSI_COLOR_RESET ANSI_COLOR_BRIGHT_CYAN "TRANSPORT: UDP Segment successfully sent to network layer.\n");
+    packet_buffer_release(udp_segment);
+    metrics_inc(METRIC_TP_SEGMENTS_SENT);
+    metrics_add(METRIC_TP_BYTES_SENT, app_data_length);
+    LOG_DEBUG(LOG_TRANSPORT, "UDP Segment successfully sent to network layer.");
     return 0;
-}
\ No newline at end of file
+}
+
+void transport_layer_init() {
+    for(int i = 0; i < TRANSPORT_PORT_LOCK_STRIPES; i++) pthread_mutex_init(&transport_port_locks[i], NULL);
+    memset(transport_ports, 0, sizeof(transport_ports));
+}
+
+void transport_layer_shutdown() {
+    for(uint32_t port = 0; port < TRANSPORT_PORT_COUNT; port++) {
+        if(transport_ports[port] != NULL) {
+            LOG_DEBUG(LOG_TRANSPORT, "Closing endpoint on port %u.", port);
+            transport_unbind(transport_ports[port]);
+        }
+    }
+    for(int i = 0; i < TRANSPORT_PORT_LOCK_STRIPES; i++) pthread_mutex_destroy(&transport_port_locks[i]);
+}
+
+transport_endpoint_t* transport_bind(uint16_t port, transport_receive_callback_t callback, void* context, uint32_t queue_depth) {
+    if(queue_depth == 0) queue_depth = TRANSPORT_DEFAULT_QUEUE_DEPTH;
+    if(callback == NULL && queue_depth > TRANSPORT_MAX_QUEUE_DEPTH) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Receive queue depth %u exceeds %d.\n", queue_depth, TRANSPORT_MAX_QUEUE_DEPTH);
+        return NULL;
+    }
+    transport_endpoint_t* endpoint = (transport_endpoint_t*)calloc(1, sizeof(transport_endpoint_t));
+    if(endpoint == NULL) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Failed to allocate endpoint for port %u.\n", port);
+        return NULL;
+    }
+    endpoint->port = port;
+    endpoint->callback = callback;
+    endpoint->context = context;
+    atomic_init(&endpoint->references, 1);
+    if(callback == NULL) {
+        endpoint->queue = (packet_buffer_t**)malloc(queue_depth * sizeof(packet_buffer_t*));
+        if(endpoint->queue == NULL) {
+            fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Failed to allocate receive queue for port %u.\n", port);
+            free(endpoint);
+            return NULL;
+        }
+        endpoint->queue_capacity = queue_depth;
+    }
+    pthread_mutex_init(&endpoint->lock, NULL);
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&endpoint->readable, &attributes);
+    pthread_condattr_destroy(&attributes);
+    pthread_mutex_t* lock = &transport_port_locks[port % TRANSPORT_PORT_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    bool taken = transport_ports[port] != NULL;
+    if(!taken) transport_ports[port] = endpoint;
+    pthread_mutex_unlock(lock);
+    if(taken) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "TRANSPORT Error: Port %u is already bound.\n", port);
+        transport_endpoint_release(endpoint);
+        return NULL;
+    }
+    LOG_DEBUG(LOG_TRANSPORT, "Bound port %u (%s).", port, callback != NULL ? "callback" : "receive queue");
+    return endpoint;
+}
+
+void transport_unbind(transport_endpoint_t* endpoint) {
+    if(endpoint == NULL) return;
+    pthread_mutex_t* lock = &transport_port_locks[endpoint->port % TRANSPORT_PORT_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    if(transport_ports[endpoint->port] == endpoint) transport_ports[endpoint->port] = NULL;
+    pthread_mutex_unlock(lock);
+    pthread_mutex_lock(&endpoint->lock);
+    endpoint->closed = true;
+    pthread_cond_broadcast(&endpoint->readable);
+    pthread_mutex_unlock(&endpoint->lock);
+    LOG_DEBUG(LOG_TRANSPORT, "Unbound port %u.", endpoint->port);
+    // Datagrams still on their way hold references; the last one frees the endpoint.
+    transport_endpoint_release(endpoint);
+}
+
+uint16_t transport_endpoint_port(const transport_endpoint_t* endpoint) {
+    return endpoint->port;
+}
+
+int transport_recv_many(transport_endpoint_t* endpoint, transport_message_t* messages, size_t max_messages, int timeout_ms) {
+    if(endpoint == NULL || endpoint->callback != NULL || (messages == NULL && max_messages > 0)) return -1;
+    atomic_fetch_add_explicit(&endpoint->references, 1, memory_order_relaxed);
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if(timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if(deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+    pthread_mutex_lock(&endpoint->lock);
+    int error = 0;
+    while (endpoint->queue_count == 0 && !endpoint->closed && timeout_ms != 0 && error != ETIMEDOUT) {
+        if(timeout_ms < 0) pthread_cond_wait(&endpoint->readable, &endpoint->lock);
+        else error = pthread_cond_timedwait(&endpoint->readable, &endpoint->lock, &deadline);
+    }
+    int received = 0;
+    if(endpoint->queue_count == 0 && endpoint->closed) received = -1;
+    while (endpoint->queue_count > 0 && (size_t)received < max_messages) {
+        packet_buffer_t* packet = endpoint->queue[endpoint->queue_head];
+        endpoint->queue_head = (endpoint->queue_head + 1) % endpoint->queue_capacity;
+        endpoint->queue_count--;
+        messages[received] = ((transport_receive_control_t*)packet->control)->message;
+        received++;
+    }
+    pthread_mutex_unlock(&endpoint->lock);
+    transport_endpoint_release(endpoint);
+    return received;
+}
+
+void transport_message_release(transport_message_t* message) {
+    if(message == NULL || message->block == NULL) return;
+    // The message may live in the control area of the buffer it releases.
+    packet_buffer_t* packet = (packet_buffer_t*)message->block;
+    message->block = NULL;
+    message->data = NULL;
+    packet_buffer_release(packet);
+}
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "headers/metrics.h"
+#include "headers/colors.h"
+
+#define STATS_HEADER_EVERY 20
+
+typedef struct {
+    uint64_t values[METRIC_COUNT];
+    struct timespec taken;
+} stats_sample_t;
+
+static volatile sig_atomic_t stats_stop = 0;
+
+static void stats_handle_sigint(int sig) {
+    (void)sig;
+    stats_stop = 1;
+}
+
+static const metrics_segment_t* stats_attach(const char* mac_address) {
+    char name[64];
+    metrics_segment_name(mac_address, name, sizeof(name));
+    int fd = shm_open(name, O_RDONLY, 0);
+    if(fd == -1) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "STATS Error: Cannot open %s. Is instance '%s' running?\n", name, mac_address);
+        return NULL;
+    }
+    struct stat shm_stat;
+    void* ptr = MAP_FAILED;
+    if(fstat(fd, &shm_stat) == 0 && (size_t)shm_stat.st_size >= sizeof(metrics_segment_t)) ptr = mmap(NULL, sizeof(metrics_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "STATS Error: %s is not a metrics segment of this version.\n", name);
+        return NULL;
+    }
+    const metrics_segment_t* segment = (const metrics_segment_t*)ptr;
+    if(segment->magic != METRICS_MAGIC || segment->version != METRICS_VERSION || segment->metric_count != METRIC_COUNT || segment->slot_size != sizeof(metrics_slot_t)) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "STATS Error: %s was published by an incompatible build.\n", name);
+        munmap(ptr, sizeof(metrics_segment_t));
+        return NULL;
+    }
+    return segment;
+}
+
+static void stats_take(const metrics_segment_t* segment, stats_sample_t* sample) {
+    for(int i = 0; i < METRIC_COUNT; i++) sample->values[i] = metrics_total(segment, (metric_id_t)i);
+    clock_gettime(CLOCK_MONOTONIC, &sample->taken);
+}
+
+static double stats_rate(const stats_sample_t* now, const stats_sample_t* before, metric_id_t metric, double seconds) {
+    return seconds > 0 ? (double)(now->values[metric] - before->values[metric]) / seconds : 0;
+}
+
+static uint64_t stats_delta(const stats_sample_t* now, const stats_sample_t* before, metric_id_t metric) {
+    return now->values[metric] - before->values[metric];
+}
+
+static void stats_print_header() {
+    printf("%-26s %-21s %-17s %5s | %s\n", "-------- frames/s --------", "-------- MB/s -------", "-- messages/s ---", "queue", "--------------- drops since last report ---------------");
+    printf("%8s %8s %8s %10s %10s %8s %8s %5s | %5s %5s %5s %5s %5s %5s %5s %5s %5s\n", "rx", "tx", "dgram", "rx", "tx", "app-rx", "app-tx", "rxq", "fcs", "frame", "ipck", "udpck", "malf", "rto", "rdrop", "port", "nomem");
+}
+
+static void stats_print_row(const stats_sample_t* now, const stats_sample_t* before, double seconds) {
+    uint64_t queued = now->values[METRIC_RX_QUEUED], started = now->values[METRIC_RX_STARTED];
+    printf("%8.0f %8.0f %8.0f %10.2f %10.2f %8.0f %8.0f %5llu | %5llu %5llu %5llu %5llu %5llu %5llu %5llu %5llu %5llu\n",
+            stats_rate(now, before, METRIC_PHY_FRAMES_RECEIVED, seconds),
+            stats_rate(now, before, METRIC_PHY_FRAMES_SENT, seconds),
+            stats_rate(now, before, METRIC_NW_DATAGRAMS_RECEIVED, seconds),
+            stats_rate(now, before, METRIC_PHY_BYTES_RECEIVED, seconds) / 1e6,
+            stats_rate(now, before, METRIC_PHY_BYTES_SENT, seconds) / 1e6,
+            stats_rate(now, before, METRIC_APP_MESSAGES_RECEIVED, seconds),
+            stats_rate(now, before, METRIC_APP_MESSAGES_SENT, seconds),
+            (unsigned long long)(queued > started ? queued - started : 0),
+            (unsigned long long)stats_delta(now, before, METRIC_DL_FCS_FAILURES),
+            (unsigned long long)stats_delta(now, before, METRIC_DL_FRAMING_ERRORS),
+            (unsigned long long)stats_delta(now, before, METRIC_NW_CHECKSUM_FAILURES),
+            (unsigned long long)stats_delta(now, before, METRIC_TP_CHECKSUM_FAILURES),
+            (unsigned long long)(stats_delta(now, before, METRIC_NW_MALFORMED) + stats_delta(now, before, METRIC_TP_MALFORMED) + stats_delta(now, before, METRIC_PHY_INVALID_SLOTS)),
+            (unsigned long long)stats_delta(now, before, METRIC_NW_REASSEMBLY_TIMEOUTS),
+            (unsigned long long)(stats_delta(now, before, METRIC_NW_REASSEMBLY_DROPS) + stats_delta(now, before, METRIC_RX_DISPATCH_FAILURES) + stats_delta(now, before, METRIC_PHY_SEND_DROPS)),
+            (unsigned long long)(stats_delta(now, before, METRIC_TP_NO_PORT) + stats_delta(now, before, METRIC_TP_QUEUE_DROPS)),
+            (unsigned long long)stats_delta(now, before, METRIC_ALLOC_FAILURES));
+    fflush(stdout);
+}
+
+static void stats_print_all(const metrics_segment_t* segment, const stats_sample_t* now, const stats_sample_t* before, double seconds) {
+    printf("%-28s %16s %14s\n", "counter", "total", "per second");
+    for(int i = 0; i < METRIC_COUNT; i++) printf("%-28s %16llu %14.1f\n", segment->names[i], (unsigned long long)now->values[i], stats_rate(now, before, (metric_id_t)i, seconds));
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"interval", required_argument, NULL, 'i'},
+        {"count", required_argument, NULL, 'n'},
+        {"all", no_argument, NULL, 'a'},
+        {NULL, 0, NULL, 0}
+    };
+    double interval = 1.0;
+    long count = 0;
+    int show_all = 0;
+    bool usage_error = false;
+    int option;
+    while ((option = getopt_long(argc, argv, "i:n:a", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'i': {
+                char* end = NULL;
+                interval = strtod(optarg, &end);
+                if(end == optarg || *end != '\0' || interval < 0.01) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "STATS Error: Invalid interval '%s' (seconds, at least 0.01).\n", optarg);
+                    usage_error = true;
+                }
+                break;
+            }
+            case 'n': {
+                char* end = NULL;
+                count = strtol(optarg, &end, 10);
+                if(end == optarg || *end != '\0' || count < 1) {
+                    fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "STATS Error: Invalid count '%s'.\n", optarg);
+                    usage_error = true;
+                }
+                break;
+            }
+            case 'a':
+                show_all = 1;
+                break;
+            default:
+                usage_error = true;
+                break;
+        }
+    }
+    if(usage_error || argc - optind != 1) {
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "Usage: %s [options] <mac>\n", argv[0]);
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  <mac>                : Identifier of the running instance to watch.\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -i, --interval <sec> : Seconds between reports (default 1).\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -n, --count <n>      : Stop after n reports (default: until Ctrl+C or the instance exits).\n");
+        fprintf(stderr, ANSI_COLOR_RESET COLOR_ERR "  -a, --all            : Print every counter instead of the summary columns.\n");
+        return 1;
+    }
+    const metrics_segment_t* segment = stats_attach(argv[optind]);
+    if(segment == NULL) return 1;
+    signal(SIGINT, stats_handle_sigint);
+    printf(ANSI_COLOR_RESET "Watching '%s' (pid %d). The first report covers the time since it started.\n", argv[optind], segment->pid);
+    // Like vmstat, the first report is the average since the instance started.
+    stats_sample_t before, now;
+    memset(&before, 0, sizeof(before));
+    stats_take(segment, &now);
+    double seconds = difftime(time(NULL), (time_t)segment->start_time);
+    if(seconds < 1) seconds = 1;
+    long reports = 0;
+    while (true) {
+        if(show_all) stats_print_all(segment, &now, &before, seconds);
+        else {
+            if(reports % STATS_HEADER_EVERY == 0) stats_print_header();
+            stats_print_row(&now, &before, seconds);
+        }
+        reports++;
+        if((count > 0 && reports >= count) || stats_stop) break;
+        if(!atomic_load_explicit(&segment->active, memory_order_acquire)) {
+            printf("Instance '%s' has shut down.\n", argv[optind]);
+            break;
+        }
+        struct timespec pause = { (time_t)interval, (long)((interval - (double)(time_t)interval) * 1e9) };
+        nanosleep(&pause, NULL);
+        if(stats_stop) break;
+        before = now;
+        stats_take(segment, &now);
+        seconds = (double)(now.taken.tv_sec - before.taken.tv_sec) + (double)(now.taken.tv_nsec - before.taken.tv_nsec) / 1e9;
+    }
+    munmap((void*)segment, sizeof(metrics_segment_t));
+    return 0;
+}